@@ -0,0 +1,152 @@
+#pragma once
+
+#include <geom/basic_algorithm.h>
+#include <geom/basics.h>
+#include <geom/sector.h>
+#include <geom/soa.h>
+
+#include <cmath>
+#include <cstddef>
+#include <random>
+#include <string_view>
+#include <utility>
+
+namespace geom::bench
+{
+
+// Input classes of distance benchmarks, each one takes its own path in geom::distance.
+enum class input_class {
+    crossing,   // skew lines, closest points are inside both segments
+    parallel,   // parallel segments at random offset
+    collinear,  // overlapping segments on one line
+    degenerate, // point against segment
+    random,     // uniform ends in a cube
+    // Parallel threshold cases: almost parallel or opposite lines, too short and zero length segments.
+    near_degenerate,
+};
+
+inline constexpr input_class all_input_classes[] = {
+    input_class::crossing,
+    input_class::parallel,
+    input_class::collinear,
+    input_class::degenerate,
+    input_class::random,
+    input_class::near_degenerate,
+};
+
+inline std::string_view to_string(input_class c) {
+    switch (c) {
+    case input_class::crossing: return "crossing";
+    case input_class::parallel: return "parallel";
+    case input_class::collinear: return "collinear";
+    case input_class::degenerate: return "degenerate";
+    case input_class::random: return "random";
+    case input_class::near_degenerate: return "near_degenerate";
+    }
+    return "unknown";
+}
+
+template<std::floating_point scalar_type>
+class Pairs_generator {
+public:
+    using point = Point_3D<scalar_type>;
+    using vector = Vector_3D<scalar_type>;
+    using sector = Sector_3D<scalar_type>;
+
+    explicit Pairs_generator(unsigned seed = 42)
+        : gen{ seed }
+    {}
+
+    std::pair<sector, sector> operator()(input_class c) {
+        switch (c) {
+        case input_class::crossing: {
+            // Closest points of the lines are p and p + h on both segments.
+            point p = gen_point();
+            vector h = gen_vector();
+            vector v = gen_vector();
+            vector w = gen_vector();
+            return {sector{p + v * uniform(-1., -.25), p + v * uniform(.25, 1.)},
+                    sector{(p + h) + w * uniform(-1., -.25), (p + h) + w * uniform(.25, 1.)}};
+        }
+        case input_class::parallel: {
+            point p = gen_point();
+            vector v = gen_vector();
+            vector h = gen_vector();
+            return {sector{p, p + v}, sector{p + h, (p + h) + v * uniform(.5, 2.)}};
+        }
+        case input_class::collinear: {
+            point p = gen_point();
+            vector v = gen_vector();
+            return {sector{p, p + v}, sector{p + v * uniform(-.5, .5), p + v * uniform(.5, 1.5)}};
+        }
+        case input_class::degenerate: {
+            point p = gen_point();
+            return {sector{p, p}, sector{gen_point(), gen_point()}};
+        }
+        case input_class::random:
+            return {sector{gen_point(), gen_point()}, sector{gen_point(), gen_point()}};
+        case input_class::near_degenerate: {
+            point p = gen_point();
+            vector v = gen_vector();
+            vector h = gen_vector();
+            // Squared sine of the angle between the lines is around epsilon.
+            vector w = v + gen_vector() * (uniform(.5, 2.) * std::sqrt(epsilon<scalar_type>));
+            switch (std::uniform_int_distribution<int>{0, 3}(gen)) {
+            case 0:
+                return {sector{p, p + v}, sector{p + h, (p + h) + w}};
+            case 1:
+                return {sector{p, p + v}, sector{(p + h) + w, p + h}};
+            case 2:
+                return {sector{p, p + v * (std::sqrt(epsilon<scalar_type>) / 2)}, sector{p + h, (p + h) + w}};
+            default:
+                return {sector{p, p}, sector{p + h, p + h}};
+            }
+        }
+        }
+        return {sector{gen_point(), gen_point()}, sector{gen_point(), gen_point()}};
+    }
+
+    std::pair<SoA_sectors<scalar_type>, SoA_sectors<scalar_type>> pairs(input_class c, std::size_t n) {
+        SoA_sectors<scalar_type> first, second;
+        first.reserve(n);
+        second.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const auto& [a, b] = (*this)(c);
+            first.push_back(a);
+            second.push_back(b);
+        }
+        return {std::move(first), std::move(second)};
+    }
+
+    SoA_sectors<scalar_type> sectors(std::size_t n) {
+        SoA_sectors<scalar_type> res;
+        res.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            res.push_back(sector{gen_point(), gen_point()});
+        }
+        return res;
+    }
+
+    scalar_type uniform(scalar_type from, scalar_type to) {
+        return std::uniform_real_distribution<scalar_type>{from, to}(gen);
+    }
+
+    point gen_point() {
+        return point{uniform(-10., 10.), uniform(-10., 10.), uniform(-10., 10.)};
+    }
+
+    // Not too short, so that only near_degenerate pairs meet almost degenerate lines.
+    vector gen_vector() {
+        while (true) {
+            vector v{uniform(-1., 1.), uniform(-1., 1.), uniform(-1., 1.)};
+            if (v.len2() > .01) {
+                return v;
+            }
+        }
+    }
+
+private:
+    std::mt19937_64 gen;
+};
+
+} // namespace geom::bench
@@ -0,0 +1,1137 @@
+#include <benchmark/benchmark.h>
+
+#include <geom/distance.h>
+#include <geom/fast_distance.h>
+#include <geom/batch_distance.h>
+#include <geom/parallel_distance.h>
+#include <geom/prepared_sector.h>
+#include <geom/closest_points.h>
+#include <geom/within_distance.h>
+#include <geom/bvh.h>
+#include <geom/dynamic_bvh.h>
+#include <geom/self_proximity.h>
+#include <geom/distance_matrix.h>
+#include <geom/polyline.h>
+#include <geom/hausdorff.h>
+#include <geom/point_distance.h>
+#include <geom/distance_cache.h>
+#include <geom/curve_order.h>
+#include <geom/quantized.h>
+#include <geom/closest_approach.h>
+#include <geom/stats.h>
+#ifndef _WIN32
+#include <geom/server.h>
+#include <geom/client.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "bench_data.h"
+
+namespace
+{
+
+using geom::bench::input_class;
+
+// Pairs count of one iteration, fits into L2.
+constexpr std::size_t pairs_count = 4096;
+
+template<std::floating_point scalar_type>
+std::string type_name() {
+    return std::is_same_v<scalar_type, float> ? "float" : "double";
+}
+
+std::string level_name(geom::simd_level level) {
+    switch (level) {
+    case geom::simd_level::scalar: return "scalar";
+    case geom::simd_level::sse2: return "sse2";
+    case geom::simd_level::avx2: return "avx2";
+    case geom::simd_level::avx512: return "avx512";
+    }
+    return "unknown";
+}
+
+template<std::floating_point scalar_type, typename distance_function>
+void bm_pairwise(benchmark::State& state, input_class c, distance_function distance) {
+    const auto& [first, second] = geom::bench::Pairs_generator<scalar_type>{}.pairs(c, pairs_count);
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < pairs_count; ++i) {
+            benchmark::DoNotOptimize(distance(first[i], second[i]));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * pairs_count);
+}
+
+template<std::floating_point scalar_type>
+void bm_batch(benchmark::State& state, input_class c, geom::simd_level level) {
+    if (level > geom::supported_simd_level()) {
+        state.SkipWithError("instruction set is not supported");
+        return;
+    }
+    const auto& [first, second] = geom::bench::Pairs_generator<scalar_type>{}.pairs(c, pairs_count);
+    std::vector<scalar_type> out(pairs_count);
+    for (auto _ : state) {
+        geom::batch_distance(first.get_view(), second.get_view(), std::span<scalar_type>(out), level);
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * pairs_count);
+}
+
+// One query segment against pairs_count random targets.
+template<std::floating_point scalar_type, typename distance_function>
+void bm_one_vs_many(benchmark::State& state, distance_function distance) {
+    geom::bench::Pairs_generator<scalar_type> gen;
+    const auto query = gen(input_class::random).first;
+    const auto targets = gen.sectors(pairs_count);
+    std::vector<scalar_type> out(pairs_count);
+    for (auto _ : state) {
+        distance(query, targets, std::span<scalar_type>(out));
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * pairs_count);
+}
+
+template<std::floating_point scalar_type>
+void register_one_vs_many(const std::string& type) {
+    using sector = geom::Sector_3D<scalar_type>;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+    using soa = geom::SoA_sectors<scalar_type>;
+
+    benchmark::RegisterBenchmark(("one_vs_many/distance/" + type).c_str(), [](benchmark::State& state) {
+        bm_one_vs_many<scalar_type>(state, [](const sector& query, const soa& targets, std::span<scalar_type> out) {
+            for (std::size_t i = 0; i < out.size(); ++i) {
+                out[i] = geom::distance(query, targets[i]);
+            }
+        });
+    });
+    benchmark::RegisterBenchmark(("one_vs_many/fast_distance/" + type).c_str(), [](benchmark::State& state) {
+        bm_one_vs_many<scalar_type>(state, [](const sector& query, const soa& targets, std::span<scalar_type> out) {
+            for (std::size_t i = 0; i < out.size(); ++i) {
+                out[i] = geom::fast_distance(query, targets[i]);
+            }
+        });
+    });
+    benchmark::RegisterBenchmark(("one_vs_many/prepared_query/" + type).c_str(), [](benchmark::State& state) {
+        bm_one_vs_many<scalar_type>(state, [](const sector& query, const soa& targets, std::span<scalar_type> out) {
+            const prepared p(query);
+            for (std::size_t i = 0; i < out.size(); ++i) {
+                out[i] = p.distance(targets[i]);
+            }
+        });
+    });
+    benchmark::RegisterBenchmark(("one_vs_many/prepared_targets/" + type).c_str(), [](benchmark::State& state) {
+        std::vector<prepared> prepared_targets;
+        bm_one_vs_many<scalar_type>(state, [&](const sector& query, const soa& targets, std::span<scalar_type> out) {
+            if (prepared_targets.empty()) {
+                for (std::size_t i = 0; i < targets.size(); ++i) {
+                    prepared_targets.emplace_back(targets[i]);
+                }
+            }
+            geom::batch_distance(prepared(query), std::span<const prepared>(prepared_targets), out);
+        });
+    });
+    benchmark::RegisterBenchmark(("one_vs_many/prepared_batch/" + type).c_str(), [](benchmark::State& state) {
+        bm_one_vs_many<scalar_type>(state, [](const sector& query, const soa& targets, std::span<scalar_type> out) {
+            geom::batch_distance(prepared(query), targets.get_view(), out);
+        });
+    });
+}
+
+// Proximity check of short segments spread over the generator cube: almost all pairs are far apart.
+constexpr double proximity_distance = 1.;
+
+template<std::floating_point scalar_type>
+std::pair<geom::SoA_sectors<scalar_type>, geom::SoA_sectors<scalar_type>> proximity_pairs() {
+    geom::bench::Pairs_generator<scalar_type> gen;
+    geom::SoA_sectors<scalar_type> first, second;
+    for (std::size_t i = 0; i < pairs_count; ++i) {
+        const auto a = gen.gen_point();
+        const auto b = gen.gen_point();
+        first.push_back({a, a + gen.gen_vector()});
+        second.push_back({b, b + gen.gen_vector()});
+    }
+    return {std::move(first), std::move(second)};
+}
+
+template<std::floating_point scalar_type>
+void register_within_distance(const std::string& type) {
+    const scalar_type dist = proximity_distance;
+    benchmark::RegisterBenchmark(("within/distance/" + type).c_str(), [dist](benchmark::State& state) {
+        const auto& [first, second] = proximity_pairs<scalar_type>();
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < pairs_count; ++i) {
+                benchmark::DoNotOptimize(geom::fast_distance(first[i], second[i]) <= dist);
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * pairs_count);
+    });
+    benchmark::RegisterBenchmark(("within/within_distance/" + type).c_str(), [dist](benchmark::State& state) {
+        const auto& [first, second] = proximity_pairs<scalar_type>();
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < pairs_count; ++i) {
+                benchmark::DoNotOptimize(geom::within_distance(first[i], second[i], dist));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * pairs_count);
+    });
+    benchmark::RegisterBenchmark(("within/batch_distance/" + type).c_str(), [dist](benchmark::State& state) {
+        const auto& [first, second] = proximity_pairs<scalar_type>();
+        std::vector<scalar_type> out(pairs_count);
+        for (auto _ : state) {
+            geom::batch_distance(first.get_view(), second.get_view(), std::span<scalar_type>(out));
+            benchmark::DoNotOptimize(out.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * pairs_count);
+    });
+    benchmark::RegisterBenchmark(("within/batch_within_distance/" + type).c_str(), [dist](benchmark::State& state) {
+        const auto& [first, second] = proximity_pairs<scalar_type>();
+        std::vector<std::uint8_t> out(pairs_count);
+        for (auto _ : state) {
+            geom::batch_within_distance(first.get_view(), second.get_view(), dist, std::span<std::uint8_t>(out));
+            benchmark::DoNotOptimize(out.data());
+            benchmark::ClobberMemory();
+        }
+        state.SetItemsProcessed(state.iterations() * pairs_count);
+    });
+}
+
+// Scene of the index benchmarks: short segments in the generator cube.
+constexpr std::size_t scene_size = 1 << 20;
+constexpr std::size_t queries_count = 1024;
+
+template<std::floating_point scalar_type>
+const geom::SoA_sectors<scalar_type>& scene() {
+    static const auto res = [] {
+        geom::bench::Pairs_generator<scalar_type> gen;
+        geom::SoA_sectors<scalar_type> sectors;
+        sectors.reserve(scene_size);
+        for (std::size_t i = 0; i < scene_size; ++i) {
+            const auto a = gen.gen_point();
+            sectors.push_back({a, a + gen.gen_vector() * scalar_type(.1)});
+        }
+        return sectors;
+    }();
+    return res;
+}
+
+template<std::floating_point scalar_type>
+const geom::Bvh_3D<scalar_type>& scene_bvh() {
+    static const geom::Bvh_3D<scalar_type> res(scene<scalar_type>().get_view());
+    return res;
+}
+
+template<std::floating_point scalar_type>
+std::vector<geom::Sector_3D<scalar_type>> scene_queries() {
+    geom::bench::Pairs_generator<scalar_type> gen(7);
+    std::vector<geom::Sector_3D<scalar_type>> res;
+    for (std::size_t i = 0; i < queries_count; ++i) {
+        res.push_back(gen(input_class::random).first);
+    }
+    return res;
+}
+
+template<std::floating_point scalar_type, typename query_function>
+void bm_bvh_query(benchmark::State& state, query_function query) {
+    const auto& bvh = scene_bvh<scalar_type>();
+    const auto queries = scene_queries<scalar_type>();
+    for (auto _ : state) {
+        for (const auto& q : queries) {
+            benchmark::DoNotOptimize(query(bvh, q));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * queries_count);
+}
+
+template<std::floating_point scalar_type>
+void register_bvh(const std::string& type, int hardware_threads) {
+    using bvh = geom::Bvh_3D<scalar_type>;
+    using sector = geom::Sector_3D<scalar_type>;
+
+    auto* build = benchmark::RegisterBenchmark(("bvh/build/" + type).c_str(), [](benchmark::State& state) {
+        const auto& sectors = scene<scalar_type>();
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state) {
+            bvh index(sectors.get_view(), executor);
+            benchmark::DoNotOptimize(index.nodes_count());
+        }
+        state.SetItemsProcessed(state.iterations() * scene_size);
+    });
+    for (int threads = 1; threads < hardware_threads; threads *= 2) {
+        build->Arg(threads);
+    }
+    build->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+
+    benchmark::RegisterBenchmark(("bvh/nearest/" + type).c_str(), [](benchmark::State& state) {
+        bm_bvh_query<scalar_type>(state, [](const bvh& index, const sector& q) { return index.nearest(q)->distance; });
+    });
+    benchmark::RegisterBenchmark(("bvh/k_nearest_16/" + type).c_str(), [](benchmark::State& state) {
+        bm_bvh_query<scalar_type>(state, [](const bvh& index, const sector& q) { return index.k_nearest(q, 16).size(); });
+    });
+    benchmark::RegisterBenchmark(("bvh/within_0.5/" + type).c_str(), [](benchmark::State& state) {
+        bm_bvh_query<scalar_type>(state, [](const bvh& index, const sector& q) {
+            return index.within(q, scalar_type(.5)).size();
+        });
+    });
+    // Brute force nearest over the whole scene, for reference.
+    benchmark::RegisterBenchmark(("bvh/brute_force_nearest/" + type).c_str(), [](benchmark::State& state) {
+        const auto& sectors = scene<scalar_type>();
+        const auto queries = scene_queries<scalar_type>();
+        std::vector<scalar_type> out(scene_size);
+        for (auto _ : state) {
+            geom::batch_distance(geom::Prepared_sector_3D<scalar_type>(queries[0]), sectors.get_view(),
+                                 std::span<scalar_type>(out));
+            benchmark::DoNotOptimize(*std::min_element(out.begin(), out.end()));
+        }
+        state.SetItemsProcessed(state.iterations());
+    })->Unit(benchmark::kMillisecond);
+}
+
+// Frame of a moving scene: every segment of the scene moves by its own small step,
+// forth on even frames and back on odd ones, then the index is brought up to date.
+template<std::floating_point scalar_type, typename update_function>
+void bm_dynamic_frame(benchmark::State& state, update_function bring_up_to_date) {
+    const auto& sectors = scene<scalar_type>();
+    static const auto steps = [] {
+        geom::bench::Pairs_generator<scalar_type> gen(11);
+        std::vector<geom::Vector_3D<scalar_type>> res;
+        res.reserve(scene_size);
+        for (std::size_t i = 0; i < scene_size; ++i) {
+            res.push_back(gen.gen_vector() * scalar_type(.01));
+        }
+        return res;
+    }();
+    geom::Dynamic_bvh_3D<scalar_type> index(sectors.get_view());
+    std::size_t frame = 0;
+    for (auto _ : state) {
+        const scalar_type sign = frame++ % 2 ? -1 : 1;
+        for (std::size_t i = 0; i < scene_size; ++i) {
+            const auto s = index.get(i);
+            const auto step = steps[i] * sign;
+            index.update(i, {s.get_first_point() + step, s.get_second_point() + step});
+        }
+        bring_up_to_date(index);
+        benchmark::DoNotOptimize(index.bounds());
+    }
+    state.SetItemsProcessed(state.iterations() * scene_size);
+}
+
+template<std::floating_point scalar_type>
+void register_dynamic_bvh(const std::string& type) {
+    using index_type = geom::Dynamic_bvh_3D<scalar_type>;
+
+    benchmark::RegisterBenchmark(("dynamic_bvh/frame_refit/" + type).c_str(), [](benchmark::State& state) {
+        bm_dynamic_frame<scalar_type>(state, [](index_type& index) { index.refit(); });
+    })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("dynamic_bvh/frame_refit_degraded/" + type).c_str(), [](benchmark::State& state) {
+        bm_dynamic_frame<scalar_type>(state, [](index_type& index) { index.rebuild_degraded(); });
+    })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("dynamic_bvh/frame_rebuild/" + type).c_str(), [](benchmark::State& state) {
+        bm_dynamic_frame<scalar_type>(state, [](index_type& index) { index.rebuild(); });
+    })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("dynamic_bvh/nearest/" + type).c_str(), [](benchmark::State& state) {
+        static const index_type index(scene<scalar_type>().get_view());
+        const auto queries = scene_queries<scalar_type>();
+        for (auto _ : state) {
+            for (const auto& q : queries) {
+                benchmark::DoNotOptimize(index.nearest(q));
+            }
+        }
+        state.SetItemsProcessed(state.iterations() * queries_count);
+    });
+}
+
+// Segments of the brute force comparison: all pairs of them take about as long as the sweep of the scene.
+constexpr std::size_t brute_force_size = 1 << 12;
+
+template<std::floating_point scalar_type>
+void register_proximity(const std::string& type, int hardware_threads) {
+    const auto with_threads = [hardware_threads](benchmark::internal::Benchmark* bm) {
+        for (int threads = 1; threads < hardware_threads; threads *= 2) {
+            bm->Arg(threads);
+        }
+        bm->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+    };
+    with_threads(benchmark::RegisterBenchmark(("proximity/closest_pair/" + type).c_str(), [](benchmark::State& state) {
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(geom::closest_pair(executor, scene<scalar_type>().get_view()));
+        }
+        state.SetItemsProcessed(state.iterations() * scene_size);
+    }));
+    with_threads(benchmark::RegisterBenchmark(("proximity/pairs_within_0.01/" + type).c_str(), [](benchmark::State& state) {
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(geom::proximity_pairs(executor, scene<scalar_type>().get_view(), scalar_type(.01)));
+        }
+        state.SetItemsProcessed(state.iterations() * scene_size);
+    }));
+    // The double loop over a small part of the scene, for reference.
+    benchmark::RegisterBenchmark(("proximity/brute_force_closest_pair/" + type).c_str(), [](benchmark::State& state) {
+        const auto sectors = scene<scalar_type>().get_view().subview(0, brute_force_size);
+        for (auto _ : state) {
+            scalar_type best = std::numeric_limits<scalar_type>::infinity();
+            for (std::size_t i = 0; i < brute_force_size; ++i) {
+                const geom::Prepared_sector_3D<scalar_type> first(sectors[i]);
+                for (std::size_t j = i + 1; j < brute_force_size; ++j) {
+                    best = std::min(best, first.distance2(geom::Prepared_sector_3D<scalar_type>(sectors[j])));
+                }
+            }
+            benchmark::DoNotOptimize(best);
+        }
+        state.SetItemsProcessed(state.iterations() * brute_force_size);
+    })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("proximity/closest_pair_small/" + type).c_str(), [](benchmark::State& state) {
+        const auto sectors = scene<scalar_type>().get_view().subview(0, brute_force_size);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(geom::closest_pair(sectors));
+        }
+        state.SetItemsProcessed(state.iterations() * brute_force_size);
+    })->Unit(benchmark::kMillisecond);
+}
+
+// Sides of the matrix benchmarks: the naive loop goes over the small one only.
+// It calls geom::fast_distance: geom::distance throws for some nearly parallel pairs of the scene.
+constexpr std::size_t matrix_size = 1 << 13;
+constexpr std::size_t small_matrix_size = 1 << 10;
+
+template<std::floating_point scalar_type>
+void register_matrix(const std::string& type, int hardware_threads) {
+    const auto with_threads = [hardware_threads](benchmark::internal::Benchmark* bm) {
+        for (int threads = 1; threads < hardware_threads; threads *= 2) {
+            bm->Arg(threads);
+        }
+        bm->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+    };
+    benchmark::RegisterBenchmark(("matrix/naive/" + type).c_str(), [](benchmark::State& state) {
+        const auto rows = scene<scalar_type>().get_view().subview(0, small_matrix_size);
+        const auto cols = scene<scalar_type>().get_view().subview(small_matrix_size, small_matrix_size);
+        std::vector<scalar_type> out(small_matrix_size * small_matrix_size);
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < small_matrix_size; ++i) {
+                for (std::size_t j = 0; j < small_matrix_size; ++j) {
+                    out[i * small_matrix_size + j] = geom::fast_distance(rows[i], cols[j]);
+                }
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * small_matrix_size * small_matrix_size);
+    })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("matrix/tiled/" + type).c_str(), [](benchmark::State& state) {
+        const auto rows = scene<scalar_type>().get_view().subview(0, small_matrix_size);
+        const auto cols = scene<scalar_type>().get_view().subview(small_matrix_size, small_matrix_size);
+        geom::Executor executor(1);
+        std::vector<scalar_type> out(small_matrix_size * small_matrix_size);
+        for (auto _ : state) {
+            geom::distance_matrix(executor, rows, cols, std::span<scalar_type>(out));
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * small_matrix_size * small_matrix_size);
+    })->Unit(benchmark::kMillisecond);
+    with_threads(benchmark::RegisterBenchmark(("matrix/full/" + type).c_str(), [](benchmark::State& state) {
+        const auto sectors = scene<scalar_type>().get_view();
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        std::vector<float> out(matrix_size * matrix_size);
+        for (auto _ : state) {
+            geom::distance_matrix(executor, sectors.subview(0, matrix_size), sectors.subview(matrix_size, matrix_size),
+                                  std::span<float>(out));
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * matrix_size * matrix_size);
+    }));
+    with_threads(benchmark::RegisterBenchmark(("matrix/upper/" + type).c_str(), [](benchmark::State& state) {
+        const auto sectors = scene<scalar_type>().get_view().subview(0, matrix_size);
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        std::vector<float> out(geom::upper_triangle_size(matrix_size));
+        for (auto _ : state) {
+            geom::distance_matrix_upper(executor, sectors, std::span<float>(out));
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * out.size());
+    }));
+}
+
+// Random walk polylines of up to 1 << 17 vertices, the second one starts near the first
+// and they tangle, so the descent has to reach many close ranges.
+constexpr std::size_t polyline_brute_force_size = 2048;
+
+template<std::floating_point scalar_type>
+geom::Polyline_3D<scalar_type> bench_polyline(std::size_t n, scalar_type offset, unsigned seed) {
+    std::mt19937 gen{seed};
+    std::uniform_real_distribution<scalar_type> step(-.01, .01);
+    std::vector<geom::Point_3D<scalar_type>> vertices;
+    vertices.reserve(n);
+    geom::Point_3D<scalar_type> a{offset, 0, 0};
+    for (std::size_t i = 0; i < n; ++i) {
+        vertices.push_back(a);
+        a = a + geom::Vector_3D<scalar_type>{step(gen), step(gen), step(gen)};
+    }
+    return geom::Polyline_3D<scalar_type>(std::move(vertices));
+}
+
+template<std::floating_point scalar_type>
+void register_polyline(const std::string& type) {
+    benchmark::RegisterBenchmark(("polyline/brute_force/" + type).c_str(), [](benchmark::State& state) {
+        const auto first = bench_polyline<scalar_type>(polyline_brute_force_size, 0, 1);
+        const auto second = bench_polyline<scalar_type>(polyline_brute_force_size, .1, 2);
+        for (auto _ : state) {
+            scalar_type best = std::numeric_limits<scalar_type>::infinity();
+            for (std::size_t i = 0; i < first.segments_count(); ++i) {
+                const geom::Prepared_sector_3D<scalar_type> s(first.segment(i));
+                for (std::size_t j = 0; j < second.segments_count(); ++j) {
+                    best = std::min(best, s.distance2(geom::Prepared_sector_3D<scalar_type>(second.segment(j))));
+                }
+            }
+            benchmark::DoNotOptimize(best);
+        }
+    })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("polyline/distance/" + type).c_str(), [](benchmark::State& state) {
+        const auto n = static_cast<std::size_t>(state.range(0));
+        const auto first = bench_polyline<scalar_type>(n, 0, 1);
+        const auto second = bench_polyline<scalar_type>(n, .1, 2);
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(geom::distance(first, second));
+        }
+    })->RangeMultiplier(8)->Range(polyline_brute_force_size, 1 << 17)->ArgName("vertices")
+      ->Unit(benchmark::kMicrosecond);
+}
+
+// Fit of the scene: ends of every segment moved by up to .01 along each axis.
+template<std::floating_point scalar_type>
+const geom::SoA_sectors<scalar_type>& fitted_scene() {
+    static const auto res = [] {
+        geom::bench::Pairs_generator<scalar_type> gen(13);
+        const auto view = scene<scalar_type>().get_view();
+        geom::SoA_sectors<scalar_type> sectors;
+        sectors.reserve(scene_size);
+        for (std::size_t i = 0; i < scene_size; ++i) {
+            const auto s = view[i];
+            sectors.push_back({s.get_first_point() + gen.gen_vector() * scalar_type(.01),
+                               s.get_second_point() + gen.gen_vector() * scalar_type(.01)});
+        }
+        return sectors;
+    }();
+    return res;
+}
+
+constexpr std::size_t hausdorff_brute_force_size = 4096;
+
+template<std::floating_point scalar_type>
+void register_hausdorff(const std::string& type, int hardware_threads) {
+    const auto with_threads = [hardware_threads](benchmark::internal::Benchmark* bm) {
+        for (int threads = 1; threads < hardware_threads; threads *= 2) {
+            bm->Arg(threads);
+        }
+        bm->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+    };
+    // Discrete directed distance of the first segments of the fit to the first segments of the scene.
+    benchmark::RegisterBenchmark(("hausdorff/brute_force/" + type).c_str(), [](benchmark::State& state) {
+        const auto from = fitted_scene<scalar_type>().get_view().subview(0, hausdorff_brute_force_size);
+        const auto to = scene<scalar_type>().get_view().subview(0, hausdorff_brute_force_size);
+        for (auto _ : state) {
+            scalar_type res = 0;
+            for (std::size_t i = 0; i < from.size(); ++i) {
+                for (const auto& p : {from[i].get_first_point(), from[i].get_second_point()}) {
+                    const geom::Prepared_sector_3D<scalar_type> query({p, p});
+                    scalar_type d2 = std::numeric_limits<scalar_type>::infinity();
+                    for (std::size_t j = 0; j < to.size(); ++j) {
+                        d2 = std::min(d2, query.distance2(geom::Prepared_sector_3D<scalar_type>(to[j])));
+                    }
+                    res = std::max(res, d2);
+                }
+            }
+            benchmark::DoNotOptimize(res);
+        }
+        state.SetItemsProcessed(state.iterations() * hausdorff_brute_force_size);
+    })->Unit(benchmark::kMillisecond);
+    with_threads(benchmark::RegisterBenchmark(("hausdorff/directed/" + type).c_str(), [](benchmark::State& state) {
+        const auto& index = scene_bvh<scalar_type>();
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(geom::directed_hausdorff(executor, fitted_scene<scalar_type>().get_view(),
+                                                                scene<scalar_type>().get_view(), index));
+        }
+        state.SetItemsProcessed(state.iterations() * scene_size);
+    }));
+    // Both directions with both indexes built.
+    with_threads(benchmark::RegisterBenchmark(("hausdorff/symmetric/" + type).c_str(), [](benchmark::State& state) {
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        for (auto _ : state) {
+            benchmark::DoNotOptimize(geom::hausdorff(executor, scene<scalar_type>().get_view(),
+                                                     fitted_scene<scalar_type>().get_view()));
+        }
+        state.SetItemsProcessed(state.iterations() * 2 * scene_size);
+    }));
+}
+
+// Point cloud of the scene cube against one segment, pairwise against the scene and nearest over its index.
+constexpr std::size_t cloud_size = 1 << 20;
+
+template<std::floating_point scalar_type>
+const geom::SoA_points<scalar_type>& cloud() {
+    static const auto res = [] {
+        geom::bench::Pairs_generator<scalar_type> gen(17);
+        geom::SoA_points<scalar_type> points;
+        points.reserve(cloud_size);
+        for (std::size_t i = 0; i < cloud_size; ++i) {
+            points.push_back(gen.gen_point());
+        }
+        return points;
+    }();
+    return res;
+}
+
+template<std::floating_point scalar_type>
+void register_points(const std::string& type, int hardware_threads) {
+    using sector = geom::Sector_3D<scalar_type>;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    // The old way: every point is a zero length segment for geom::distance.
+    benchmark::RegisterBenchmark(("points/degenerate_sector/" + type).c_str(), [](benchmark::State& state) {
+        const auto points = cloud<scalar_type>().get_view();
+        const sector query = scene<scalar_type>()[0];
+        std::vector<scalar_type> out(cloud_size);
+        for (auto _ : state) {
+            for (std::size_t i = 0; i < cloud_size; ++i) {
+                out[i] = geom::distance(sector{points[i], points[i]}, query);
+            }
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * cloud_size);
+    })->Unit(benchmark::kMillisecond);
+    for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2, geom::simd_level::avx2, geom::simd_level::avx512}) {
+        const std::string suffix = type + "/" + level_name(level);
+        benchmark::RegisterBenchmark(("points/one_segment/" + suffix).c_str(), [level](benchmark::State& state) {
+            if (level > geom::supported_simd_level()) {
+                state.SkipWithError("instruction set is not supported");
+                return;
+            }
+            const prepared query(scene<scalar_type>()[0]);
+            std::vector<scalar_type> t(cloud_size), d(cloud_size);
+            for (auto _ : state) {
+                geom::batch_project(cloud<scalar_type>().get_view(), query, std::span<scalar_type>(t),
+                                    std::span<scalar_type>(d), level);
+                benchmark::DoNotOptimize(d.data());
+            }
+            state.SetItemsProcessed(state.iterations() * cloud_size);
+        })->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("points/pairwise/" + suffix).c_str(), [level](benchmark::State& state) {
+            if (level > geom::supported_simd_level()) {
+                state.SkipWithError("instruction set is not supported");
+                return;
+            }
+            std::vector<scalar_type> t(cloud_size), d(cloud_size);
+            for (auto _ : state) {
+                geom::batch_project(cloud<scalar_type>().get_view(), scene<scalar_type>().get_view(),
+                                    std::span<scalar_type>(t), std::span<scalar_type>(d), level);
+                benchmark::DoNotOptimize(d.data());
+            }
+            state.SetItemsProcessed(state.iterations() * cloud_size);
+        })->Unit(benchmark::kMillisecond);
+    }
+    auto* nearest = benchmark::RegisterBenchmark(("points/nearest/" + type).c_str(), [](benchmark::State& state) {
+        const auto& index = scene_bvh<scalar_type>();
+        const auto points = cloud<scalar_type>().get_view().subview(0, cloud_size / 16);
+        geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+        std::vector<geom::Bvh_point_hit<scalar_type>> out(points.size(), {0, 0, 0});
+        for (auto _ : state) {
+            geom::nearest_segments(executor, index, points, std::span<geom::Bvh_point_hit<scalar_type>>(out));
+            benchmark::DoNotOptimize(out.data());
+        }
+        state.SetItemsProcessed(state.iterations() * points.size());
+    });
+    for (int threads = 1; threads < hardware_threads; threads *= 2) {
+        nearest->Arg(threads);
+    }
+    nearest->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+// Short segments at random points of the scene cube, in no spatial order: 10M segments of double take 480 MB,
+// far more than caches and TLB reach. Made by every benchmark, so float and double sets do not live together.
+constexpr std::size_t large_scene_size = 10'000'000;
+
+template<std::floating_point scalar_type>
+geom::SoA_sectors<scalar_type> large_scene() {
+    geom::bench::Pairs_generator<scalar_type> gen(23);
+    geom::SoA_sectors<scalar_type> sectors;
+    sectors.reserve(large_scene_size);
+    for (std::size_t i = 0; i < large_scene_size; ++i) {
+        const auto a = gen.gen_point();
+        sectors.push_back({a, a + gen.gen_vector() * scalar_type(.01)});
+    }
+    return sectors;
+}
+
+std::string curve_name(geom::space_curve curve) {
+    return curve == geom::space_curve::hilbert ? "hilbert" : "morton";
+}
+
+// Sorting along curves, index builds and distances of near pairs over the shuffled set and its sorted copy.
+// Near pairs are neighbours along the curve given by source indices in random order, as from a broad phase.
+template<std::floating_point scalar_type>
+void register_curve_order(const std::string& type, int hardware_threads) {
+    for (auto curve : {geom::space_curve::morton, geom::space_curve::hilbert}) {
+        benchmark::RegisterBenchmark(("curve_order/sort/" + type + "/" + curve_name(curve)).c_str(),
+            [curve](benchmark::State& state) {
+                const auto sectors = large_scene<scalar_type>();
+                geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+                for (auto _ : state) {
+                    geom::Sector_order<scalar_type> ordered(sectors.get_view(), executor, curve);
+                    benchmark::DoNotOptimize(ordered.permutation().data());
+                }
+                state.SetItemsProcessed(state.iterations() * large_scene_size);
+            })->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+    for (bool sorted : {false, true}) {
+        const std::string suffix = type + (sorted ? "/sorted" : "/shuffled");
+        benchmark::RegisterBenchmark(("curve_order/bvh_build/" + suffix).c_str(), [sorted](benchmark::State& state) {
+            const auto sectors = large_scene<scalar_type>();
+            geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+            const geom::Sector_order<scalar_type> ordered = sorted
+                ? geom::Sector_order<scalar_type>(sectors.get_view(), executor) : geom::Sector_order<scalar_type>();
+            for (auto _ : state) {
+                const auto index = sorted ? geom::Bvh_3D<scalar_type>(ordered, executor)
+                                          : geom::Bvh_3D<scalar_type>(sectors.get_view(), executor);
+                benchmark::DoNotOptimize(index.nodes_count());
+            }
+            state.SetItemsProcessed(state.iterations() * large_scene_size);
+        })->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+        benchmark::RegisterBenchmark(("curve_order/near_pairs/" + suffix).c_str(), [sorted](benchmark::State& state) {
+            const auto sectors = large_scene<scalar_type>();
+            geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+            const geom::Sector_order<scalar_type> ordered(sectors.get_view(), executor);
+            std::vector<geom::index_pair> pairs(large_scene_size - 1);
+            for (std::size_t k = 0; k + 1 < large_scene_size; ++k) {
+                pairs[k] = {ordered.original(k), ordered.original(k + 1)};
+            }
+            std::shuffle(pairs.begin(), pairs.end(), std::mt19937_64{3});
+            std::vector<scalar_type> out(pairs.size());
+            for (auto _ : state) {
+                if (sorted) {
+                    geom::parallel_distance(executor, ordered, std::span<const geom::index_pair>(pairs),
+                                            std::span<scalar_type>(out));
+                } else {
+                    geom::parallel_distance(executor, sectors.get_view(), std::span<const geom::index_pair>(pairs),
+                                            std::span<scalar_type>(out));
+                }
+                benchmark::DoNotOptimize(out.data());
+            }
+            state.SetItemsProcessed(state.iterations() * pairs.size());
+        })->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+    }
+}
+
+// One query against the whole large scene ordered along the curve, from full precision and quantized copies:
+// distances, and within tests with the share of rechecks from full precision.
+template<std::floating_point scalar_type, unsigned bits>
+void bm_quantized(benchmark::State& state) {
+    const bool within = state.range(0);
+    const auto sectors = large_scene<scalar_type>();
+    const geom::Sector_order<scalar_type> ordered(sectors.get_view());
+    // bits 0 - the full precision copy only.
+    std::optional<geom::Quantized_sectors<scalar_type, bits ? bits : 16>> quantized;
+    if constexpr (bits != 0) {
+        quantized.emplace(ordered.sectors());
+        state.counters["bytes_per_segment"] = double(quantized->bytes()) / double(large_scene_size);
+        state.counters["max_error"] = double(quantized->max_error());
+    } else {
+        state.counters["bytes_per_segment"] = double(6 * sizeof(scalar_type));
+    }
+    const geom::Prepared_sector_3D<scalar_type> query(sectors[0]);
+    std::vector<scalar_type> out(large_scene_size);
+    std::vector<std::uint8_t> flags(large_scene_size);
+    std::size_t rechecks = 0;
+    for (auto _ : state) {
+        if constexpr (bits != 0) {
+            if (within) {
+                rechecks += geom::batch_within_distance(query, *quantized, ordered.sectors(), scalar_type(1),
+                                                        std::span<std::uint8_t>(flags));
+            } else {
+                geom::batch_distance(query, *quantized, std::span<scalar_type>(out));
+            }
+        } else {
+            geom::batch_distance(query, ordered.sectors(), std::span<scalar_type>(out));
+            if (within) {
+                for (std::size_t i = 0; i < large_scene_size; ++i) {
+                    flags[i] = out[i] <= 1;
+                }
+            }
+        }
+        benchmark::DoNotOptimize(out.data());
+        benchmark::DoNotOptimize(flags.data());
+    }
+    state.counters["recheck_rate"] = double(rechecks) / double(state.iterations() * large_scene_size);
+    state.SetItemsProcessed(state.iterations() * large_scene_size);
+}
+
+template<std::floating_point scalar_type>
+void register_quantized(const std::string& type) {
+    for (auto* bm : {
+            benchmark::RegisterBenchmark(("quantized/full/" + type).c_str(), bm_quantized<scalar_type, 0>),
+            benchmark::RegisterBenchmark(("quantized/16bit/" + type).c_str(), bm_quantized<scalar_type, 16>),
+            benchmark::RegisterBenchmark(("quantized/21bit/" + type).c_str(), bm_quantized<scalar_type, 21>)}) {
+        bm->Arg(0)->Arg(1)->ArgName("within")->Unit(benchmark::kMillisecond);
+    }
+}
+
+// Closest approach of moving pairs over [0, 1] against the minimum of 32 sampled distances:
+// translating pairs (exact) and pairs with ends moving differently (conservative advancement).
+constexpr std::size_t moving_pairs_count = 4096;
+constexpr int approach_samples = 32;
+
+template<std::floating_point scalar_type>
+void bm_closest_approach(benchmark::State& state) {
+    using moving = geom::Moving_sector_3D<scalar_type>;
+    const bool sampling = state.range(0);
+    const bool translating = state.range(1);
+    geom::bench::Pairs_generator<scalar_type> gen(29);
+    std::vector<moving> first, second;
+    for (std::size_t i = 0; i < moving_pairs_count; ++i) {
+        const auto& [a, b] = gen(geom::bench::input_class::random);
+        const auto va = gen.gen_vector() * scalar_type(10);
+        const auto vb = gen.gen_vector() * scalar_type(10);
+        first.push_back(translating ? moving{a, va} : moving{a, va, va + gen.gen_vector()});
+        second.push_back(translating ? moving{b, vb} : moving{b, vb, vb + gen.gen_vector()});
+    }
+    std::vector<geom::Closest_approach<scalar_type>> out(moving_pairs_count);
+    for (auto _ : state) {
+        if (sampling) {
+            for (std::size_t i = 0; i < moving_pairs_count; ++i) {
+                out[i] = {0, std::numeric_limits<scalar_type>::infinity()};
+                for (int k = 0; k <= approach_samples; ++k) {
+                    const scalar_type t = scalar_type(k) / approach_samples;
+                    const scalar_type d = geom::distance(first[i].at(t), second[i].at(t));
+                    if (d < out[i].distance) {
+                        out[i] = {t, d};
+                    }
+                }
+            }
+        } else {
+            geom::batch_closest_approach(std::span<const moving>(first), std::span<const moving>(second),
+                                         scalar_type(0), scalar_type(1),
+                                         std::span<geom::Closest_approach<scalar_type>>(out));
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations() * moving_pairs_count);
+}
+
+template<std::floating_point scalar_type>
+void register_closest_approach(const std::string& type) {
+    benchmark::RegisterBenchmark(("closest_approach/" + type).c_str(), bm_closest_approach<scalar_type>)
+        ->ArgsProduct({{0, 1}, {1, 0}})->ArgNames({"sampling", "translating"});
+}
+
+// Stream of cache_stream_chunks chunks of pairs_count pairs, an iteration takes the next chunk.
+// `repeat` percent of pairs recur from a pool of 256, the others are new and mostly evicted before
+// the stream comes round, since the cache holds cache_capacity entries only.
+constexpr std::size_t cache_stream_chunks = 16;
+constexpr std::size_t cache_capacity = 1 << 12;
+
+template<std::floating_point scalar_type>
+std::pair<geom::SoA_sectors<scalar_type>, geom::SoA_sectors<scalar_type>> recurring_pairs(int repeat) {
+    geom::bench::Pairs_generator<scalar_type> gen(5);
+    std::vector<std::pair<geom::Sector_3D<scalar_type>, geom::Sector_3D<scalar_type>>> pool;
+    for (std::size_t i = 0; i < 256; ++i) {
+        pool.push_back(gen(input_class::random));
+    }
+    std::mt19937_64 random{7};
+    std::uniform_int_distribution<int> percent{0, 99};
+    std::pair<geom::SoA_sectors<scalar_type>, geom::SoA_sectors<scalar_type>> res;
+    for (std::size_t i = 0; i < cache_stream_chunks * pairs_count; ++i) {
+        const auto [a, b] = percent(random) < repeat ? pool[random() % pool.size()] : gen(input_class::random);
+        res.first.push_back(a);
+        res.second.push_back(b);
+    }
+    return res;
+}
+
+// geom::distance and the batch kernel over the stream against their cached versions;
+// cached_* report hit_rate, cached_batch fills the cache by geom::distance as cached_distance does.
+template<std::floating_point scalar_type, bool cached, bool batch>
+void bm_cache(benchmark::State& state) {
+    const auto [first, second] = recurring_pairs<scalar_type>(static_cast<int>(state.range(0)));
+    geom::Distance_cache<scalar_type> cache(cache_capacity);
+    std::vector<scalar_type> out(pairs_count);
+    std::size_t chunk = 0;
+    for (auto _ : state) {
+        const auto a = first.get_view().subview(chunk * pairs_count, pairs_count);
+        const auto b = second.get_view().subview(chunk * pairs_count, pairs_count);
+        chunk = (chunk + 1) % cache_stream_chunks;
+        if constexpr (batch && cached) {
+            geom::batch_distance(cache, a, b, std::span<scalar_type>(out));
+        } else if constexpr (batch) {
+            geom::batch_distance(a, b, std::span<scalar_type>(out));
+        } else {
+            for (std::size_t i = 0; i < pairs_count; ++i) {
+                out[i] = cached ? cache.distance(a[i], b[i]) : geom::distance(a[i], b[i]);
+            }
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    if constexpr (cached) {
+        const auto counters = cache.counters();
+        state.counters["hit_rate"] = double(counters.hits) / double(counters.hits + counters.misses);
+    }
+    state.SetItemsProcessed(state.iterations() * pairs_count);
+}
+
+template<std::floating_point scalar_type>
+void register_cache(const std::string& type) {
+    for (auto* bm : {
+            benchmark::RegisterBenchmark(("cache/distance/" + type).c_str(), bm_cache<scalar_type, false, false>),
+            benchmark::RegisterBenchmark(("cache/cached_distance/" + type).c_str(), bm_cache<scalar_type, true, false>),
+            benchmark::RegisterBenchmark(("cache/batch/" + type).c_str(), bm_cache<scalar_type, false, true>),
+            benchmark::RegisterBenchmark(("cache/cached_batch/" + type).c_str(), bm_cache<scalar_type, true, true>)}) {
+        bm->Arg(0)->Arg(90)->Arg(99)->ArgName("repeat");
+    }
+}
+
+#ifndef _WIN32
+// Query server of one process, shared by all clients of server benchmarks.
+const geom::net::Server& bench_server() {
+    static const geom::net::Server server(
+        (std::filesystem::temp_directory_path() / ("geom_bench_" + std::to_string(::getpid()) + ".sock")).string());
+    return server;
+}
+
+// A client per benchmark thread keeps `depth` requests of `pairs` pairs in flight: an iteration receives
+// one response and sends the next request. p50_us and p99_us counters are round trip latencies.
+template<std::floating_point scalar_type>
+void bm_server(benchmark::State& state) {
+    const auto pairs = static_cast<std::size_t>(state.range(0));
+    const auto depth = static_cast<std::size_t>(state.range(1));
+    const auto& [first, second] = geom::bench::Pairs_generator<scalar_type>{}.pairs(input_class::random, pairs);
+    auto client = geom::net::Client::connect(bench_server().path());
+
+    using clock = std::chrono::steady_clock;
+    std::unordered_map<std::uint32_t, clock::time_point> sent;
+    const auto send = [&] { sent[client.send(first.get_view(), second.get_view())] = clock::now(); };
+    std::vector<scalar_type> out;
+    geom::stats::Latency_histogram latency;
+    const auto receive = [&] {
+        const auto it = sent.find(client.receive(out));
+        latency.add(clock::now() - it->second);
+        sent.erase(it);
+    };
+
+    for (std::size_t i = 1; i < depth; ++i) {
+        send();
+    }
+    for (auto _ : state) {
+        send();
+        receive();
+    }
+    while (!sent.empty()) {
+        receive();
+    }
+    state.counters["p50_us"] = benchmark::Counter(latency.quantile(.5) / 1e3, benchmark::Counter::kAvgThreads);
+    state.counters["p99_us"] = benchmark::Counter(latency.quantile(.99) / 1e3, benchmark::Counter::kAvgThreads);
+    state.SetItemsProcessed(state.iterations() * pairs);
+}
+
+template<std::floating_point scalar_type>
+void register_server(const std::string& type) {
+    auto* bm = benchmark::RegisterBenchmark(("server/" + type).c_str(), bm_server<scalar_type>);
+    bm->ArgsProduct({{16, 1024}, {1, 8}})->ArgNames({"pairs", "depth"});
+    bm->Threads(1)->Threads(4)->UseRealTime();
+}
+#endif
+
+// Pairs of the scaling benchmark: far larger than caches, pairs of all classes are mixed.
+constexpr std::size_t scaling_sectors_count = 1 << 16;
+constexpr std::size_t scaling_pairs_count = 1 << 22;
+
+template<std::floating_point scalar_type>
+void bm_parallel(benchmark::State& state) {
+    static const auto sectors = [] {
+        geom::bench::Pairs_generator<scalar_type> gen;
+        geom::SoA_sectors<scalar_type> res;
+        for (std::size_t i = 0; i < scaling_sectors_count / 2; ++i) {
+            const auto& [a, b] = gen(geom::bench::all_input_classes[i % std::size(geom::bench::all_input_classes)]);
+            res.push_back(a);
+            res.push_back(b);
+        }
+        return res;
+    }();
+    static const auto pairs = [] {
+        std::mt19937_64 gen{42};
+        std::uniform_int_distribution<std::size_t> index{0, scaling_sectors_count - 1};
+        std::vector<geom::index_pair> res(scaling_pairs_count);
+        for (auto& p : res) {
+            p = {index(gen), index(gen)};
+        }
+        return res;
+    }();
+
+    geom::Executor executor(static_cast<std::size_t>(state.range(0)));
+    std::vector<scalar_type> out(scaling_pairs_count);
+    for (auto _ : state) {
+        geom::parallel_distance(executor, sectors.get_view(), std::span<const geom::index_pair>(pairs),
+                                std::span<scalar_type>(out));
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * scaling_pairs_count);
+}
+
+// All pairs of segments between integer points of [0, 3)^3, as the grids of tests:
+// crossing, parallel, collinear, touching and degenerate pairs, with long double distances.
+template<std::floating_point scalar_type>
+const std::vector<std::pair<geom::Sector_3D<scalar_type>, geom::Sector_3D<scalar_type>>>& grid_pairs() {
+    static const auto res = [] {
+        std::vector<geom::Point_3D<scalar_type>> points;
+        for (int x = 0; x < 3; ++x) {
+            for (int y = 0; y < 3; ++y) {
+                for (int z = 0; z < 3; ++z) {
+                    points.push_back({scalar_type(x), scalar_type(y), scalar_type(z)});
+                }
+            }
+        }
+        std::vector<geom::Sector_3D<scalar_type>> sectors;
+        for (const auto& a : points) {
+            for (const auto& b : points) {
+                sectors.push_back({a, b});
+            }
+        }
+        std::vector<std::pair<geom::Sector_3D<scalar_type>, geom::Sector_3D<scalar_type>>> pairs;
+        for (const auto& a : sectors) {
+            for (const auto& b : sectors) {
+                pairs.push_back({a, b});
+            }
+        }
+        return pairs;
+    }();
+    return res;
+}
+
+template<std::floating_point scalar_type>
+const std::vector<long double>& grid_reference() {
+    static const auto res = [] {
+        std::vector<long double> distances;
+        for (const auto& [a, b] : grid_pairs<scalar_type>()) {
+            const auto to_long = [](const geom::Sector_3D<scalar_type>& s) {
+                const auto p = s.get_first_point();
+                const auto q = s.get_second_point();
+                return geom::Sector_3D<long double>{{p.get_x(), p.get_y(), p.get_z()}, {q.get_x(), q.get_y(), q.get_z()}};
+            };
+            distances.push_back(geom::fast_distance(to_long(a), to_long(b)));
+        }
+        return distances;
+    }();
+    return res;
+}
+
+// Speed over the grid and errors against long double enumeration: max_error and mean_error counters.
+template<std::floating_point scalar_type, typename policy>
+void bm_grid_accuracy(benchmark::State& state) {
+    const auto& pairs = grid_pairs<scalar_type>();
+    const auto& reference = grid_reference<scalar_type>();
+    std::vector<scalar_type> out(pairs.size());
+    for (auto _ : state) {
+        for (std::size_t i = 0; i < pairs.size(); ++i) {
+            out[i] = geom::fast_distance<policy>(pairs[i].first, pairs[i].second);
+        }
+        benchmark::DoNotOptimize(out.data());
+    }
+    long double max_error = 0, sum_error = 0;
+    for (std::size_t i = 0; i < pairs.size(); ++i) {
+        const long double error = std::abs(out[i] - reference[i]);
+        max_error = std::max(max_error, error);
+        sum_error += error;
+    }
+    state.counters["max_error"] = static_cast<double>(max_error);
+    state.counters["mean_error"] = static_cast<double>(sum_error / pairs.size());
+    state.SetItemsProcessed(state.iterations() * pairs.size());
+}
+
+template<std::floating_point scalar_type>
+void register_benchmarks() {
+    using sector = geom::Sector_3D<scalar_type>;
+    const std::string type = type_name<scalar_type>();
+    for (input_class c : geom::bench::all_input_classes) {
+        const std::string suffix = "/" + type + "/" + std::string(to_string(c));
+
+        benchmark::RegisterBenchmark(("distance" + suffix).c_str(), [c](benchmark::State& state) {
+            bm_pairwise<scalar_type>(state, c, [](const sector& a, const sector& b) {
+                return geom::distance(a, b);
+            });
+        });
+        benchmark::RegisterBenchmark(("fast_distance" + suffix).c_str(), [c](benchmark::State& state) {
+            bm_pairwise<scalar_type>(state, c, [](const sector& a, const sector& b) {
+                return geom::fast_distance(a, b);
+            });
+        });
+        benchmark::RegisterBenchmark(("closest_points" + suffix).c_str(), [c](benchmark::State& state) {
+            bm_pairwise<scalar_type>(state, c, [](const sector& a, const sector& b) {
+                return geom::closest_points(a, b).distance2;
+            });
+        });
+        benchmark::RegisterBenchmark(("clamped_distance" + suffix).c_str(), [c](benchmark::State& state) {
+            bm_pairwise<scalar_type>(state, c, [](const sector& a, const sector& b) {
+                return geom::fast_distance<geom::Clamped_policy>(a, b);
+            });
+        });
+        benchmark::RegisterBenchmark(("clamped_closest_points" + suffix).c_str(), [c](benchmark::State& state) {
+            bm_pairwise<scalar_type>(state, c, [](const sector& a, const sector& b) {
+                return geom::closest_points<geom::Clamped_policy>(a, b).distance2;
+            });
+        });
+        for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2,
+                           geom::simd_level::avx2, geom::simd_level::avx512}) {
+            benchmark::RegisterBenchmark(("batch_distance_" + level_name(level) + suffix).c_str(),
+                [c, level](benchmark::State& state) {
+                    bm_batch<scalar_type>(state, c, level);
+                });
+        }
+    }
+
+    benchmark::RegisterBenchmark(("grid_accuracy/enumeration/" + type).c_str(),
+                                 bm_grid_accuracy<scalar_type, geom::Enumeration_policy>)->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark(("grid_accuracy/clamped/" + type).c_str(),
+                                 bm_grid_accuracy<scalar_type, geom::Clamped_policy>)->Unit(benchmark::kMillisecond);
+
+    register_one_vs_many<scalar_type>(type);
+    register_within_distance<scalar_type>(type);
+
+    // Threads 1, 2, 4, ... up to all hardware threads.
+    const int hardware_threads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+    register_bvh<scalar_type>(type, hardware_threads);
+    register_dynamic_bvh<scalar_type>(type);
+    register_proximity<scalar_type>(type, hardware_threads);
+    register_matrix<scalar_type>(type, hardware_threads);
+    register_polyline<scalar_type>(type);
+    register_hausdorff<scalar_type>(type, hardware_threads);
+    register_points<scalar_type>(type, hardware_threads);
+    register_cache<scalar_type>(type);
+    register_curve_order<scalar_type>(type, hardware_threads);
+    register_quantized<scalar_type>(type);
+    register_closest_approach<scalar_type>(type);
+#ifndef _WIN32
+    register_server<scalar_type>(type);
+#endif
+
+    auto* scaling = benchmark::RegisterBenchmark(("parallel_distance/" + type).c_str(), bm_parallel<scalar_type>);
+    for (int threads = 1; threads < hardware_threads; threads *= 2) {
+        scaling->Arg(threads);
+    }
+    scaling->Arg(hardware_threads)->ArgName("threads")->UseRealTime()->Unit(benchmark::kMillisecond);
+}
+
+const bool registered = [] {
+    register_benchmarks<float>();
+    register_benchmarks<double>();
+    return true;
+}();
+
+} // namespace
@@ -19,6 +19,12 @@ struct scalar_type_epsilon<double> {
     static constexpr double value = 1e-6;
 };
 
+// For reference computations of accuracy checks.
+template<>
+struct scalar_type_epsilon<long double> {
+    static constexpr long double value = 1e-8L;
+};
+
 template<std::floating_point scalar_type>
 constexpr scalar_type epsilon = scalar_type_epsilon<scalar_type>::value;
 
@@ -0,0 +1,257 @@
+#pragma once
+
+#include "sector.h"
+#include "basics.h"
+#include "fast_distance.h"
+#include "simd.h"
+#include "soa.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+
+namespace geom
+{
+
+namespace impl
+{
+// Replaces candidate parameter with 0 in lanes where it is out of segment.
+// Comparisons go straight into selects: combined masks are lowered badly for AVX-512 by GCC.
+template<typename lane_type>
+GEOM_FORCE_INLINE void mask_candidate(lane_type& t, const lane_type& lower, const lane_type& upper) noexcept
+{
+    t = t > lower ? (t < upper ? t : lane_type{}) : lane_type{};
+}
+
+// Branch free param_distance2 for lanes of a batch: lane_type is scalar_type
+// or a vector of them, comparisons give lane masks.
+// Candidates of geom::distance that do not exist are masked by the 0 parameter:
+// the segment begin is always a candidate, so min is not affected.
+// Parallel lines get zero inverse cross product, and degenerate segments get
+// zero projections (both products vanish), so all of them fall into the 0 parameter.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void lane_param_distance2(const lane_type (&c)[3],
+                                            const lane_type (&v)[3], const lane_type& vv, const lane_type& inv_vv,
+                                            const lane_type (&w)[3], const lane_type& ww, const lane_type& inv_ww,
+                                            lane_type& res) noexcept
+{
+    const lane_type zero{};
+    const lane_type one = zero + scalar_type(1);
+    const lane_type eps = zero + epsilon<scalar_type>;
+    const lane_type lower = zero - eps;
+    const lane_type upper = one + eps;
+
+    const auto& [cx, cy, cz] = c;
+    const auto& [vx, vy, vz] = v;
+    const auto& [wx, wy, wz] = w;
+
+    const lane_type vw = vx * wx + vy * wy + vz * wz;
+    const lane_type cv = cx * vx + cy * vy + cz * vz;
+    const lane_type cw = cx * wx + cy * wy + cz * wz;
+
+    const lane_type nx = vy * wz - vz * wy;
+    const lane_type ny = vz * wx - vx * wz;
+    const lane_type nz = vx * wy - vy * wx;
+    const lane_type cross2 = nx * nx + ny * ny + nz * nz;
+
+    const lane_type inv_cross2 = cross2 > eps * vv * ww ? one / cross2 : zero;
+
+    lane_type s[5] = {
+        zero,
+        one,
+        (vw * cw - cv * ww) * inv_cross2,
+        (zero - cv) * inv_vv,
+        (vw - cv) * inv_vv,
+    };
+    lane_type t[5] = {
+        zero,
+        one,
+        (vv * cw - vw * cv) * inv_cross2,
+        cw * inv_ww,
+        (cw + vw) * inv_ww,
+    };
+    for (int i = 2; i < 5; ++i) {
+        mask_candidate(s[i], lower, upper);
+        mask_candidate(t[i], lower, upper);
+    }
+
+    res = zero + std::numeric_limits<scalar_type>::infinity();
+    GEOM_UNROLL
+    for (int i = 0; i < 5; ++i) {
+        const lane_type px = cx + s[i] * vx;
+        const lane_type py = cy + s[i] * vy;
+        const lane_type pz = cz + s[i] * vz;
+        GEOM_UNROLL
+        for (int j = 0; j < 5; ++j) {
+            const lane_type dx = px - t[j] * wx;
+            const lane_type dy = py - t[j] * wy;
+            const lane_type dz = pz - t[j] * wz;
+            const lane_type d2 = dx * dx + dy * dy + dz * dz;
+            res = d2 < res ? d2 : res;
+        }
+    }
+}
+
+// Direction, squared length and its inverse (0 for degenerate segments) of lanes.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void lane_direction(const lane_type (&sector)[6],
+                                      lane_type (&v)[3], lane_type& vv, lane_type& inv_vv) noexcept
+{
+    const lane_type zero{};
+    const lane_type one = zero + scalar_type(1);
+    for (int k = 0; k < 3; ++k) {
+        v[k] = sector[k + 3] - sector[k];
+    }
+    vv = v[0] * v[0] + v[1] * v[1] + v[2] * v[2];
+    inv_vv = vv > zero ? one / vv : zero;
+}
+
+// lane_param_distance2 of segments given by coordinates of ends: ax, ay, az, bx, by, bz.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void lane_distance2(const lane_type (&first)[6],
+                                      const lane_type (&second)[6],
+                                      lane_type& res) noexcept
+{
+    lane_type v[3], w[3], vv, ww, inv_vv, inv_ww;
+    lane_direction<lane_type, scalar_type>(first, v, vv, inv_vv);
+    lane_direction<lane_type, scalar_type>(second, w, ww, inv_ww);
+    const lane_type c[3] = {first[0] - second[0], first[1] - second[1], first[2] - second[2]};
+    lane_param_distance2<lane_type, scalar_type>(c, v, vv, inv_vv, w, ww, inv_ww, res);
+}
+
+// Runs lane_distance2 over lane_type sized blocks of a batch, the tail goes by scalars.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void batch_distance_loop(const SoA_sectors_view<scalar_type>& first,
+                                           const SoA_sectors_view<scalar_type>& second,
+                                           std::span<scalar_type> out) noexcept
+{
+    constexpr std::size_t lanes = sizeof(lane_type) / sizeof(scalar_type);
+    const scalar_type* first_coords[6] = {
+        first.ax.data(), first.ay.data(), first.az.data(),
+        first.bx.data(), first.by.data(), first.bz.data()};
+    const scalar_type* second_coords[6] = {
+        second.ax.data(), second.ay.data(), second.az.data(),
+        second.bx.data(), second.by.data(), second.bz.data()};
+    scalar_type* res = out.data();
+    const std::size_t n = out.size();
+
+    std::size_t i = 0;
+    if constexpr (lanes > 1) {
+        for (; i + lanes <= n; i += lanes) {
+            lane_type first_lanes[6], second_lanes[6], d2;
+            for (int k = 0; k < 6; ++k) {
+                std::memcpy(&first_lanes[k], first_coords[k] + i, sizeof(lane_type));
+                std::memcpy(&second_lanes[k], second_coords[k] + i, sizeof(lane_type));
+            }
+            lane_distance2<lane_type, scalar_type>(first_lanes, second_lanes, d2);
+            for (std::size_t k = 0; k < lanes; ++k) {
+                res[i + k] = std::sqrt(d2[k]);
+            }
+        }
+    }
+    for (; i < n; ++i) {
+        scalar_type first_lane[6], second_lane[6], d2;
+        for (int k = 0; k < 6; ++k) {
+            first_lane[k] = first_coords[k][i];
+            second_lane[k] = second_coords[k][i];
+        }
+        lane_distance2<scalar_type, scalar_type>(first_lane, second_lane, d2);
+        res[i] = std::sqrt(d2);
+    }
+}
+
+template<std::floating_point scalar_type>
+void batch_distance_scalar(const SoA_sectors_view<scalar_type>& first,
+                           const SoA_sectors_view<scalar_type>& second,
+                           std::span<scalar_type> out) noexcept
+{
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = std::sqrt(fast_distance2(first[i], second[i]));
+    }
+}
+
+template<std::floating_point scalar_type>
+void batch_distance_sse2(const SoA_sectors_view<scalar_type>& first,
+                         const SoA_sectors_view<scalar_type>& second,
+                         std::span<scalar_type> out) noexcept
+{
+#ifdef GEOM_SIMD_DISPATCH
+    batch_distance_loop<simd_vector_t<scalar_type, 16>>(first, second, out);
+#else
+    batch_distance_loop<scalar_type>(first, second, out);
+#endif
+}
+
+#ifdef GEOM_SIMD_DISPATCH
+
+template<std::floating_point scalar_type>
+GEOM_TARGET("avx2,fma")
+void batch_distance_avx2(const SoA_sectors_view<scalar_type>& first,
+                         const SoA_sectors_view<scalar_type>& second,
+                         std::span<scalar_type> out) noexcept
+{
+    batch_distance_loop<simd_vector_t<scalar_type, 32>>(first, second, out);
+}
+
+template<std::floating_point scalar_type>
+GEOM_TARGET("avx512f,avx512dq,avx2,fma")
+void batch_distance_avx512(const SoA_sectors_view<scalar_type>& first,
+                           const SoA_sectors_view<scalar_type>& second,
+                           std::span<scalar_type> out) noexcept
+{
+    batch_distance_loop<simd_vector_t<scalar_type, 64>>(first, second, out);
+}
+#endif
+} // namespace impl
+
+// out[i] = distance(first[i], second[i]).
+// Kernel uses given instruction set, or the strongest supported one if it is not available.
+template<std::floating_point scalar_type>
+void batch_distance(const SoA_sectors_view<scalar_type>& first,
+                    const SoA_sectors_view<scalar_type>& second,
+                    std::span<scalar_type> out,
+                    simd_level level)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    if constexpr (stats::enabled) {
+        // Lane kernels have no branches to count, the scalar one records paths of every pair.
+        level = simd_level::scalar;
+    }
+    switch (std::min(level, supported_simd_level())) {
+    case simd_level::scalar:
+        impl::batch_distance_scalar(first, second, out);
+        break;
+    case simd_level::sse2:
+        impl::batch_distance_sse2(first, second, out);
+        break;
+#ifdef GEOM_SIMD_DISPATCH
+    case simd_level::avx2:
+        impl::batch_distance_avx2(first, second, out);
+        break;
+    case simd_level::avx512:
+        impl::batch_distance_avx512(first, second, out);
+        break;
+#else
+    default:
+        impl::batch_distance_sse2(first, second, out);
+        break;
+#endif
+    }
+}
+
+template<std::floating_point scalar_type>
+void batch_distance(const SoA_sectors_view<scalar_type>& first,
+                    const SoA_sectors_view<scalar_type>& second,
+                    std::span<scalar_type> out)
+{
+    batch_distance(first, second, out, best_simd_level());
+}
+
+} // namespace geom
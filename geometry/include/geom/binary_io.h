@@ -0,0 +1,162 @@
+#pragma once
+
+#include "mapped_file.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+namespace geom::io
+{
+
+// Binary segment file, little endian:
+//   header, 64 bytes - see Binary_header;
+//   arrays of coordinates, each one of `count` float or double numbers,
+//   starting at 64 byte boundary (array i is at 64 + i * binary_stride(header)).
+// Arrays go as in SoA_sectors: ax, ay, az, bx, by, bz of the first segments,
+// then the same 6 arrays of the second segments for pairs.
+// Distances file has one array.
+// So mapped arrays are passed to batch kernels without copies.
+enum class binary_kind : std::uint32_t {
+    pairs = 1,
+    sectors = 2,
+    distances = 3,
+};
+
+struct Binary_header {
+    static constexpr char signature[4] = {'S', 'E', 'G', 'D'};
+    static constexpr std::uint32_t current_version = 1;
+
+    char magic[4] = {'S', 'E', 'G', 'D'};
+    std::uint32_t version = current_version;
+    std::uint32_t scalar_size = 0; // 4 - float, 8 - double
+    binary_kind kind = binary_kind::pairs;
+    std::uint64_t count = 0;
+    std::uint8_t reserved[40] = {};
+};
+static_assert(sizeof(Binary_header) == 64);
+
+inline constexpr std::size_t binary_alignment = 64;
+
+inline std::size_t binary_arrays_count(binary_kind kind) {
+    switch (kind) {
+    case binary_kind::pairs: return 12;
+    case binary_kind::sectors: return 6;
+    case binary_kind::distances: return 1;
+    }
+    throw std::runtime_error("unknown binary kind");
+}
+
+inline std::size_t binary_stride(const Binary_header& header) {
+    std::size_t bytes = static_cast<std::size_t>(header.count) * header.scalar_size;
+    return (bytes + binary_alignment - 1) / binary_alignment * binary_alignment;
+}
+
+inline std::size_t binary_file_size(const Binary_header& header) {
+    return sizeof(Binary_header) + binary_arrays_count(header.kind) * binary_stride(header);
+}
+
+inline bool is_binary(std::span<const std::byte> data) {
+    return data.size() >= sizeof(Binary_header) &&
+           std::memcmp(data.data(), Binary_header::signature, sizeof(Binary_header::signature)) == 0;
+}
+
+// Checks header and file size.
+inline Binary_header read_binary_header(std::span<const std::byte> data) {
+    if (!is_binary(data)) {
+        throw std::runtime_error("not a binary segment file");
+    }
+    Binary_header header;
+    std::memcpy(&header, data.data(), sizeof(header));
+    if (header.version != Binary_header::current_version) {
+        throw std::runtime_error("unsupported binary segment file version");
+    }
+    if (header.scalar_size != sizeof(float) && header.scalar_size != sizeof(double)) {
+        throw std::runtime_error("unsupported scalar size in binary segment file");
+    }
+    if (header.count > data.size() / header.scalar_size || data.size() < binary_file_size(header)) {
+        throw std::runtime_error("binary segment file is truncated");
+    }
+    return header;
+}
+
+template<std::floating_point scalar_type>
+std::span<const scalar_type> binary_array(std::span<const std::byte> data, const Binary_header& header,
+                                          std::size_t index) {
+    if (header.scalar_size != sizeof(scalar_type) || index >= binary_arrays_count(header.kind)) {
+        throw std::invalid_argument("no such array in binary segment file");
+    }
+    const std::byte* begin = data.data() + sizeof(Binary_header) + index * binary_stride(header);
+    return {reinterpret_cast<const scalar_type*>(begin), static_cast<std::size_t>(header.count)};
+}
+
+template<std::floating_point scalar_type>
+std::span<scalar_type> binary_array(std::span<std::byte> data, const Binary_header& header,
+                                    std::size_t index) {
+    auto res = binary_array<scalar_type>(std::span<const std::byte>(data), header, index);
+    return {const_cast<scalar_type*>(res.data()), res.size()};
+}
+
+// Segments of the file: side 0 - first segments of pairs or the segment set, 1 - second segments of pairs.
+template<std::floating_point scalar_type>
+SoA_sectors_view<scalar_type> binary_sectors(std::span<const std::byte> data, const Binary_header& header,
+                                             std::size_t side = 0) {
+    const std::size_t first = side * 6;
+    return {binary_array<scalar_type>(data, header, first + 0),
+            binary_array<scalar_type>(data, header, first + 1),
+            binary_array<scalar_type>(data, header, first + 2),
+            binary_array<scalar_type>(data, header, first + 3),
+            binary_array<scalar_type>(data, header, first + 4),
+            binary_array<scalar_type>(data, header, first + 5)};
+}
+
+// Creates mapped file with the header, arrays are filled by the caller.
+template<std::floating_point scalar_type>
+Mapped_file create_binary(const std::string& path, binary_kind kind, std::size_t count) {
+    Binary_header header;
+    header.scalar_size = sizeof(scalar_type);
+    header.kind = kind;
+    header.count = count;
+    auto file = Mapped_file::create(path, binary_file_size(header));
+    std::memcpy(file.data().data(), &header, sizeof(header));
+    return file;
+}
+
+namespace impl
+{
+template<std::floating_point scalar_type>
+void copy_sectors(std::span<std::byte> data, const Binary_header& header, std::size_t side,
+                  const SoA_sectors_view<scalar_type>& sectors) {
+    const std::span<const scalar_type> coords[6] = {
+        sectors.ax, sectors.ay, sectors.az, sectors.bx, sectors.by, sectors.bz};
+    for (std::size_t i = 0; i < 6; ++i) {
+        std::ranges::copy(coords[i], binary_array<scalar_type>(data, header, side * 6 + i).begin());
+    }
+}
+} // namespace impl
+
+template<std::floating_point scalar_type>
+void write_binary_pairs(const std::string& path, const SoA_sectors_view<scalar_type>& first,
+                        const SoA_sectors_view<scalar_type>& second) {
+    if (first.size() != second.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    auto file = create_binary<scalar_type>(path, binary_kind::pairs, first.size());
+    const auto header = read_binary_header(file.data());
+    impl::copy_sectors(file.data(), header, 0, first);
+    impl::copy_sectors(file.data(), header, 1, second);
+}
+
+template<std::floating_point scalar_type>
+void write_binary_sectors(const std::string& path, const SoA_sectors_view<scalar_type>& sectors) {
+    auto file = create_binary<scalar_type>(path, binary_kind::sectors, sectors.size());
+    impl::copy_sectors(file.data(), read_binary_header(file.data()), 0, sectors);
+}
+
+} // namespace geom::io
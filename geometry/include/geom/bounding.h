@@ -0,0 +1,126 @@
+#pragma once
+
+#include "sector.h"
+#include "point.h"
+#include "vector.h"
+#include "basic_algorithm.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace geom
+{
+
+// Axis aligned bounding box.
+template<std::floating_point scalar_type>
+class Bounding_box_3D {
+public:
+    using point = Point_3D<scalar_type>;
+
+    // Empty box: it contains nothing, and adding anything gives that thing's box.
+    Bounding_box_3D()
+        : lo{ inf, inf, inf }
+        , hi{ -inf, -inf, -inf }
+    {}
+
+    Bounding_box_3D(const point& lo, const point& hi)
+        : lo{ lo }
+        , hi{ hi }
+    {}
+
+    explicit Bounding_box_3D(const Sector_3D<scalar_type>& s)
+        : Bounding_box_3D(s.get_first_point(), s.get_first_point())
+    {
+        add(s.get_second_point());
+    }
+
+    const point& get_lo() const { return lo; }
+    const point& get_hi() const { return hi; }
+
+    bool empty() const { return lo.get_x() > hi.get_x(); }
+
+    void add(const Bounding_box_3D& oth) {
+        lo = point{std::min(lo.get_x(), oth.lo.get_x()), std::min(lo.get_y(), oth.lo.get_y()),
+                   std::min(lo.get_z(), oth.lo.get_z())};
+        hi = point{std::max(hi.get_x(), oth.hi.get_x()), std::max(hi.get_y(), oth.hi.get_y()),
+                   std::max(hi.get_z(), oth.hi.get_z())};
+    }
+
+    void add(const point& p) {
+        add(Bounding_box_3D(p, p));
+    }
+
+    point center() const {
+        return point{(lo.get_x() + hi.get_x()) / 2, (lo.get_y() + hi.get_y()) / 2, (lo.get_z() + hi.get_z()) / 2};
+    }
+
+    // Half of the surface area, for the surface area heuristic.
+    scalar_type half_area() const {
+        if (empty()) {
+            return 0;
+        }
+        const scalar_type dx = hi.get_x() - lo.get_x();
+        const scalar_type dy = hi.get_y() - lo.get_y();
+        const scalar_type dz = hi.get_z() - lo.get_z();
+        return dx * dy + dy * dz + dz * dx;
+    }
+
+private:
+    static constexpr scalar_type inf = std::numeric_limits<scalar_type>::infinity();
+
+    point lo, hi;
+};
+
+namespace impl
+{
+// Gap between [lo1, hi1] and [lo2, hi2], 0 if they intersect.
+template<std::floating_point scalar_type>
+scalar_type interval_gap(scalar_type lo1, scalar_type hi1, scalar_type lo2, scalar_type hi2) noexcept {
+    return std::max({scalar_type(0), lo2 - hi1, lo1 - hi2});
+}
+} // namespace impl
+
+// Squared distance between boxes, a lower bound of distances between their content.
+template<std::floating_point scalar_type>
+scalar_type distance2(const Bounding_box_3D<scalar_type>& l, const Bounding_box_3D<scalar_type>& r) noexcept {
+    const scalar_type dx = impl::interval_gap(l.get_lo().get_x(), l.get_hi().get_x(), r.get_lo().get_x(), r.get_hi().get_x());
+    const scalar_type dy = impl::interval_gap(l.get_lo().get_y(), l.get_hi().get_y(), r.get_lo().get_y(), r.get_hi().get_y());
+    const scalar_type dz = impl::interval_gap(l.get_lo().get_z(), l.get_hi().get_z(), r.get_lo().get_z(), r.get_hi().get_z());
+    return dx * dx + dy * dy + dz * dz;
+}
+
+// Squared distance from point to box.
+template<std::floating_point scalar_type>
+scalar_type distance2(const Point_3D<scalar_type>& p, const Bounding_box_3D<scalar_type>& box) noexcept {
+    return distance2(Bounding_box_3D<scalar_type>(p, p), box);
+}
+
+// Sphere around a segment: center in the middle, radius - half of the length.
+template<std::floating_point scalar_type>
+struct Bounding_sphere_3D {
+    Point_3D<scalar_type> center;
+    scalar_type radius;
+
+    explicit Bounding_sphere_3D(const Sector_3D<scalar_type>& s)
+        : center{ s.get_first_point() + (s.get_second_point() - s.get_first_point()) * scalar_type(.5) }
+        , radius{ std::sqrt(s.len2()) / 2 }
+    {}
+};
+
+// True if everything in one box is farther than dist from everything in the other one.
+template<std::floating_point scalar_type>
+bool separated(const Bounding_box_3D<scalar_type>& l, const Bounding_box_3D<scalar_type>& r,
+               scalar_type dist) noexcept {
+    return distance2(l, r) > dist * dist;
+}
+
+// The same for spheres, without sqrt.
+template<std::floating_point scalar_type>
+bool separated(const Bounding_sphere_3D<scalar_type>& l, const Bounding_sphere_3D<scalar_type>& r,
+               scalar_type dist) noexcept {
+    const scalar_type reach = l.radius + r.radius + dist;
+    return (l.center - r.center).len2() > reach * reach;
+}
+
+} // namespace geom
@@ -0,0 +1,517 @@
+#pragma once
+
+#include "sector.h"
+#include "bounding.h"
+#include "curve_order.h"
+#include "executor.h"
+#include "parallel_distance.h"
+#include "point_distance.h"
+#include "prepared_sector.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <span>
+#include <utility>
+#include <stdexcept>
+#include <vector>
+
+namespace geom
+{
+
+namespace impl
+{
+// Lower bound of squared distances from the query to content of the box: the larger one
+// of the gap between boxes and the distance to the ball around the box.
+// Boxes of long oblique queries are large, so for them it is the ball that prunes;
+// a point is bounded by the gap only.
+template<std::floating_point scalar_type>
+scalar_type bvh_bound2(const Prepared_sector_3D<scalar_type>& query, const Bounding_box_3D<scalar_type>& query_box,
+                       const Bounding_box_3D<scalar_type>& b) noexcept
+{
+    const scalar_type gap2 = distance2(query_box, b);
+    // The ball contains the box, so for a point the gap is never smaller.
+    if (!query.get_inv_len2()) {
+        return gap2;
+    }
+    const auto to_center = b.center() - query.get_begin();
+    const scalar_type t = std::clamp<scalar_type>(
+        dot_product(to_center, query.get_direction()) * query.get_inv_len2(), 0, 1);
+    const scalar_type center_dist = std::sqrt((to_center - query.get_direction() * t).len2());
+    const scalar_type radius = std::sqrt((b.get_hi() - b.get_lo()).len2()) / 2;
+    const scalar_type ball_gap = center_dist - radius;
+    return ball_gap > 0 ? std::max(gap2, ball_gap * ball_gap) : gap2;
+}
+} // namespace impl
+
+// Segment of an index found by a query: its index in the indexed set and distance to the query.
+template<std::floating_point scalar_type>
+struct Bvh_hit {
+    std::size_t index;
+    scalar_type distance;
+};
+
+// Segment of an index closest to a point: its index in the indexed set,
+// parameter of the closest point on it and distance.
+template<std::floating_point scalar_type>
+struct Bvh_point_hit {
+    std::size_t index;
+    scalar_type t;
+    scalar_type distance;
+};
+
+// Bounding volume hierarchy over a fixed set of segments.
+// Nodes are flattened in depth first order: the left child goes right after its parent,
+// so traversal mostly walks memory forward. Segments are reordered as leaves go
+// and stored as structure of arrays.
+// Built by binned surface area heuristic; with an executor subtrees are built in parallel.
+// Leaf test is the exact distance (geom::fast_distance kernel).
+template<std::floating_point scalar_type>
+class Bvh_3D {
+public:
+    using sector = Sector_3D<scalar_type>;
+    using box = Bounding_box_3D<scalar_type>;
+    using hit = Bvh_hit<scalar_type>;
+    using point = Point_3D<scalar_type>;
+    using point_hit = Bvh_point_hit<scalar_type>;
+
+    static constexpr std::size_t max_leaf_size = 8;
+
+    Bvh_3D() = default;
+
+    explicit Bvh_3D(const SoA_sectors_view<scalar_type>& sectors) {
+        build(sectors, nullptr);
+    }
+
+    Bvh_3D(const SoA_sectors_view<scalar_type>& sectors, Executor& executor) {
+        build(sectors, &executor);
+    }
+
+    // Index over the copy sorted along a space filling curve: leaves are gathered from it almost
+    // sequentially; hits report indices of the source set.
+    explicit Bvh_3D(const Sector_order<scalar_type>& ordered) {
+        build(ordered.sectors(), nullptr);
+        to_source_indices(ordered);
+    }
+
+    Bvh_3D(const Sector_order<scalar_type>& ordered, Executor& executor) {
+        build(ordered.sectors(), &executor);
+        to_source_indices(ordered);
+    }
+
+    std::size_t size() const { return indices.size(); }
+    bool empty() const { return indices.empty(); }
+    std::size_t nodes_count() const { return nodes.size(); }
+    box bounds() const { return nodes.empty() ? box{} : nodes.front().bounds; }
+
+    // The closest segment, nothing for empty index.
+    std::optional<hit> nearest(const sector& query) const {
+        return nearest(query, 0);
+    }
+
+    // The closest segment or the first one found closer than good_enough: the search stops there.
+    // Enough for the questions like "is anything closer than d, and if not, how far is it".
+    std::optional<hit> nearest(const sector& query, scalar_type good_enough) const {
+        std::optional<hit> res;
+        scalar_type best = std::numeric_limits<scalar_type>::infinity();
+        traverse(query, [&] { return best; }, [&](std::size_t i, scalar_type d2) {
+            if (d2 < best) {
+                const scalar_type d = std::sqrt(d2);
+                res = hit{indices[i], d};
+                // Negative bound prunes everything left.
+                best = d < good_enough ? -scalar_type(1) : d2;
+            }
+        });
+        return res;
+    }
+
+    // k closest segments sorted by distance, fewer if the index is smaller.
+    std::vector<hit> k_nearest(const sector& query, std::size_t k) const {
+        const auto farther = [](const hit& l, const hit& r) { return l.distance < r.distance; };
+        std::priority_queue<hit, std::vector<hit>, decltype(farther)> heap(farther);
+        if (k) {
+            traverse(query,
+                [&] { return heap.size() < k ? std::numeric_limits<scalar_type>::infinity() : heap.top().distance; },
+                [&](std::size_t i, scalar_type d2) {
+                    if (heap.size() < k) {
+                        heap.push({indices[i], d2});
+                    } else if (d2 < heap.top().distance) {
+                        heap.pop();
+                        heap.push({indices[i], d2});
+                    }
+                });
+        }
+        std::vector<hit> res(heap.size(), hit{0, 0});
+        for (auto it = res.rbegin(); it != res.rend(); ++it) {
+            *it = heap.top();
+            it->distance = std::sqrt(it->distance);
+            heap.pop();
+        }
+        return res;
+    }
+
+    // The closest segment to the point with the closest point on it, nothing for empty index.
+    // Boxes are bounded by the gap to the point and leaves are tested by the projection.
+    std::optional<point_hit> nearest(const point& query) const {
+        std::optional<point_hit> res;
+        scalar_type best = std::numeric_limits<scalar_type>::infinity();
+        traverse([&](const box& b) { return distance2(query, b); },
+            [&](std::size_t i) {
+                const auto [t, d] = project(query, Prepared_sector_3D<scalar_type>(leaf_sectors[i]));
+                if (d * d < best) {
+                    best = d * d;
+                    res = point_hit{indices[i], t, d};
+                }
+            },
+            [&] { return best; });
+        return res;
+    }
+
+    // All segments not farther than radius, in no particular order.
+    std::vector<hit> within(const sector& query, scalar_type radius) const {
+        std::vector<hit> res;
+        if (radius < 0) {
+            return res;
+        }
+        const scalar_type radius2 = radius * radius;
+        traverse(query, [&] { return radius2; }, [&](std::size_t i, scalar_type d2) {
+            if (d2 <= radius2) {
+                res.push_back({indices[i], std::sqrt(d2)});
+            }
+        });
+        return res;
+    }
+
+private:
+    struct Node {
+        box bounds;
+        std::uint32_t offset = 0; // leaf - first segment, inner node - right child
+        std::uint32_t count = 0;  // segments of leaf, 0 for inner node
+    };
+
+    // Range of build refs with bounds of their boxes and centers.
+    struct Range {
+        std::size_t begin, end;
+        box bounds, centroid_bounds;
+    };
+
+    // Range whose subtree is built by an executor task.
+    struct Subtree {
+        std::size_t node;
+        Range range;
+    };
+
+    // Segment of the build: its box, box center and index in the source set.
+    struct Build_ref {
+        box bounds;
+        Point_3D<scalar_type> centroid;
+        std::uint32_t index;
+    };
+
+    static constexpr std::size_t bins_count = 16;
+    // Ranges this small become leaves without the heuristic: a few segment tests
+    // are cheaper than a node, and the build makes half as many nodes.
+    static constexpr std::size_t min_leaf_size = 4;
+    // Cost of a box test relative to a segment test.
+    static constexpr scalar_type traversal_cost = 1;
+    // Ranges below this size are not worth a task.
+    static constexpr std::size_t min_subtree_size = 1 << 12;
+
+    std::vector<Node> nodes;
+    SoA_sectors<scalar_type> leaf_sectors;
+    std::vector<std::size_t> indices; // index in the source set of leaf_sectors[i]
+
+    // Build state: refs are partitioned in place, so subtrees own contiguous ranges.
+    std::vector<Build_ref> refs;
+
+    static scalar_type coord(const Point_3D<scalar_type>& p, int axis) {
+        return axis == 0 ? p.get_x() : axis == 1 ? p.get_y() : p.get_z();
+    }
+
+    void build(const SoA_sectors_view<scalar_type>& sectors, Executor* executor) {
+        const std::size_t n = sectors.size();
+        if (n > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("too many segments for the index");
+        }
+        if (!n) {
+            return;
+        }
+        refs.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            const box bounds(sectors[i]);
+            refs.push_back({bounds, bounds.center(), static_cast<std::uint32_t>(i)});
+        }
+
+        if (executor && executor->size() > 1 && n > min_subtree_size) {
+            build_parallel(*executor);
+        } else {
+            build_node(nodes, make_range(0, n), 0, nullptr);
+        }
+
+        leaf_sectors.resize(n);
+        indices.resize(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            leaf_sectors.set(i, sectors[refs[i].index]);
+            indices[i] = refs[i].index;
+        }
+        refs = {};
+    }
+
+    void to_source_indices(const Sector_order<scalar_type>& ordered) {
+        for (auto& i : indices) {
+            i = ordered.original(i);
+        }
+    }
+
+    // Top of the tree goes serially down to ranges of about n / (4 * threads) segments,
+    // then these subtrees are built by tasks into own arrays and spliced in.
+    void build_parallel(Executor& executor) {
+        const std::size_t n = refs.size();
+        const std::size_t subtree_size = std::max(min_subtree_size, n / (4 * executor.size()));
+        std::vector<Node> top;
+        std::vector<Subtree> subtrees;
+        build_node(top, make_range(0, n), subtree_size, &subtrees);
+
+        std::vector<std::vector<Node>> subtree_nodes(subtrees.size());
+        executor.parallel_for(subtrees.size(), 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                build_node(subtree_nodes[i], subtrees[i].range, 0, nullptr);
+            }
+        });
+
+        std::vector<const std::vector<Node>*> spliced(top.size(), nullptr);
+        std::size_t total = top.size();
+        for (std::size_t i = 0; i < subtrees.size(); ++i) {
+            spliced[subtrees[i].node] = &subtree_nodes[i];
+            total += subtree_nodes[i].size();
+        }
+        nodes.reserve(total);
+        splice(top, spliced, 0);
+    }
+
+    // Builds subtree of the range into out in depth first order, returns its root.
+    // Ranges not larger than subtree_size become placeholders listed in subtrees.
+    std::size_t build_node(std::vector<Node>& out, const Range& range,
+                           std::size_t subtree_size, std::vector<Subtree>* subtrees) {
+        const std::size_t index = out.size();
+        out.push_back({range.bounds, 0, 0});
+        if (subtrees && range.end - range.begin <= subtree_size) {
+            subtrees->push_back({index, range});
+            return index;
+        }
+
+        const auto halves = split(range);
+        if (!halves) {
+            out[index].offset = static_cast<std::uint32_t>(range.begin);
+            out[index].count = static_cast<std::uint32_t>(range.end - range.begin);
+            return index;
+        }
+        build_node(out, halves->first, subtree_size, subtrees);
+        const std::size_t right = build_node(out, halves->second, subtree_size, subtrees);
+        out[index].offset = static_cast<std::uint32_t>(right);
+        return index;
+    }
+
+    Range make_range(std::size_t begin, std::size_t end) const {
+        Range res{begin, end, {}, {}};
+        for (std::size_t i = begin; i < end; ++i) {
+            res.bounds.add(refs[i].bounds);
+            res.centroid_bounds.add(refs[i].centroid);
+        }
+        return res;
+    }
+
+    // Partitions the range by the cheapest binned split, nothing if a leaf is cheaper.
+    // Bounds of halves are collected from bins, so refs are passed twice per level only:
+    // to bins and by the partition.
+    std::optional<std::pair<Range, Range>> split(const Range& range) {
+        const std::size_t count = range.end - range.begin;
+        if (count <= min_leaf_size) {
+            return std::nullopt;
+        }
+
+        // Bins go along the longest extent of centroids only, it is 3 times cheaper than all axes
+        // and gives almost the same trees.
+        int axis = 0;
+        scalar_type extent = 0;
+        for (int k = 0; k < 3; ++k) {
+            const scalar_type k_extent = coord(range.centroid_bounds.get_hi(), k)
+                                       - coord(range.centroid_bounds.get_lo(), k);
+            if (k_extent > extent) {
+                axis = k;
+                extent = k_extent;
+            }
+        }
+        const scalar_type lo = coord(range.centroid_bounds.get_lo(), axis);
+        const scalar_type scale = extent > 0 ? static_cast<scalar_type>(bins_count) / extent : 0;
+
+        scalar_type best_cost = std::numeric_limits<scalar_type>::infinity();
+        std::size_t best_bin = bins_count;
+        Range left{range.begin, range.begin, {}, {}};
+        Range right{range.end, range.end, {}, {}};
+        if (scale > 0) {
+            std::array<box, bins_count> bin_boxes, bin_centroids;
+            std::array<std::size_t, bins_count> bin_counts{};
+            for (std::size_t i = range.begin; i < range.end; ++i) {
+                const std::size_t bin = bin_of(refs[i].centroid, axis, lo, scale);
+                bin_boxes[bin].add(refs[i].bounds);
+                bin_centroids[bin].add(refs[i].centroid);
+                ++bin_counts[bin];
+            }
+            // Cost of the split after bin i: right parts are summed backwards first.
+            std::array<scalar_type, bins_count> right_costs{};
+            std::array<box, bins_count> right_boxes, right_centroids;
+            box right_box, right_centroid;
+            std::size_t right_count = 0;
+            for (std::size_t i = bins_count - 1; i > 0; --i) {
+                right_box.add(bin_boxes[i]);
+                right_centroid.add(bin_centroids[i]);
+                right_count += bin_counts[i];
+                right_costs[i - 1] = right_box.half_area() * static_cast<scalar_type>(right_count);
+                right_boxes[i - 1] = right_box;
+                right_centroids[i - 1] = right_centroid;
+            }
+            box left_box, left_centroid;
+            std::size_t left_count = 0;
+            for (std::size_t i = 0; i + 1 < bins_count; ++i) {
+                left_box.add(bin_boxes[i]);
+                left_centroid.add(bin_centroids[i]);
+                left_count += bin_counts[i];
+                const scalar_type cost = left_box.half_area() * static_cast<scalar_type>(left_count) + right_costs[i];
+                if (left_count && left_count < count && cost < best_cost) {
+                    best_cost = cost;
+                    best_bin = i;
+                    left.end = right.begin = range.begin + left_count;
+                    left.bounds = left_box;
+                    left.centroid_bounds = left_centroid;
+                    right.bounds = right_boxes[i];
+                    right.centroid_bounds = right_centroids[i];
+                }
+            }
+        }
+
+        const scalar_type area = range.bounds.half_area();
+        const scalar_type leaf_cost = static_cast<scalar_type>(count);
+        const scalar_type split_cost = best_bin == bins_count ? leaf_cost
+            : area > 0 ? traversal_cost + best_cost / area
+            : traversal_cost + leaf_cost; // flat boxes have no area to compare
+        if (count <= max_leaf_size && leaf_cost <= split_cost) {
+            return std::nullopt;
+        }
+        if (best_bin == bins_count) {
+            // Equal centroids: halves by index keep leaves small.
+            const std::size_t middle = range.begin + count / 2;
+            return std::pair{make_range(range.begin, middle), make_range(middle, range.end)};
+        }
+
+        std::partition(refs.begin() + range.begin, refs.begin() + range.end, [&](const Build_ref& ref) {
+            return bin_of(ref.centroid, axis, lo, scale) <= best_bin;
+        });
+        return std::pair{left, right};
+    }
+
+    static std::size_t bin_of(const Point_3D<scalar_type>& centroid, int axis, scalar_type lo, scalar_type scale) {
+        const auto bin = static_cast<std::size_t>((coord(centroid, axis) - lo) * scale);
+        return std::min(bin, bins_count - 1);
+    }
+
+    // Copies top nodes in depth first order, placeholders are replaced with their subtrees.
+    std::size_t splice(const std::vector<Node>& top, const std::vector<const std::vector<Node>*>& spliced,
+                       std::size_t index) {
+        const std::size_t res = nodes.size();
+        if (const auto* subtree = spliced[index]) {
+            for (Node node : *subtree) {
+                if (!node.count) {
+                    node.offset += static_cast<std::uint32_t>(res);
+                }
+                nodes.push_back(node);
+            }
+            return res;
+        }
+        nodes.push_back(top[index]);
+        if (!top[index].count) {
+            splice(top, spliced, index + 1);
+            nodes[res].offset = static_cast<std::uint32_t>(splice(top, spliced, top[index].offset));
+        }
+        return res;
+    }
+
+    // Calls on_segment(i, d2) for segments of leaves whose bounds are not farther than bound(),
+    // nearer children first.
+    template<typename bound_function, typename segment_function>
+    void traverse(const sector& query, bound_function bound, segment_function on_segment) const {
+        const Prepared_sector_3D<scalar_type> prepared(query);
+        const box query_box(query);
+        traverse([&](const box& b) { return impl::bvh_bound2(prepared, query_box, b); },
+            [&](std::size_t i) { on_segment(i, prepared.distance2(Prepared_sector_3D<scalar_type>(leaf_sectors[i]))); },
+            bound);
+    }
+
+    // Calls on_segment(i) for segments of leaves whose box_bound2(bounds) is not above bound().
+    template<typename box_bound_function, typename segment_function, typename bound_function>
+    void traverse(box_bound_function box_bound2, segment_function on_segment, bound_function bound) const {
+        if (nodes.empty()) {
+            return;
+        }
+        struct Item {
+            std::size_t node;
+            scalar_type d2;
+        };
+        std::vector<Item> stack;
+        stack.reserve(64);
+        stack.push_back({0, box_bound2(nodes[0].bounds)});
+        while (!stack.empty()) {
+            const Item item = stack.back();
+            stack.pop_back();
+            if (item.d2 > bound()) {
+                continue;
+            }
+            const Node& node = nodes[item.node];
+            if (node.count) {
+                for (std::size_t i = node.offset; i < node.offset + node.count; ++i) {
+                    on_segment(i);
+                }
+                continue;
+            }
+            Item left{item.node + 1, box_bound2(nodes[item.node + 1].bounds)};
+            Item right{node.offset, box_bound2(nodes[node.offset].bounds)};
+            if (left.d2 > right.d2) {
+                std::swap(left, right);
+            }
+            const scalar_type limit = bound();
+            if (right.d2 <= limit) {
+                stack.push_back(right);
+            }
+            if (left.d2 <= limit) {
+                stack.push_back(left);
+            }
+        }
+    }
+};
+
+// out[i] = the closest segment of the index to points[i], queries go in parallel.
+// The index must not be empty.
+template<std::floating_point scalar_type>
+void nearest_segments(Executor& executor, const Bvh_3D<scalar_type>& index,
+                      const SoA_points_view<scalar_type>& points, std::span<Bvh_point_hit<scalar_type>> out)
+{
+    if (points.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    if (index.empty()) {
+        throw std::invalid_argument("empty index");
+    }
+    executor.parallel_for(points.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            out[i] = *index.nearest(points[i]);
+        }
+    });
+}
+
+} // namespace geom
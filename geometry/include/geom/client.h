@@ -0,0 +1,124 @@
+#pragma once
+
+#include "protocol.h"
+#include "socket.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace geom::net
+{
+
+// Connection to the query server, see protocol.h. Not thread safe: one client per thread.
+class Client {
+public:
+    static Client connect(const std::string& path) {
+        return Client(connect_unix(path));
+    }
+
+    // Sends distance request of pairs (first[i], second[i]) without waiting, returns its id.
+    // Throws for more than max_request_pairs pairs: distance() splits larger batches.
+    template<std::floating_point scalar_type>
+    std::uint32_t send(const SoA_sectors_view<scalar_type>& first, const SoA_sectors_view<scalar_type>& second) {
+        if (first.size() != second.size()) {
+            throw std::invalid_argument("batch sizes mismatch");
+        }
+        if (first.size() > max_request_pairs) {
+            throw std::length_error("too many pairs for one request");
+        }
+        Request_header header;
+        header.id = next_id++;
+        header.count = static_cast<std::uint32_t>(first.size());
+        header.scalar_size = sizeof(scalar_type);
+        const std::span<const std::byte> buffers[] = {
+            std::as_bytes(std::span(&header, 1)),
+            std::as_bytes(first.ax), std::as_bytes(first.ay), std::as_bytes(first.az),
+            std::as_bytes(first.bx), std::as_bytes(first.by), std::as_bytes(first.bz),
+            std::as_bytes(second.ax), std::as_bytes(second.ay), std::as_bytes(second.az),
+            std::as_bytes(second.bx), std::as_bytes(second.by), std::as_bytes(second.bz)};
+        if (!send_all(socket, buffers)) {
+            throw std::runtime_error("connection to server is closed");
+        }
+        return header.id;
+    }
+
+    // Waits for the next response to any sent request, distances go to out; returns the request id.
+    // Throws if the server rejected the request (and closed the connection) or is gone.
+    template<std::floating_point scalar_type>
+    std::uint32_t receive(std::vector<scalar_type>& out) {
+        const Response_header header = receive_header<scalar_type>();
+        out.resize(header.count);
+        receive_distances(std::span<scalar_type>(out));
+        return header.id;
+    }
+
+    // out[i] = distance(first[i], second[i]); no other requests may be in flight. Batches larger than
+    // max_request_pairs go as parts, a few of them pipelined: the server reads on while responses wait.
+    template<std::floating_point scalar_type>
+    void distance(const SoA_sectors_view<scalar_type>& first, const SoA_sectors_view<scalar_type>& second,
+                  std::span<scalar_type> out) {
+        if (out.size() != first.size() || out.size() != second.size()) {
+            throw std::invalid_argument("batch sizes mismatch");
+        }
+        constexpr std::size_t max_in_flight = 4;
+        const std::size_t parts = std::max<std::size_t>((out.size() + max_request_pairs - 1) / max_request_pairs, 1);
+        std::vector<std::pair<std::uint32_t, std::size_t>> in_flight; // ids and first pairs of parts
+        std::size_t sent = 0;
+        for (std::size_t received = 0; received < parts; ++received) {
+            for (; sent < parts && in_flight.size() < max_in_flight; ++sent) {
+                const std::size_t offset = sent * max_request_pairs;
+                const std::size_t count = std::min<std::size_t>(max_request_pairs, out.size() - offset);
+                in_flight.emplace_back(send(first.subview(offset, count), second.subview(offset, count)), offset);
+            }
+            const Response_header header = receive_header<scalar_type>();
+            const auto it = std::find_if(in_flight.begin(), in_flight.end(),
+                                         [&](const auto& part) { return part.first == header.id; });
+            if (it == in_flight.end()
+                || header.count != std::min<std::size_t>(max_request_pairs, out.size() - it->second)) {
+                throw std::logic_error("response to another request");
+            }
+            receive_distances(out.subspan(it->second, header.count));
+            in_flight.erase(it);
+        }
+    }
+
+private:
+    Socket socket;
+    std::uint32_t next_id = 0;
+
+    explicit Client(Socket socket)
+        : socket{ std::move(socket) }
+    {}
+
+    template<std::floating_point scalar_type>
+    Response_header receive_header() {
+        Response_header header;
+        if (!recv_all(socket, std::as_writable_bytes(std::span(&header, 1))) || !has_signature(header)) {
+            throw std::runtime_error("connection to server is closed");
+        }
+        if (header.status != response_status::ok) {
+            throw std::runtime_error("server rejected request " + std::to_string(header.id));
+        }
+        if (header.scalar_size != sizeof(scalar_type)) {
+            throw std::invalid_argument("response scalar type mismatch");
+        }
+        return header;
+    }
+
+    template<std::floating_point scalar_type>
+    void receive_distances(std::span<scalar_type> out) {
+        if (!recv_all(socket, std::as_writable_bytes(out))) {
+            throw std::runtime_error("connection to server is closed");
+        }
+    }
+};
+
+} // namespace geom::net
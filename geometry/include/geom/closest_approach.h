@@ -0,0 +1,519 @@
+#pragma once
+
+#include "sector.h"
+#include "basic_algorithm.h"
+#include "basics.h"
+#include "closest_points.h"
+#include "distance.h"
+#include "executor.h"
+#include "parallel_distance.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+namespace geom
+{
+
+// Segment moving linearly: at time t its ends are first + t * first_velocity and second + t * second_velocity.
+// Equal velocities of ends make a translating segment.
+template<std::floating_point scalar_type>
+class Moving_sector_3D {
+public:
+    using point = Point_3D<scalar_type>;
+    using vector = Vector_3D<scalar_type>;
+    using sector = Sector_3D<scalar_type>;
+
+    constexpr Moving_sector_3D(const sector& s, const vector& velocity) noexcept
+        : Moving_sector_3D(s, velocity, velocity)
+    {}
+
+    constexpr Moving_sector_3D(const sector& s, const vector& first_velocity, const vector& second_velocity) noexcept
+        : start{ s }
+        , first_velocity{ first_velocity }
+        , second_velocity{ second_velocity }
+    {}
+
+    constexpr const sector& get_sector() const noexcept { return start; }
+    constexpr const vector& get_first_velocity() const noexcept { return first_velocity; }
+    constexpr const vector& get_second_velocity() const noexcept { return second_velocity; }
+
+    constexpr bool is_translating() const noexcept {
+        return first_velocity.get_x() == second_velocity.get_x() && first_velocity.get_y() == second_velocity.get_y()
+            && first_velocity.get_z() == second_velocity.get_z();
+    }
+
+    constexpr sector at(scalar_type t) const noexcept {
+        return sector{start.get_first_point() + first_velocity * t, start.get_second_point() + second_velocity * t};
+    }
+
+private:
+    sector start;
+    vector first_velocity;
+    vector second_velocity;
+};
+
+// The least distance of two moving segments over a time interval and a time it is reached at.
+template<std::floating_point scalar_type>
+struct Closest_approach {
+    scalar_type time;
+    scalar_type distance;
+};
+
+namespace impl
+{
+// Translating segments: relative to the second one, ends of the first move by w = va - vb, so distances
+// over [0, duration] are those between the parallelogram P = {(a0 - b0) + s * u + r * v}, v = b0 - b1, and the segment
+// Q = {-tau * w}. Their least distance is reached by an edge of P and Q, or by an end of Q and the inside
+// of P, or Q crosses P. Each candidate is a real pair of points, so rounding only loses a little of it.
+template<std::floating_point scalar_type>
+Closest_approach<scalar_type> translating_approach(const Sector_3D<scalar_type>& first,
+                                                   const Sector_3D<scalar_type>& second,
+                                                   const Vector_3D<scalar_type>& w,
+                                                   scalar_type duration) noexcept
+{
+    using point = Point_3D<scalar_type>;
+    using vector = Vector_3D<scalar_type>;
+    const point origin{0, 0, 0};
+    const vector c = first.get_first_point() - second.get_first_point();
+    const vector u = first.get_second_point() - first.get_first_point();
+    const vector v = second.get_first_point() - second.get_second_point();
+    const point corners[4] = {origin + c, origin + (c + u), origin + (c + v), origin + (c + u + v)};
+    const Sector_3D<scalar_type> path{origin, origin + w * -duration};
+
+    Closest_approach<scalar_type> best{0, std::numeric_limits<scalar_type>::infinity()};
+    const auto add = [&](scalar_type distance2, scalar_type tau) {
+        if (distance2 < best.distance) {
+            best = {tau, distance2};
+        }
+    };
+    for (const auto& [i, j] : {std::pair{0, 1}, std::pair{2, 3}, std::pair{0, 2}, std::pair{1, 3}}) {
+        const auto closest = closest_points(Sector_3D<scalar_type>{corners[i], corners[j]}, path);
+        add(closest.distance2, closest.second_param * duration);
+    }
+
+    // Points of the plane of P by parameters: e = s * u + r * v for e in the plane.
+    const vector n = u * v;
+    const scalar_type nn = n.len2();
+    const auto add_inside = [&](scalar_type tau) {
+        const vector e = (origin + w * -tau) - corners[0];
+        const scalar_type s = dot_product(e * v, n) / nn;
+        const scalar_type r = dot_product(u * e, n) / nn;
+        if (s >= 0 && s <= 1 && r >= 0 && r <= 1) {
+            add((e - u * s - v * r).len2(), tau);
+        }
+    };
+    if (nn > 0) {
+        add_inside(0);
+        add_inside(duration);
+        const scalar_type nw = dot_product(n, w);
+        if (nw != 0) {
+            const scalar_type tau = -dot_product(n, c) / nw;
+            if (tau > 0 && tau < duration) {
+                add_inside(tau);
+            }
+        }
+    }
+    best.distance = std::sqrt(best.distance);
+    return best;
+}
+
+// Coefficients of polynomials in time, the lowest first.
+template<typename calc_type, std::size_t size>
+using polynomial = std::array<calc_type, size>;
+
+template<typename calc_type, std::size_t n, std::size_t m>
+constexpr polynomial<calc_type, n + m - 1> multiply(const polynomial<calc_type, n>& a,
+                                                    const polynomial<calc_type, m>& b) noexcept
+{
+    polynomial<calc_type, n + m - 1> res{};
+    for (std::size_t i = 0; i < n; ++i) {
+        for (std::size_t j = 0; j < m; ++j) {
+            res[i + j] += a[i] * b[j];
+        }
+    }
+    return res;
+}
+
+template<typename calc_type, std::size_t n>
+constexpr polynomial<calc_type, n - 1> derivative(const polynomial<calc_type, n>& p) noexcept {
+    polynomial<calc_type, n - 1> res{};
+    for (std::size_t i = 1; i < n; ++i) {
+        res[i - 1] = p[i] * static_cast<calc_type>(i);
+    }
+    return res;
+}
+
+template<typename calc_type, std::size_t n>
+constexpr calc_type evaluate(const polynomial<calc_type, n>& p, calc_type x) noexcept {
+    calc_type res = 0;
+    for (std::size_t i = n; i-- > 0;) {
+        res = res * x + p[i];
+    }
+    return res;
+}
+
+// Vector whose coordinates are polynomials in time.
+template<typename calc_type, std::size_t size>
+using vector_polynomial = std::array<polynomial<calc_type, size>, 3>;
+
+template<typename calc_type, std::size_t n, std::size_t m>
+constexpr polynomial<calc_type, n + m - 1> dot(const vector_polynomial<calc_type, n>& a,
+                                               const vector_polynomial<calc_type, m>& b) noexcept
+{
+    polynomial<calc_type, n + m - 1> res{};
+    for (int k = 0; k < 3; ++k) {
+        const auto product = multiply(a[k], b[k]);
+        for (std::size_t i = 0; i < res.size(); ++i) {
+            res[i] += product[i];
+        }
+    }
+    return res;
+}
+
+template<typename calc_type, std::size_t n, std::size_t m>
+constexpr vector_polynomial<calc_type, n + m - 1> cross(const vector_polynomial<calc_type, n>& a,
+                                                        const vector_polynomial<calc_type, m>& b) noexcept
+{
+    vector_polynomial<calc_type, n + m - 1> res{};
+    for (int k = 0; k < 3; ++k) {
+        const auto l = multiply(a[(k + 1) % 3], b[(k + 2) % 3]);
+        const auto r = multiply(a[(k + 2) % 3], b[(k + 1) % 3]);
+        for (std::size_t i = 0; i < l.size(); ++i) {
+            res[k][i] = l[i] - r[i];
+        }
+    }
+    return res;
+}
+
+// p' * q - p * q' of the same degree, numerator of the derivative of p / q.
+template<typename calc_type, std::size_t n, std::size_t m>
+constexpr polynomial<calc_type, n + m - 2> quotient_derivative(const polynomial<calc_type, n>& p,
+                                                               const polynomial<calc_type, m>& q) noexcept
+{
+    const auto l = multiply(derivative(p), q);
+    const auto r = multiply(p, derivative(q));
+    polynomial<calc_type, n + m - 2> res{};
+    for (std::size_t i = 0; i < res.size(); ++i) {
+        res[i] = l[i] - r[i];
+    }
+    return res;
+}
+
+// p(y * length): the same polynomial over y in [0, 1].
+template<typename calc_type, std::size_t n>
+constexpr polynomial<calc_type, n> scaled(polynomial<calc_type, n> p, calc_type length) noexcept {
+    calc_type power = 1;
+    for (std::size_t i = 0; i < n; ++i) {
+        p[i] *= power;
+        power *= length;
+    }
+    return p;
+}
+
+// Bernstein coefficients of p over [0, length]: p there is between the least and the largest of them.
+template<typename calc_type, std::size_t n>
+constexpr polynomial<calc_type, n> bernstein(const polynomial<calc_type, n>& p, calc_type length) noexcept {
+    constexpr std::size_t degree = n - 1;
+    const auto q = scaled(p, length);
+    polynomial<calc_type, n> res{};
+    for (std::size_t k = 0; k < n; ++k) {
+        // b_k = sum over i <= k of C(k, i) / C(degree, i) q_i.
+        calc_type ratio = 1;
+        for (std::size_t i = 0; i <= k; ++i) {
+            res[k] += ratio * q[i];
+            if (i < k) {
+                ratio = ratio * static_cast<calc_type>(k - i) / static_cast<calc_type>(degree - i);
+            }
+        }
+    }
+    return res;
+}
+
+// Points of [0, length] at roots of p of degree n - 1 there. In the Bernstein basis of a span, no sign
+// changes of coefficients mean no roots and one change means one root, refined by regula falsi (Illinois);
+// spans with more changes are halved by de Casteljau. Touching roots and spans left when the budget
+// of halvings runs out give their middles, which only adds candidates.
+template<typename calc_type>
+struct Roots {
+    std::array<calc_type, 64> points;
+    std::size_t count = 0;
+
+    void add(calc_type x) {
+        if (count < points.size()) {
+            points[count++] = x;
+        }
+    }
+};
+
+template<typename calc_type, std::size_t n>
+void find_roots(const polynomial<calc_type, n>& p, calc_type length, Roots<calc_type>& res) noexcept {
+    static_assert(n >= 2);
+    constexpr std::size_t degree = n - 1;
+    constexpr int max_spans = 32;
+    constexpr calc_type min_width = calc_type(1) / (1 << 20);
+    struct Span {
+        calc_type from, to;
+        polynomial<calc_type, n> bernstein;
+    };
+
+    Span stack[max_spans];
+    int top = 0;
+    stack[top++] = {0, 1, bernstein(p, length)};
+    const auto q = scaled(p, length);
+
+    int budget = 4 * max_spans;
+    while (top > 0) {
+        const Span span = stack[--top];
+        const auto& b = span.bernstein;
+        int changes = 0;
+        for (std::size_t k = 1; k < n; ++k) {
+            changes += (b[k - 1] < 0) != (b[k] < 0);
+        }
+        if (changes == 0) {
+            if (b[0] == 0) {
+                res.add(span.from * length);
+            }
+            continue;
+        }
+        if (changes == 1 && (b[0] < 0) != (b[degree] < 0)) {
+            const calc_type resolution = 4 * std::numeric_limits<calc_type>::epsilon();
+            calc_type y0 = span.from, f0 = b[0], y1 = span.to, f1 = b[degree], y = span.to;
+            int kept = -1;
+            for (int i = 0; i < 64; ++i) {
+                const calc_type next = std::clamp(y0 - f0 * (y1 - y0) / (f1 - f0), y0, y1);
+                const bool converged = std::abs(next - y) <= resolution;
+                y = next;
+                const calc_type fy = evaluate(q, y);
+                if (converged || fy == 0) {
+                    break;
+                }
+                // The end kept twice in a row has its value halved.
+                if ((fy < 0) == (f0 < 0)) {
+                    y0 = y;
+                    f0 = fy;
+                    f1 /= kept == 1 ? 2 : 1;
+                    kept = 1;
+                } else {
+                    y1 = y;
+                    f1 = fy;
+                    f0 /= kept == 0 ? 2 : 1;
+                    kept = 0;
+                }
+            }
+            res.add(y * length);
+            continue;
+        }
+        const calc_type middle = (span.from + span.to) / 2;
+        if (span.to - span.from < min_width || top + 2 > max_spans || --budget < 0) {
+            res.add(middle * length);
+            continue;
+        }
+        Span& left = stack[top++];
+        Span& right = stack[top++];
+        left.from = span.from;
+        left.to = middle;
+        right.from = middle;
+        right.to = span.to;
+        polynomial<calc_type, n> work = b;
+        for (std::size_t level = 0; level < n; ++level) {
+            left.bernstein[level] = work[0];
+            right.bernstein[degree - level] = work[degree - level];
+            for (std::size_t k = 0; k + level < degree; ++k) {
+                work[k] = (work[k] + work[k + 1]) / 2;
+            }
+        }
+    }
+}
+
+// Segments with ends moving differently. Distances of the pair at time tau are those between the origin
+// and D(s, r, tau) = c + s * u - r * v: a0 - b0, a1 - a0 and b1 - b0, all linear in tau.
+// The least distance over [0, duration] is reached at an end of the interval or where a regime of the
+// closest pair is stationary: both at ends (quadratic), an end against the line of the other segment
+// (degree 5 numerator), or inside both (the coplanarity cubic and a degree 6 numerator). Each candidate
+// time is scored by a real pair of points - parameters clamped to the segments - so extra candidates
+// and rounding of roots do not make the result less than the least distance.
+template<std::floating_point scalar_type>
+Closest_approach<scalar_type> moving_approach(const Moving_sector_3D<scalar_type>& first,
+                                              const Moving_sector_3D<scalar_type>& second,
+                                              scalar_type from, scalar_type to) noexcept
+{
+    using calc_type = std::common_type_t<scalar_type, double>;
+    using vector = Vector_3D<calc_type>;
+    using linear = vector_polynomial<calc_type, 2>;
+    const auto to_calc = [](const Vector_3D<scalar_type>& x) {
+        return vector{x.get_x(), x.get_y(), x.get_z()};
+    };
+    const auto make_linear = [](const vector& at0, const vector& speed) {
+        return linear{{{at0.get_x(), speed.get_x()}, {at0.get_y(), speed.get_y()}, {at0.get_z(), speed.get_z()}}};
+    };
+    const auto start_first = first.at(from);
+    const auto start_second = second.at(from);
+    const vector va0 = to_calc(first.get_first_velocity()), va1 = to_calc(first.get_second_velocity());
+    const vector vb0 = to_calc(second.get_first_velocity()), vb1 = to_calc(second.get_second_velocity());
+    const linear c = make_linear(to_calc(start_first.get_first_point() - start_second.get_first_point()), va0 - vb0);
+    const linear u = make_linear(to_calc(start_first.get_second_point() - start_first.get_first_point()), va1 - va0);
+    const linear v = make_linear(to_calc(start_second.get_second_point() - start_second.get_first_point()), vb1 - vb0);
+    const calc_type duration = static_cast<calc_type>(to) - static_cast<calc_type>(from);
+
+    const auto at = [](const linear& x, calc_type tau) {
+        return vector{evaluate(x[0], tau), evaluate(x[1], tau), evaluate(x[2], tau)};
+    };
+
+    Closest_approach<scalar_type> best{from, geom::distance(start_first, start_second)};
+    calc_type best2 = static_cast<calc_type>(best.distance) * best.distance;
+    const scalar_type to_distance = geom::distance(first.at(to), second.at(to));
+    if (to_distance < best.distance) {
+        best = {to, to_distance};
+        best2 = static_cast<calc_type>(to_distance) * to_distance;
+    }
+    bool improved = false;
+    calc_type best_tau = 0;
+    const auto consider = [&](calc_type tau, calc_type s, calc_type r) {
+        tau = std::clamp<calc_type>(tau, 0, duration);
+        s = std::clamp<calc_type>(s, 0, 1);
+        r = std::clamp<calc_type>(r, 0, 1);
+        const calc_type d2 = (at(c, tau) + at(u, tau) * s - at(v, tau) * r).len2();
+        if (d2 < best2) {
+            best2 = d2;
+            best_tau = tau;
+            improved = true;
+        }
+    };
+
+    // Ends of both segments: e = c + s0 * u - r0 * v.
+    Roots<calc_type> roots;
+    for (int end = 0; end < 4; ++end) {
+        const calc_type s0 = end & 1, r0 = end >> 1;
+        linear e;
+        for (int k = 0; k < 3; ++k) {
+            for (int i = 0; i < 2; ++i) {
+                e[k][i] = c[k][i] + s0 * u[k][i] - r0 * v[k][i];
+            }
+        }
+        const auto ee = dot(e, e);
+        if (ee[2] > 0) {
+            consider(-ee[1] / (2 * ee[2]), s0, r0);
+        }
+    }
+    for (int side = 0; side < 4; ++side) {
+        // Sides 0, 1: the end s0 of the first segment against the second one, 2, 3: the end r0 of the second.
+        const bool first_end = side < 2;
+        const calc_type fixed = side & 1;
+        const linear& dir = first_end ? v : u;
+        linear e;
+        for (int k = 0; k < 3; ++k) {
+            for (int i = 0; i < 2; ++i) {
+                e[k][i] = c[k][i] + (first_end ? fixed * u[k][i] : -fixed * v[k][i]);
+            }
+        }
+        const auto dd = dot(dir, dir);
+        const auto side_cross = cross(e, dir);
+        roots.count = 0;
+        find_roots(quotient_derivative(dot(side_cross, side_cross), dd), duration, roots);
+        for (std::size_t k = 0; k < roots.count; ++k) {
+            const calc_type tau = roots.points[k];
+            const vector e_tau = at(e, tau), dir_tau = at(dir, tau);
+            const calc_type len2 = dir_tau.len2();
+            const calc_type param = len2 > 0 ? dot_product(e_tau, dir_tau) / len2 : 0;
+            if (first_end) {
+                consider(tau, fixed, param);
+            } else {
+                consider(tau, -param, fixed);
+            }
+        }
+    }
+    const auto n = cross(u, v);
+    const auto cn = dot(c, n);
+    const auto nn = dot(n, n);
+    // (c n)^2 / n^2 is stationary where c n = 0, or where 2 (c n)' n^2 - (c n) (n^2)' = 0.
+    const auto l = multiply(derivative(cn), nn);
+    const auto r = multiply(cn, derivative(nn));
+    polynomial<calc_type, 7> numerator{};
+    for (std::size_t i = 0; i < numerator.size(); ++i) {
+        numerator[i] = 2 * l[i] - r[i];
+    }
+    roots.count = 0;
+    find_roots(cn, duration, roots);
+    find_roots(numerator, duration, roots);
+    for (std::size_t k = 0; k < roots.count; ++k) {
+        const calc_type tau = roots.points[k];
+        const vector c_tau = at(c, tau), u_tau = at(u, tau), v_tau = at(v, tau);
+        const calc_type uu = u_tau.len2(), vv = v_tau.len2(), uv = dot_product(u_tau, v_tau);
+        const calc_type cu = dot_product(c_tau, u_tau), cv = dot_product(c_tau, v_tau);
+        const calc_type det = uu * vv - uv * uv;
+        if (det > 0) {
+            consider(tau, (uv * cv - cu * vv) / det, (uu * cv - uv * cu) / det);
+        }
+    }
+
+    if (improved) {
+        best = {std::min(static_cast<scalar_type>(from + best_tau), to), static_cast<scalar_type>(std::sqrt(best2))};
+    }
+    return best;
+}
+} // namespace impl
+
+// The least distance of moving segments over [from, to] and a time it is reached at; if it holds
+// over a span of time, any time of it. Translating segments are solved geometrically, others by roots
+// of polynomials; both are exact up to rounding, unlike the least of sampled distances.
+// Throws std::invalid_argument on an empty or NaN interval.
+template<std::floating_point scalar_type>
+Closest_approach<scalar_type> closest_approach(const Moving_sector_3D<scalar_type>& first,
+                                               const Moving_sector_3D<scalar_type>& second,
+                                               scalar_type from, scalar_type to)
+{
+    if (!(from <= to)) {
+        throw std::invalid_argument("bad closest approach interval");
+    }
+    if (first.is_translating() && second.is_translating()) {
+        auto res = impl::translating_approach(first.at(from), second.at(from),
+                                              first.get_first_velocity() - second.get_first_velocity(), to - from);
+        res.time = std::min(from + res.time, to);
+        return res;
+    }
+    return impl::moving_approach(first, second, from, to);
+}
+
+// out[i] = closest_approach(first[i], second[i], from, to).
+template<std::floating_point scalar_type>
+void batch_closest_approach(std::span<const Moving_sector_3D<scalar_type>> first,
+                            std::span<const Moving_sector_3D<scalar_type>> second,
+                            scalar_type from, scalar_type to,
+                            std::span<Closest_approach<scalar_type>> out)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = closest_approach(first[i], second[i], from, to);
+    }
+}
+
+// batch_closest_approach over chunks computed by executor threads.
+template<std::floating_point scalar_type>
+void parallel_closest_approach(Executor& executor,
+                               std::span<const Moving_sector_3D<scalar_type>> first,
+                               std::span<const Moving_sector_3D<scalar_type>> second,
+                               scalar_type from, scalar_type to,
+                               std::span<Closest_approach<scalar_type>> out)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    if (!(from <= to)) {
+        throw std::invalid_argument("bad closest approach interval");
+    }
+    executor.parallel_for(out.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        batch_closest_approach(first.subspan(begin, end - begin), second.subspan(begin, end - begin), from, to,
+                               out.subspan(begin, end - begin));
+    });
+}
+
+} // namespace geom
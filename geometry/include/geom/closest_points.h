@@ -0,0 +1,48 @@
+#pragma once
+
+#include "sector.h"
+#include "fast_distance.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace geom
+{
+
+// Closest points of two segments: first_point = a1 + first_param * (b1 - a1),
+// second_point = a2 + second_param * (b2 - a2), params are in [0, 1].
+template<std::floating_point scalar_type>
+struct Closest_points {
+    scalar_type first_param;
+    scalar_type second_param;
+    Point_3D<scalar_type> first_point;
+    Point_3D<scalar_type> second_point;
+    scalar_type distance2;
+
+    constexpr scalar_type distance() const noexcept { return geom::sqrt(distance2); }
+};
+
+// Witness of geom::fast_distance: the same algorithm, the best pair is kept.
+// Degenerate segments give param 0. For parallel segments any of the closest pairs is returned.
+template<typename policy = Enumeration_policy, std::floating_point scalar_type>
+constexpr Closest_points<scalar_type> closest_points(const Sector_3D<scalar_type>& first_sector,
+                                           const Sector_3D<scalar_type>& second_sector) noexcept
+{
+    const auto first_begin = first_sector.get_first_point();
+    const auto second_begin = second_sector.get_first_point();
+    const auto v = first_sector.get_second_point() - first_begin;
+    const auto w = second_sector.get_second_point() - second_begin;
+    const scalar_type vv = v.len2();
+    const scalar_type ww = w.len2();
+    const auto params = policy::closest(first_begin - second_begin, v, vv, impl::inverse_or_zero(vv),
+                                        w, ww, impl::inverse_or_zero(ww));
+
+    // Candidates within eps out of the segment are moved to its end.
+    const scalar_type s = std::clamp<scalar_type>(params.first, 0, 1);
+    const scalar_type t = std::clamp<scalar_type>(params.second, 0, 1);
+    const auto first_point = first_begin + v * s;
+    const auto second_point = second_begin + w * t;
+    return {s, t, first_point, second_point, (first_point - second_point).len2()};
+}
+
+} // namespace geom
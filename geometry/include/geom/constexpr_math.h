@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cmath>
+#include <concepts>
+#include <limits>
+#include <type_traits>
+
+namespace geom
+{
+
+namespace impl
+{
+// Square root by Newton's iterations for constant evaluation: from x or 1, whichever is larger,
+// the iterations go down monotonically until they stop decreasing, exact to the last bit or two.
+template<std::floating_point scalar_type>
+constexpr scalar_type constexpr_sqrt(scalar_type x) noexcept {
+    if (!(x >= 0)) {
+        return std::numeric_limits<scalar_type>::quiet_NaN();
+    }
+    if (x == 0 || x == std::numeric_limits<scalar_type>::infinity()) {
+        return x;
+    }
+    scalar_type r = x > 1 ? x : scalar_type(1);
+    while (true) {
+        const scalar_type next = (r + x / r) / 2;
+        if (!(next < r)) {
+            return r;
+        }
+        r = next;
+    }
+}
+} // namespace impl
+
+// std::sqrt and std::abs at runtime, their constexpr fallbacks in constant evaluation.
+template<std::floating_point scalar_type>
+constexpr scalar_type sqrt(scalar_type x) noexcept {
+    if (std::is_constant_evaluated()) {
+        return impl::constexpr_sqrt(x);
+    }
+    return std::sqrt(x);
+}
+
+template<std::floating_point scalar_type>
+constexpr scalar_type abs(scalar_type x) noexcept {
+    return x < 0 ? -x : x;
+}
+
+} // namespace geom
@@ -0,0 +1,347 @@
+#pragma once
+
+#include "sector.h"
+#include "bounding.h"
+#include "executor.h"
+#include "parallel_distance.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace geom
+{
+
+// Space filling curves of segment ordering: Morton (Z order) is cheaper to compute,
+// Hilbert has no jumps between neighbouring codes, so runs of segments are more compact.
+enum class space_curve {
+    morton,
+    hilbert,
+};
+
+// Bits per axis of curve codes, 3 * 21 bits fit into 63.
+inline constexpr int curve_bits = 21;
+
+namespace impl
+{
+// Spreads 21 low bits of v to every third bit.
+constexpr std::uint64_t spread_bits(std::uint64_t v) noexcept {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x001f00000000ffffull;
+    v = (v | v << 16) & 0x001f0000ff0000ffull;
+    v = (v | v << 8) & 0x100f00f00f00f00full;
+    v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2) & 0x1249249249249249ull;
+    return v;
+}
+} // namespace impl
+
+// Interleaved bits of 21 bit coordinates, x goes to the lowest bit of every triple.
+constexpr std::uint64_t morton_code(std::uint32_t x, std::uint32_t y, std::uint32_t z) noexcept {
+    return impl::spread_bits(x) | impl::spread_bits(y) << 1 | impl::spread_bits(z) << 2;
+}
+
+namespace impl
+{
+// Hilbert curve as a state machine (Hamilton, "Compact Hilbert indices", 2006): the state is the entry
+// corner e and the direction d of the current cube, the octant of the point in it gives the curve digit
+// and the state of the sub-cube. Bits of an octant are x | y << 1 | z << 2, as Morton codes interleave them.
+// one: state * 8 + octant -> digit | next state << 3; two - the same for two levels at once:
+// state * 64 + octants -> digits | next state << 6.
+struct Hilbert_tables {
+    std::array<std::uint8_t, 24 * 8> one{};
+    std::array<std::uint16_t, 24 * 64> two{};
+};
+
+constexpr Hilbert_tables make_hilbert_tables() {
+    const auto rotate_right = [](unsigned b, unsigned r) { r %= 3; return ((b >> r) | (b << (3 - r))) & 7; };
+    const auto rotate_left = [](unsigned b, unsigned r) { r %= 3; return ((b << r) | (b >> (3 - r))) & 7; };
+    const auto gray = [](unsigned i) { return i ^ (i >> 1); };
+    const auto gray_inverse = [](unsigned g) { return (g ^ (g >> 1) ^ (g >> 2)) & 7; };
+    const auto trailing_ones = [](unsigned x) { unsigned c = 0; for (; x & 1; x >>= 1) ++c; return c; };
+    const auto entry = [&](unsigned w) { return w ? gray(2 * ((w - 1) / 2)) : 0u; };
+    const auto direction = [&](unsigned w) {
+        return w ? (w % 2 ? trailing_ones(w) : trailing_ones(w - 1)) % 3 : 0u;
+    };
+
+    Hilbert_tables res;
+    for (unsigned e = 0; e < 8; ++e) {
+        for (unsigned d = 0; d < 3; ++d) {
+            for (unsigned octant = 0; octant < 8; ++octant) {
+                const unsigned w = gray_inverse(rotate_right(octant ^ e, d + 1));
+                const unsigned next = (e ^ rotate_left(entry(w), d + 1)) * 3 + (d + direction(w) + 1) % 3;
+                res.one[(e * 3 + d) * 8 + octant] = static_cast<std::uint8_t>(w | next << 3);
+            }
+        }
+    }
+    for (unsigned state = 0; state < 24; ++state) {
+        for (unsigned octants = 0; octants < 64; ++octants) {
+            const unsigned first = res.one[state * 8 + (octants >> 3)];
+            const unsigned second = res.one[(first >> 3) * 8 + (octants & 7)];
+            res.two[state * 64 + octants] =
+                static_cast<std::uint16_t>((first & 7) << 3 | (second & 7) | (second >> 3) << 6);
+        }
+    }
+    return res;
+}
+
+inline constexpr Hilbert_tables hilbert_tables = make_hilbert_tables();
+} // namespace impl
+
+// Position of the cell on the Hilbert curve through the 2^21 cube: octants of the Morton code
+// go through the state machine from the top level, the first one alone, then by pairs.
+constexpr std::uint64_t hilbert_code(std::uint32_t x, std::uint32_t y, std::uint32_t z) noexcept {
+    const std::uint64_t octants = morton_code(x, y, z);
+    const unsigned first = impl::hilbert_tables.one[octants >> 60];
+    std::uint64_t res = first & 7;
+    unsigned state = first >> 3;
+    for (int shift = 3 * curve_bits - 9; shift >= 0; shift -= 6) {
+        const unsigned pair = impl::hilbert_tables.two[state * 64 + ((octants >> shift) & 63)];
+        res = res << 6 | (pair & 63);
+        state = pair >> 6;
+    }
+    return res;
+}
+
+namespace impl
+{
+// Runs task(block) for blocks by executor threads or in place.
+template<typename task_type>
+void for_each_block(Executor* executor, std::size_t blocks, const task_type& task) {
+    if (executor && blocks > 1) {
+        executor->parallel_for(blocks, 1, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t b = begin; b < end; ++b) {
+                task(b);
+            }
+        });
+    } else {
+        for (std::size_t b = 0; b < blocks; ++b) {
+            task(b);
+        }
+    }
+}
+
+// Keys per block of parallel passes: smaller blocks cost more in histograms than they give.
+inline constexpr std::size_t radix_min_block = 1 << 16;
+
+// Stable LSD radix sort of keys with values by 11 bit digits. Every block of the input counts its digits,
+// then scatters into its own slots of every digit, so passes go in parallel and stay stable.
+// Digits equal in all keys are skipped: codes of 21 bit axes take 6 passes, positions of 10M segments 3.
+// Only key_bits low bits are compared, higher ones are carried along.
+template<typename value_type>
+void radix_sort(Executor* executor, std::vector<std::uint64_t>& keys, std::vector<value_type>& values,
+                int key_bits = 64) {
+    constexpr int digit_bits = 11;
+    constexpr std::size_t digits = std::size_t(1) << digit_bits;
+    const std::size_t n = keys.size();
+    if (n < 2) {
+        return;
+    }
+    const std::size_t blocks = executor
+        ? std::clamp<std::size_t>(n / radix_min_block, 1, 4 * executor->size()) : 1;
+    const auto block_begin = [&](std::size_t b) { return b * n / blocks; };
+
+    std::vector<std::uint64_t> varying(blocks, 0);
+    for_each_block(executor, blocks, [&](std::size_t b) {
+        for (std::size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+            varying[b] |= keys[i] ^ keys[0];
+        }
+    });
+    std::uint64_t varying_bits = 0;
+    for (std::uint64_t v : varying) {
+        varying_bits |= v;
+    }
+    if (key_bits < 64) {
+        varying_bits &= (std::uint64_t(1) << key_bits) - 1;
+    }
+
+    std::vector<std::uint64_t> key_buffer(n);
+    std::vector<value_type> value_buffer(n);
+    std::vector<std::array<std::size_t, digits>> offsets(blocks);
+    for (int shift = 0; shift < 64; shift += digit_bits) {
+        if (!((varying_bits >> shift) & (digits - 1))) {
+            continue;
+        }
+        for_each_block(executor, blocks, [&](std::size_t b) {
+            offsets[b].fill(0);
+            for (std::size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+                ++offsets[b][(keys[i] >> shift) & (digits - 1)];
+            }
+        });
+        std::size_t offset = 0;
+        for (std::size_t d = 0; d < digits; ++d) {
+            for (auto& block : offsets) {
+                offset += std::exchange(block[d], offset);
+            }
+        }
+        for_each_block(executor, blocks, [&](std::size_t b) {
+            auto& slots = offsets[b];
+            for (std::size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+                const std::size_t to = slots[(keys[i] >> shift) & (digits - 1)]++;
+                key_buffer[to] = keys[i];
+                value_buffer[to] = values[i];
+            }
+        });
+        keys.swap(key_buffer);
+        values.swap(value_buffer);
+    }
+}
+} // namespace impl
+
+// Copy of a segment set sorted by curve codes of midpoints, with the permutation back to the source:
+// sectors()[k] is the source segment original(k). Midpoints are quantized to 2^21 cells per axis
+// of the cube around all of them. Neighbours in space mostly go near each other in memory, so
+// indices and passes over pairs of near segments miss caches and TLB far less on inputs in arbitrary order.
+// Built in parallel with an executor; the order does not depend on threads.
+template<std::floating_point scalar_type>
+class Sector_order {
+public:
+    using view = SoA_sectors_view<scalar_type>;
+
+    Sector_order() = default;
+
+    explicit Sector_order(const view& source, space_curve curve = space_curve::hilbert) {
+        build(source, curve, nullptr);
+    }
+
+    Sector_order(const view& source, Executor& executor, space_curve curve = space_curve::hilbert) {
+        build(source, curve, &executor);
+    }
+
+    std::size_t size() const { return order.size(); }
+    view sectors() const { return sorted.get_view(); }
+
+    // Source index of the k-th sorted segment.
+    std::size_t original(std::size_t k) const { return order[k]; }
+    // Sorted position of the source segment i.
+    std::size_t position(std::size_t i) const { return positions[i]; }
+    std::span<const std::uint32_t> permutation() const { return order; }
+
+    // out[original(k)] = in[k]: results over sorted segments back in the source order.
+    template<typename value_type>
+    void restore(std::span<const value_type> in, std::span<value_type> out) const {
+        if (in.size() != size() || out.size() != size()) {
+            throw std::invalid_argument("batch sizes mismatch");
+        }
+        for (std::size_t k = 0; k < in.size(); ++k) {
+            out[order[k]] = in[k];
+        }
+    }
+
+private:
+    SoA_sectors<scalar_type> sorted;
+    std::vector<std::uint32_t> order;
+    std::vector<std::uint32_t> positions;
+
+    void build(const view& source, space_curve curve, Executor* executor) {
+        const std::size_t n = source.size();
+        if (n > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("too many segments to order");
+        }
+        const std::size_t blocks = executor
+            ? std::clamp<std::size_t>(n / impl::radix_min_block, 1, 4 * executor->size()) : 1;
+        const auto block_begin = [&](std::size_t b) { return b * n / blocks; };
+        const auto midpoint = [&](std::size_t i) {
+            return Point_3D<scalar_type>{(source.ax[i] + source.bx[i]) / 2, (source.ay[i] + source.by[i]) / 2,
+                                         (source.az[i] + source.bz[i]) / 2};
+        };
+
+        std::vector<Bounding_box_3D<scalar_type>> block_bounds(blocks);
+        impl::for_each_block(executor, blocks, [&](std::size_t b) {
+            for (std::size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+                block_bounds[b].add(midpoint(i));
+            }
+        });
+        Bounding_box_3D<scalar_type> bounds;
+        for (const auto& b : block_bounds) {
+            bounds.add(b);
+        }
+
+        // One scale for all axes keeps cells cubic; NaN and out of range coordinates are clamped.
+        const auto extent = bounds.get_hi() - bounds.get_lo();
+        const scalar_type size = std::max({extent.get_x(), extent.get_y(), extent.get_z()});
+        constexpr scalar_type max_cell = (std::uint32_t(1) << curve_bits) - 1;
+        const scalar_type scale = size > 0 ? max_cell / size : 0;
+        const auto cell = [&](scalar_type x, scalar_type lo) {
+            const scalar_type c = (x - lo) * scale;
+            return c > 0 ? static_cast<std::uint32_t>(std::min(c, max_cell)) : std::uint32_t(0);
+        };
+
+        std::vector<std::uint64_t> codes(n);
+        order.resize(n);
+        impl::for_each_block(executor, blocks, [&](std::size_t b) {
+            for (std::size_t i = block_begin(b); i < block_begin(b + 1); ++i) {
+                const auto m = midpoint(i);
+                const std::uint32_t x = cell(m.get_x(), bounds.get_lo().get_x());
+                const std::uint32_t y = cell(m.get_y(), bounds.get_lo().get_y());
+                const std::uint32_t z = cell(m.get_z(), bounds.get_lo().get_z());
+                codes[i] = curve == space_curve::hilbert ? hilbert_code(x, y, z) : morton_code(x, y, z);
+                order[i] = static_cast<std::uint32_t>(i);
+            }
+        });
+        impl::radix_sort(executor, codes, order);
+
+        sorted.resize(n);
+        positions.resize(n);
+        impl::for_each_block(executor, blocks, [&](std::size_t b) {
+            for (std::size_t k = block_begin(b); k < block_begin(b + 1); ++k) {
+                sorted.set(k, source[order[k]]);
+                positions[order[k]] = static_cast<std::uint32_t>(k);
+            }
+        });
+    }
+};
+
+// out[i] = distance(sectors[pairs[i].first], sectors[pairs[i].second]), indices of the source set.
+// Pairs are sorted by sorted positions of their first segments, computed over the sorted copy and
+// written back: for pairs of near segments both gathers go almost sequentially.
+template<std::floating_point scalar_type>
+void parallel_distance(Executor& executor,
+                       const Sector_order<scalar_type>& sectors,
+                       std::span<const index_pair> pairs,
+                       std::span<scalar_type> out)
+{
+    if (pairs.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    if (pairs.size() > std::numeric_limits<std::uint32_t>::max()) {
+        throw std::length_error("too many pairs to order");
+    }
+    std::vector<std::uint64_t> keys(pairs.size());
+    std::vector<std::uint32_t> pair_order(pairs.size());
+    std::vector<index_pair> sorted_pairs(pairs.size());
+    executor.parallel_for(pairs.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t i = begin; i < end; ++i) {
+            const auto& [a, b] = pairs[i];
+            if (a >= sectors.size() || b >= sectors.size()) {
+                throw std::out_of_range("segment index is out of range");
+            }
+            keys[i] = std::uint64_t(sectors.position(b)) << 32 | sectors.position(a);
+            pair_order[i] = static_cast<std::uint32_t>(i);
+        }
+    });
+    impl::radix_sort(&executor, keys, pair_order, 32);
+    executor.parallel_for(pairs.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; ++k) {
+            sorted_pairs[k] = {keys[k] & 0xffffffff, keys[k] >> 32};
+        }
+    });
+
+    std::vector<scalar_type> sorted_out(pairs.size());
+    parallel_distance(executor, sectors.sectors(), std::span<const index_pair>(sorted_pairs),
+                      std::span<scalar_type>(sorted_out));
+    executor.parallel_for(pairs.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t k = begin; k < end; ++k) {
+            out[pair_order[k]] = sorted_out[k];
+        }
+    });
+}
+
+} // namespace geom
@@ -3,11 +3,17 @@
 #include "sector.h"
 #include "line.h"
 #include "basic_algorithm.h"
+#include "fast_distance.h"
+#include "stats.h"
 
 #include <algorithm>
+#include <array>
+#include <cmath>
 #include <stdexcept>
-#include <vector>
+#include <type_traits>
+#include <limits>
 #include <optional>
+#include <utility>
 
 
 namespace geom
@@ -15,50 +21,75 @@ namespace geom
 
 namespace impl
 {
+// Closest points of two lines, nothing for parallel ones: the squared sine of the angle
+// between them is not above epsilon (the denominator below, as directions are unit).
 template<std::floating_point scalar_type>
-std::pair<Point_3D<scalar_type>, Point_3D<scalar_type>> closest_point_on_cross_lines(
-    const Line_3D<scalar_type>& a, const Line_3D<scalar_type>& b) 
+constexpr std::optional<std::pair<Point_3D<scalar_type>, Point_3D<scalar_type>>> try_closest_point_on_cross_lines(
+    const Line_3D<scalar_type>& a, const Line_3D<scalar_type>& b) noexcept
 {
     auto c = a.get_point() - b.get_point();
     const auto& v = a.get_vector();
     const auto& w = b.get_vector();
 
     scalar_type vw = dot_product(v, w);
-    if (std::abs(vw - 1.) < epsilon<scalar_type>) {
-        throw std::runtime_error("lines are parallel");
+    scalar_type sin2 = 1 - vw * vw;
+    if (!(sin2 > epsilon<scalar_type>)) {
+        return std::nullopt;
     }
     scalar_type cv = dot_product(c, v);
     scalar_type cw = dot_product(c, w);
 
-    scalar_type u = (cw - cv * vw) / (1. - std::pow(vw, 2.));
+    scalar_type u = (cw - cv * vw) / sin2;
     scalar_type t = u * vw - cv;
 
-    return {a.get_point() + t * a.get_vector(), b.get_point() + u * b.get_vector()};
+    return std::pair{a.get_point() + t * a.get_vector(), b.get_point() + u * b.get_vector()};
+}
+
+template<std::floating_point scalar_type>
+constexpr std::pair<Point_3D<scalar_type>, Point_3D<scalar_type>> closest_point_on_cross_lines(
+    const Line_3D<scalar_type>& a, const Line_3D<scalar_type>& b) 
+{
+    if (auto res = try_closest_point_on_cross_lines(a, b)) {
+        return *res;
+    }
+    throw std::runtime_error("lines are parallel");
 }
-} // namespace impl
 
+// Candidate points of one segment: its ends and up to 3 points inside.
 template<std::floating_point scalar_type>
-scalar_type distance(const Sector_3D<scalar_type>& first_sector, 
-                     const Sector_3D<scalar_type>& second_sector) 
+struct Candidate_points {
+    std::array<Point_3D<scalar_type>, 5> points;
+    std::size_t count;
+
+    constexpr explicit Candidate_points(const Sector_3D<scalar_type>& s) noexcept
+        : points{s.get_first_point(), s.get_second_point(), s.get_first_point(), s.get_first_point(), s.get_first_point()}
+        , count{2}
+    {}
+
+    constexpr void push_back(const Point_3D<scalar_type>& p) noexcept { points[count++] = p; }
+    constexpr const Point_3D<scalar_type>* begin() const noexcept { return points.data(); }
+    constexpr const Point_3D<scalar_type>* end() const noexcept { return points.data() + count; }
+};
+} // namespace impl
+
+// Distance between segments by the algorithm of policy. Enumeration (the default) goes over
+// Line_3D candidates; other policies are the kernels of geom::fast_distance.
+// Never throws: degenerate segments and parallel lines just give fewer candidates.
+template<typename policy = Enumeration_policy, std::floating_point scalar_type>
+constexpr scalar_type distance(const Sector_3D<scalar_type>& first_sector, 
+                     const Sector_3D<scalar_type>& second_sector) noexcept
 {
+    if constexpr (!std::is_same_v<policy, Enumeration_policy>) {
+        return fast_distance<policy>(first_sector, second_sector);
+    }
     using point = Point_3D<scalar_type>;
     using line = Line_3D<scalar_type>;
-    static constexpr auto eps = epsilon<scalar_type>;
     
-    std::vector<point> first_sector_interested_points{
-        first_sector.get_first_point(), 
-        first_sector.get_second_point()};
-    std::vector<point> second_sector_interested_points{
-        second_sector.get_first_point(), 
-        second_sector.get_second_point()};
-    std::optional<line> first_line;
-    if (first_sector.len2()) {
-        first_line = first_sector;
-    }
-    std::optional<line> second_line;
-    if (second_sector.len2()) {
-        second_line = second_sector;
-    }
+    impl::Candidate_points<scalar_type> first_sector_interested_points(first_sector);
+    impl::Candidate_points<scalar_type> second_sector_interested_points(second_sector);
+    // Too short segments have no line, only their ends are candidates.
+    const std::optional<line> first_line = line::make(first_sector);
+    const std::optional<line> second_line = line::make(second_sector);
 
     const auto& add_first_point = [&](const point& p) {
         if (first_sector.contains(p)) {
@@ -72,12 +103,19 @@ scalar_type distance(const Sector_3D<scalar_type>& first_sector,
         }
     };
 
-    if (first_line && second_line && (first_line->get_vector() * second_line->get_vector()).len2() > eps) {
-        const auto& [first_line_point, second_line_point] = 
-            impl::closest_point_on_cross_lines(*first_line, *second_line);
-        add_first_point(first_line_point);
-        add_second_point(second_line_point);
+    if (first_line && second_line) {
+        if (const auto cross = impl::try_closest_point_on_cross_lines(*first_line, *second_line)) {
+            stats::record(stats::path::skew);
+            add_first_point(cross->first);
+            add_second_point(cross->second);
+        } else {
+            stats::record(stats::path::parallel);
+        }
+    } else {
+        stats::record(stats::path::degenerate);
     }
+    const std::size_t first_crossing_end = first_sector_interested_points.count;
+    const std::size_t second_crossing_end = second_sector_interested_points.count;
     if (first_line) {
         add_first_point(projection(*first_line, second_sector.get_first_point()));
         add_first_point(projection(*first_line, second_sector.get_second_point()));
@@ -88,11 +126,21 @@ scalar_type distance(const Sector_3D<scalar_type>& first_sector,
     }
 
     scalar_type res = std::numeric_limits<scalar_type>::infinity();
-    for (const auto& p1 : first_sector_interested_points) {
-        for (const auto& p2 : second_sector_interested_points) {
-            res = std::min(res, (p1 - p2).len());
+    std::size_t best_first = 0, best_second = 0;
+    for (std::size_t i = 0; i < first_sector_interested_points.count; ++i) {
+        for (std::size_t j = 0; j < second_sector_interested_points.count; ++j) {
+            const auto& p1 = first_sector_interested_points.points[i];
+            const auto& p2 = second_sector_interested_points.points[j];
+            const scalar_type d = (p1 - p2).len();
+            if (d < res) {
+                res = d;
+                best_first = i;
+                best_second = j;
+            }
         }
     }
+    stats::record_candidate_pairs(first_sector_interested_points.count * second_sector_interested_points.count);
+    stats::record_closest(best_first, first_crossing_end, best_second, second_crossing_end);
 
     return res;
 }
@@ -0,0 +1,261 @@
+#pragma once
+
+#include "distance.h"
+#include "executor.h"
+#include "parallel_distance.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace geom
+{
+
+// Bounded cache of distances of segment pairs, for streams where the same pairs recur.
+// Keys are bit patterns of coordinates: only exactly equal segments hit, -0 and 0 differ.
+// Keys do not depend on order - (a, b) and (b, a), and reversed ends of a segment, are one entry;
+// the stored distance is the one computed for the first seen order, others may differ by rounding.
+// Entries live in 4 way buckets, a full bucket evicts by CLOCK: a hit sets the referenced bit,
+// the hand skips referenced ways once clearing the bit. Buckets are split between shards
+// with a mutex each, so threads of an executor share one cache.
+template<std::floating_point scalar_type>
+class Distance_cache {
+public:
+    using sector = Sector_3D<scalar_type>;
+
+    struct Counters {
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+        std::uint64_t evictions = 0;
+    };
+
+    static constexpr std::size_t ways = 4;
+
+    // Capacity is rounded up to a power of two buckets.
+    explicit Distance_cache(std::size_t capacity) {
+        if (!capacity) {
+            throw std::invalid_argument("cache capacity must be positive");
+        }
+        const std::size_t buckets = std::bit_ceil((capacity + ways - 1) / ways);
+        bucket_mask = buckets - 1;
+        tags = std::vector<std::uint64_t>(buckets * ways);
+        entries = std::vector<Entry>(buckets * ways);
+        hands = std::vector<std::uint8_t>(buckets);
+        shards = std::vector<Shard>(std::min(buckets, max_shards));
+        shard_mask = shards.size() - 1;
+    }
+
+    Distance_cache(const Distance_cache&) = delete;
+    Distance_cache& operator=(const Distance_cache&) = delete;
+
+    std::size_t capacity() const { return entries.size(); }
+
+    std::optional<scalar_type> find(const sector& a, const sector& b) {
+        const Key key = make_key(a, b);
+        const std::size_t bucket = bucket_of(key);
+        Shard& shard = shards[bucket & shard_mask];
+        std::lock_guard lock(shard.mutex);
+        return find_locked(key, bucket, shard);
+    }
+
+    void insert(const sector& a, const sector& b, scalar_type distance) {
+        const Key key = make_key(a, b);
+        const std::size_t bucket = bucket_of(key);
+        Shard& shard = shards[bucket & shard_mask];
+        std::lock_guard lock(shard.mutex);
+        insert_locked(key, bucket, shard, distance);
+    }
+
+    // Cached distance, or geom::distance stored for next queries. One lock of the shard per call:
+    // a miss is computed under it, so other threads on the shard wait for one kernel call meanwhile.
+    scalar_type distance(const sector& a, const sector& b) {
+        const Key key = make_key(a, b);
+        const std::size_t bucket = bucket_of(key);
+        Shard& shard = shards[bucket & shard_mask];
+        std::lock_guard lock(shard.mutex);
+        if (const auto cached = find_locked(key, bucket, shard)) {
+            return *cached;
+        }
+        const scalar_type res = geom::distance(a, b);
+        insert_locked(key, bucket, shard, res);
+        return res;
+    }
+
+    // Sums of all shards; counts are exact when no thread uses the cache.
+    Counters counters() const {
+        Counters res;
+        for (auto& shard : shards) {
+            std::lock_guard lock(shard.mutex);
+            res.hits += shard.counters.hits;
+            res.misses += shard.counters.misses;
+            res.evictions += shard.counters.evictions;
+        }
+        return res;
+    }
+
+    // Drops entries and counters; no other thread may use the cache meanwhile.
+    void clear() {
+        for (auto& shard : shards) {
+            std::lock_guard lock(shard.mutex);
+            shard.counters = {};
+        }
+        std::fill(tags.begin(), tags.end(), 0);
+        std::fill(hands.begin(), hands.end(), 0);
+    }
+
+private:
+    using bits_type = std::conditional_t<sizeof(scalar_type) == 4, std::uint32_t, std::uint64_t>;
+    using point_bits = std::array<bits_type, 3>;
+    using ends_type = std::array<point_bits, 4>;
+
+    // Ends of both segments as given; the hash does not depend on their order, never 0.
+    struct Key {
+        ends_type ends{};
+        std::uint64_t hash = 0;
+    };
+
+    struct Entry {
+        ends_type ends{};
+        scalar_type distance = 0;
+        bool referenced = false;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        Counters counters;
+    };
+
+    static constexpr std::size_t max_shards = 64;
+
+    // Hashes of entries, 0 - empty way: a lookup reads one cache line of them per bucket.
+    std::vector<std::uint64_t> tags;
+    std::vector<Entry> entries;
+    std::vector<std::uint8_t> hands;
+    std::vector<Shard> shards;
+    std::size_t bucket_mask = 0;
+    std::size_t shard_mask = 0;
+
+    std::optional<scalar_type> find_locked(const Key& key, std::size_t bucket, Shard& shard) {
+        for (std::size_t i = bucket * ways; i < (bucket + 1) * ways; ++i) {
+            if (tags[i] == key.hash && same_ends(entries[i].ends, key.ends)) {
+                entries[i].referenced = true;
+                ++shard.counters.hits;
+                return entries[i].distance;
+            }
+        }
+        ++shard.counters.misses;
+        return std::nullopt;
+    }
+
+    void insert_locked(const Key& key, std::size_t bucket, Shard& shard, scalar_type distance) {
+        const std::size_t first = bucket * ways;
+        for (std::size_t i = first; i < first + ways; ++i) {
+            if (!tags[i] || (tags[i] == key.hash && same_ends(entries[i].ends, key.ends))) {
+                tags[i] = key.hash;
+                entries[i] = {key.ends, distance, false};
+                return;
+            }
+        }
+        std::uint8_t& hand = hands[bucket];
+        while (entries[first + hand].referenced) {
+            entries[first + hand].referenced = false;
+            hand = (hand + 1) % ways;
+        }
+        tags[first + hand] = key.hash;
+        entries[first + hand] = {key.ends, distance, false};
+        hand = (hand + 1) % ways;
+        ++shard.counters.evictions;
+    }
+
+    // The lowest bit of hashes is always set, buckets take the next ones.
+    std::size_t bucket_of(const Key& key) const { return (key.hash >> 1) & bucket_mask; }
+
+    static bool same_sector(const point_bits& p, const point_bits& q, const point_bits& r, const point_bits& s) {
+        return (p == r && q == s) || (p == s && q == r);
+    }
+
+    static bool same_ends(const ends_type& l, const ends_type& r) {
+        return (same_sector(l[0], l[1], r[0], r[1]) && same_sector(l[2], l[3], r[2], r[3]))
+            || (same_sector(l[0], l[1], r[2], r[3]) && same_sector(l[2], l[3], r[0], r[1]));
+    }
+
+    static point_bits to_bits(const Point_3D<scalar_type>& p) {
+        return {std::bit_cast<bits_type>(p.get_x()), std::bit_cast<bits_type>(p.get_y()),
+                std::bit_cast<bits_type>(p.get_z())};
+    }
+
+    // Finalizer of MurmurHash3.
+    static std::uint64_t mix(std::uint64_t h) {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        return h ^ (h >> 33);
+    }
+
+    // Round numbers have zero low mantissa bits, products of them would too: high halves are folded down first.
+    static std::uint64_t hash(const point_bits& p) {
+        const auto fold = [](std::uint64_t w) { return w ^ (w >> 32) ^ (w << 21); };
+        return (fold(p[0]) ^ 0x9e3779b97f4a7c15ull) * 0xbf58476d1ce4e5b9ull
+             + (fold(p[1]) ^ 0x94d049bb133111ebull) * 0x2545f4914f6cdd1dull
+             + (fold(p[2]) ^ 0xd6e8feb86659fd93ull) * 0x9fb21c651e98df25ull;
+    }
+
+    // Sums are symmetric: swapped ends or segments give the same hash, mixing in between keeps
+    // pairs of different segments over the same four ends apart. No branches on the data.
+    static Key make_key(const sector& a, const sector& b) {
+        Key key;
+        key.ends = {to_bits(a.get_first_point()), to_bits(a.get_second_point()),
+                    to_bits(b.get_first_point()), to_bits(b.get_second_point())};
+        const std::uint64_t ha = mix(hash(key.ends[0]) + hash(key.ends[1]));
+        const std::uint64_t hb = mix(hash(key.ends[2]) + hash(key.ends[3]));
+        key.hash = mix(ha + hb) | 1;
+        return key;
+    }
+};
+
+// out[i] = Distance_cache::distance(first[i], second[i]): missed pairs are computed by geom::distance,
+// so all entries come from one kernel and a result does not depend on which call filled the cache.
+// One shard lock per pair; it pays off against geom::distance, not against the vectorized uncached
+// batch_distance, which is cheaper than a lookup.
+template<std::floating_point scalar_type>
+void batch_distance(Distance_cache<scalar_type>& cache,
+                    const SoA_sectors_view<scalar_type>& first,
+                    const SoA_sectors_view<scalar_type>& second,
+                    std::span<scalar_type> out)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = cache.distance(first[i], second[i]);
+    }
+}
+
+// Cached batch_distance over chunks computed by executor threads.
+template<std::floating_point scalar_type>
+void parallel_batch_distance(Executor& executor,
+                             Distance_cache<scalar_type>& cache,
+                             const SoA_sectors_view<scalar_type>& first,
+                             const SoA_sectors_view<scalar_type>& second,
+                             std::span<scalar_type> out)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    executor.parallel_for(out.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        batch_distance(cache, first.subview(begin, end - begin), second.subview(begin, end - begin),
+                       out.subspan(begin, end - begin));
+    });
+}
+
+} // namespace geom
@@ -0,0 +1,128 @@
+#pragma once
+
+#include "sector.h"
+#include "executor.h"
+#include "prepared_sector.h"
+#include "simd.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace geom
+{
+
+// Tile of the matrix: rows share a column block, 1024 segments of double take 48 KB
+// and stay in L2 while rows go over it; the row is one broadcast query of the batch kernel.
+inline constexpr std::size_t matrix_tile_rows = 64;
+inline constexpr std::size_t matrix_tile_cols = 1024;
+
+// Position of (i, j), i <= j, in the packed upper triangle of n x n matrix with the diagonal:
+// rows go one after another, row i takes n - i elements.
+inline std::size_t upper_triangle_index(std::size_t i, std::size_t j, std::size_t n) {
+    return i * n - i * (i - 1) / 2 + (j - i);
+}
+
+inline std::size_t upper_triangle_size(std::size_t n) {
+    return n * (n + 1) / 2;
+}
+
+namespace impl
+{
+// out[k] = distance(query, targets[k]) converted to out_type; conversion goes through
+// a thread local buffer, so the batch kernel writes its own type always.
+template<std::floating_point scalar_type, std::floating_point out_type>
+void matrix_row(const Prepared_sector_3D<scalar_type>& query, const SoA_sectors_view<scalar_type>& targets,
+                out_type* out, simd_level level)
+{
+    if constexpr (std::is_same_v<scalar_type, out_type>) {
+        batch_distance(query, targets, std::span<scalar_type>(out, targets.size()), level);
+    } else {
+        thread_local std::vector<scalar_type> buffer;
+        buffer.resize(targets.size());
+        batch_distance(query, targets, std::span<scalar_type>(buffer), level);
+        std::copy(buffer.begin(), buffer.end(), out);
+    }
+}
+
+// Calls tile(row_begin, row_end, col_begin, col_end) for tiles of rows x cols matrix by executor threads;
+// with upper, tiles below the diagonal are skipped.
+template<typename tile_function>
+void for_each_tile(Executor& executor, std::size_t rows, std::size_t cols, bool upper, tile_function tile)
+{
+    const std::size_t row_tiles = (rows + matrix_tile_rows - 1) / matrix_tile_rows;
+    const std::size_t col_tiles = (cols + matrix_tile_cols - 1) / matrix_tile_cols;
+    std::vector<std::pair<std::size_t, std::size_t>> tiles;
+    for (std::size_t r = 0; r < row_tiles; ++r) {
+        for (std::size_t c = 0; c < col_tiles; ++c) {
+            const std::size_t row_begin = r * matrix_tile_rows;
+            const std::size_t col_end = std::min(cols, (c + 1) * matrix_tile_cols);
+            if (!upper || col_end > row_begin) {
+                tiles.push_back({row_begin, c * matrix_tile_cols});
+            }
+        }
+    }
+    executor.parallel_for(tiles.size(), 1, [&](std::size_t begin, std::size_t end) {
+        for (std::size_t t = begin; t < end; ++t) {
+            const auto [row_begin, col_begin] = tiles[t];
+            tile(row_begin, std::min(rows, row_begin + matrix_tile_rows),
+                 col_begin, std::min(cols, col_begin + matrix_tile_cols));
+        }
+    });
+}
+} // namespace impl
+
+// out[i * cols.size() + j] = distance(rows[i], cols[j]), row major.
+// The matrix goes by tiles in parallel, the output may be a mapped file
+// (binary_kind::distances of rows * cols elements).
+template<std::floating_point scalar_type, std::floating_point out_type>
+void distance_matrix(Executor& executor,
+                     const SoA_sectors_view<scalar_type>& rows,
+                     const SoA_sectors_view<scalar_type>& cols,
+                     std::span<out_type> out,
+                     simd_level level = best_simd_level())
+{
+    if (out.size() != rows.size() * cols.size()) {
+        throw std::invalid_argument("matrix size mismatch");
+    }
+    impl::for_each_tile(executor, rows.size(), cols.size(), false,
+        [&](std::size_t row_begin, std::size_t row_end, std::size_t col_begin, std::size_t col_end) {
+            const auto targets = cols.subview(col_begin, col_end - col_begin);
+            for (std::size_t i = row_begin; i < row_end; ++i) {
+                impl::matrix_row(Prepared_sector_3D<scalar_type>(rows[i]), targets,
+                                 out.data() + i * cols.size() + col_begin, level);
+            }
+        });
+}
+
+// Symmetric matrix of one set: only the upper triangle with the diagonal is computed,
+// packed as upper_triangle_index gives; out has upper_triangle_size(sectors.size()) elements.
+template<std::floating_point scalar_type, std::floating_point out_type>
+void distance_matrix_upper(Executor& executor,
+                           const SoA_sectors_view<scalar_type>& sectors,
+                           std::span<out_type> out,
+                           simd_level level = best_simd_level())
+{
+    const std::size_t n = sectors.size();
+    if (out.size() != upper_triangle_size(n)) {
+        throw std::invalid_argument("matrix size mismatch");
+    }
+    impl::for_each_tile(executor, n, n, true,
+        [&](std::size_t row_begin, std::size_t row_end, std::size_t col_begin, std::size_t col_end) {
+            for (std::size_t i = row_begin; i < row_end; ++i) {
+                const std::size_t begin = std::max(i, col_begin);
+                if (begin < col_end) {
+                    impl::matrix_row(Prepared_sector_3D<scalar_type>(sectors[i]), sectors.subview(begin, col_end - begin),
+                                     out.data() + upper_triangle_index(i, begin, n), level);
+                }
+            }
+        });
+}
+
+} // namespace geom
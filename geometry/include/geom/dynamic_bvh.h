@@ -0,0 +1,470 @@
+#pragma once
+
+#include "sector.h"
+#include "bounding.h"
+#include "bvh.h"
+#include "prepared_sector.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <vector>
+
+namespace geom
+{
+
+// Bounding volume hierarchy over a changing set of segments, for scenes that move every frame.
+// Segments get stable ids on insert; a leaf holds one segment.
+// update() moves a segment without touching the tree, refit() then recomputes all boxes
+// bottom-up in one pass; the tree shape is kept, so it loosens as segments drift apart.
+// rebuild_degraded() rebuilds the subtrees whose boxes grew too much since they were built,
+// rebuild() - the whole tree.
+// Leaf test is the exact distance (geom::fast_distance kernel).
+template<std::floating_point scalar_type>
+class Dynamic_bvh_3D {
+public:
+    using sector = Sector_3D<scalar_type>;
+    using box = Bounding_box_3D<scalar_type>;
+    using hit = Bvh_hit<scalar_type>;
+
+    Dynamic_bvh_3D() = default;
+
+    // Segments get ids 0..n-1, the tree is built at once.
+    explicit Dynamic_bvh_3D(const SoA_sectors_view<scalar_type>& sectors) {
+        if (sectors.size() >= null_index) {
+            throw std::length_error("too many segments for the index");
+        }
+        items.reserve(sectors.size());
+        nodes.reserve(2 * sectors.size());
+        for (std::size_t i = 0; i < sectors.size(); ++i) {
+            const sector s = sectors[i];
+            const auto leaf = static_cast<std::uint32_t>(nodes.size());
+            nodes.push_back({box(s), 0, null_index, null_index, static_cast<std::uint32_t>(i)});
+            items.push_back({s, leaf});
+        }
+        live_count = sectors.size();
+        rebuild();
+    }
+
+    std::size_t size() const { return live_count; }
+    bool empty() const { return !live_count; }
+    std::size_t nodes_count() const { return nodes.size() - free_nodes.size(); }
+    box bounds() const { return root == null_index ? box{} : nodes[root].bounds; }
+
+    bool contains(std::size_t id) const {
+        return id < items.size() && items[id].leaf != null_index;
+    }
+
+    const sector& get(std::size_t id) const {
+        check_id(id);
+        return items[id].segment;
+    }
+
+    // True after update() until refit() or rebuild(): queries need the boxes to be refitted.
+    bool needs_refit() const { return stale; }
+
+    // Adds the segment next to the node where it enlarges boxes least, returns its id.
+    std::size_t insert(const sector& s) {
+        std::size_t id;
+        if (free_items.empty()) {
+            if (items.size() >= null_index) {
+                throw std::length_error("too many segments for the index");
+            }
+            id = items.size();
+            items.push_back({s, null_index});
+        } else {
+            id = free_items.back();
+            free_items.pop_back();
+            items[id].segment = s;
+        }
+        const std::uint32_t leaf = allocate_node({box(s), 0, null_index, null_index, static_cast<std::uint32_t>(id)});
+        items[id].leaf = leaf;
+        ++live_count;
+        insert_leaf(leaf);
+        return id;
+    }
+
+    void remove(std::size_t id) {
+        check_id(id);
+        const std::uint32_t leaf = items[id].leaf;
+        items[id].leaf = null_index;
+        free_items.push_back(id);
+        --live_count;
+        order_stale = true;
+
+        const std::uint32_t parent = nodes[leaf].parent;
+        free_nodes.push_back(leaf);
+        if (parent == null_index) {
+            root = null_index;
+            return;
+        }
+        const std::uint32_t sibling = nodes[parent].left == leaf ? nodes[parent].right : nodes[parent].left;
+        const std::uint32_t grandparent = nodes[parent].parent;
+        nodes[sibling].parent = grandparent;
+        free_nodes.push_back(parent);
+        if (grandparent == null_index) {
+            root = sibling;
+            return;
+        }
+        (nodes[grandparent].left == parent ? nodes[grandparent].left : nodes[grandparent].right) = sibling;
+        refit_path(grandparent);
+    }
+
+    // Moves the segment; boxes of its ancestors are fixed by the next refit().
+    void update(std::size_t id, const sector& s) {
+        check_id(id);
+        items[id].segment = s;
+        nodes[items[id].leaf].bounds = box(s);
+        stale = true;
+    }
+
+    // Recomputes boxes of all inner nodes from their children.
+    void refit() {
+        refit_nodes([](const Node&) {});
+    }
+
+    // Rebuilds subtrees whose box area grew more than factor times since they were built,
+    // returns their count. Boxes are refitted on the way, the tree is walked only if
+    // anything has degraded.
+    std::size_t rebuild_degraded(scalar_type factor = 2) {
+        bool degraded = false;
+        refit_nodes([&](const Node& node) {
+            degraded |= node.bounds.half_area() > factor * node.built_area;
+        });
+        if (!degraded) {
+            return 0;
+        }
+        std::size_t res = 0;
+        std::vector<std::uint32_t> stack{root};
+        while (!stack.empty()) {
+            const std::uint32_t index = stack.back();
+            stack.pop_back();
+            const Node& node = nodes[index];
+            if (is_leaf(node)) {
+                continue;
+            }
+            if (node.bounds.half_area() > factor * node.built_area) {
+                rebuild_subtree(index);
+                ++res;
+                continue;
+            }
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+        return res;
+    }
+
+    void rebuild() {
+        if (root == null_index) {
+            // Leaves of the bulk constructor are not linked yet.
+            std::vector<Build_leaf> leaves;
+            leaves.reserve(live_count);
+            for (const Item& item : items) {
+                if (item.leaf != null_index) {
+                    leaves.push_back({nodes[item.leaf].bounds.center(), item.leaf});
+                }
+            }
+            if (!leaves.empty()) {
+                root = build(leaves, null_index, null_index);
+            }
+        } else {
+            rebuild_subtree(root);
+        }
+        stale = false;
+    }
+
+    // The closest segment, nothing for empty index.
+    std::optional<hit> nearest(const sector& query) const {
+        std::optional<hit> res;
+        scalar_type best = std::numeric_limits<scalar_type>::infinity();
+        traverse(query, [&] { return best; }, [&](std::size_t id, scalar_type d2) {
+            if (d2 < best) {
+                best = d2;
+                res = hit{id, d2};
+            }
+        });
+        if (res) {
+            res->distance = std::sqrt(res->distance);
+        }
+        return res;
+    }
+
+    // All segments not farther than radius, in no particular order.
+    std::vector<hit> within(const sector& query, scalar_type radius) const {
+        std::vector<hit> res;
+        if (radius < 0) {
+            return res;
+        }
+        const scalar_type radius2 = radius * radius;
+        traverse(query, [&] { return radius2; }, [&](std::size_t id, scalar_type d2) {
+            if (d2 <= radius2) {
+                res.push_back({id, std::sqrt(d2)});
+            }
+        });
+        return res;
+    }
+
+private:
+    static constexpr std::uint32_t null_index = std::numeric_limits<std::uint32_t>::max();
+
+    struct Node {
+        box bounds;
+        scalar_type built_area = 0; // half area of bounds when the subtree was built
+        std::uint32_t parent = null_index;
+        std::uint32_t left = null_index; // null for leaves
+        std::uint32_t right = null_index; // leaf - id of its segment
+    };
+
+    struct Item {
+        sector segment;
+        std::uint32_t leaf; // null for removed ids
+    };
+
+    // Leaf of a build with its box center.
+    struct Build_leaf {
+        Point_3D<scalar_type> centroid;
+        std::uint32_t node;
+    };
+
+    std::vector<Node> nodes;
+    std::vector<std::uint32_t> free_nodes;
+    std::vector<Item> items;
+    std::vector<std::size_t> free_items;
+    std::uint32_t root = null_index;
+    std::size_t live_count = 0;
+    bool stale = false;
+
+    // Inner nodes in depth first order, kept until the tree shape changes.
+    std::vector<std::uint32_t> refit_order;
+    bool order_stale = true;
+
+    // Refits inner nodes children first and calls on_node for each of them.
+    template<typename node_function>
+    void refit_nodes(node_function on_node) {
+        if (order_stale) {
+            // Depth first order: children go after parents, so the reverse pass sees them first.
+            // Nodes of a build are allocated in this order too, so the pass walks memory backward.
+            refit_order.clear();
+            std::vector<std::uint32_t> stack;
+            if (root != null_index) {
+                stack.push_back(root);
+            }
+            while (!stack.empty()) {
+                const std::uint32_t index = stack.back();
+                stack.pop_back();
+                const Node& node = nodes[index];
+                if (!is_leaf(node)) {
+                    refit_order.push_back(index);
+                    stack.push_back(node.right);
+                    stack.push_back(node.left);
+                }
+            }
+            order_stale = false;
+        }
+        for (auto it = refit_order.rbegin(); it != refit_order.rend(); ++it) {
+            Node& node = nodes[*it];
+            node.bounds = nodes[node.left].bounds;
+            node.bounds.add(nodes[node.right].bounds);
+            on_node(node);
+        }
+        stale = false;
+    }
+
+    static bool is_leaf(const Node& node) { return node.left == null_index; }
+
+    static scalar_type coord(const Point_3D<scalar_type>& p, int axis) {
+        return axis == 0 ? p.get_x() : axis == 1 ? p.get_y() : p.get_z();
+    }
+
+    static box merged(box l, const box& r) {
+        l.add(r);
+        return l;
+    }
+
+    void check_id(std::size_t id) const {
+        if (!contains(id)) {
+            throw std::out_of_range("no segment with this id");
+        }
+    }
+
+    std::uint32_t allocate_node(const Node& node) {
+        order_stale = true;
+        if (free_nodes.empty()) {
+            if (nodes.size() >= null_index) {
+                throw std::length_error("too many segments for the index");
+            }
+            nodes.push_back(node);
+            return static_cast<std::uint32_t>(nodes.size() - 1);
+        }
+        const std::uint32_t res = free_nodes.back();
+        free_nodes.pop_back();
+        nodes[res] = node;
+        return res;
+    }
+
+    // Goes down to the sibling where the leaf adds least area to the tree:
+    // the cost of a new parent here against the cost of going into a child.
+    void insert_leaf(std::uint32_t leaf) {
+        if (root == null_index) {
+            root = leaf;
+            nodes[leaf].parent = null_index;
+            return;
+        }
+        const box leaf_box = nodes[leaf].bounds;
+        std::uint32_t sibling = root;
+        while (!is_leaf(nodes[sibling])) {
+            const Node& node = nodes[sibling];
+            const scalar_type area = node.bounds.half_area();
+            const scalar_type combined = merged(node.bounds, leaf_box).half_area();
+            const scalar_type here = 2 * combined;
+            const scalar_type inherited = 2 * (combined - area);
+            const auto child_cost = [&](std::uint32_t child) {
+                const box& bounds = nodes[child].bounds;
+                const scalar_type grown = merged(bounds, leaf_box).half_area();
+                return inherited + (is_leaf(nodes[child]) ? grown : grown - bounds.half_area());
+            };
+            const scalar_type left_cost = child_cost(node.left);
+            const scalar_type right_cost = child_cost(node.right);
+            if (here < left_cost && here < right_cost) {
+                break;
+            }
+            sibling = left_cost < right_cost ? node.left : node.right;
+        }
+
+        const std::uint32_t old_parent = nodes[sibling].parent;
+        const box bounds = merged(nodes[sibling].bounds, leaf_box);
+        const std::uint32_t parent = allocate_node({bounds, bounds.half_area(), old_parent, sibling, leaf});
+        nodes[sibling].parent = parent;
+        nodes[leaf].parent = parent;
+        if (old_parent == null_index) {
+            root = parent;
+            return;
+        }
+        (nodes[old_parent].left == sibling ? nodes[old_parent].left : nodes[old_parent].right) = parent;
+        refit_path(old_parent);
+    }
+
+    // Refits the node and its ancestors after a change below; new content is not degradation,
+    // so built areas grow with it.
+    void refit_path(std::uint32_t index) {
+        order_stale = true;
+        while (index != null_index) {
+            Node& node = nodes[index];
+            node.bounds = merged(nodes[node.left].bounds, nodes[node.right].bounds);
+            node.built_area = std::max(node.built_area, node.bounds.half_area());
+            index = node.parent;
+        }
+    }
+
+    // Rebuilds the subtree in place: its root node keeps the index, so the parent link stays.
+    void rebuild_subtree(std::uint32_t index) {
+        if (is_leaf(nodes[index])) {
+            return;
+        }
+        std::vector<Build_leaf> leaves;
+        std::vector<std::uint32_t> stack{nodes[index].left, nodes[index].right};
+        while (!stack.empty()) {
+            const std::uint32_t node = stack.back();
+            stack.pop_back();
+            if (is_leaf(nodes[node])) {
+                leaves.push_back({nodes[node].bounds.center(), node});
+                continue;
+            }
+            free_nodes.push_back(node);
+            stack.push_back(nodes[node].left);
+            stack.push_back(nodes[node].right);
+        }
+        order_stale = true;
+        build(leaves, nodes[index].parent, index);
+    }
+
+    // Top-down build over leaves by the median of box centers along their longest extent:
+    // a balanced tree is cheap to build, and a moving scene does not keep a finer split for long.
+    // The root goes to the given slot, if any.
+    std::uint32_t build(std::span<Build_leaf> leaves, std::uint32_t parent, std::uint32_t slot) {
+        if (leaves.size() == 1) {
+            nodes[leaves[0].node].parent = parent;
+            return leaves[0].node;
+        }
+        box centroids;
+        for (const Build_leaf& leaf : leaves) {
+            centroids.add(leaf.centroid);
+        }
+        int axis = 0;
+        scalar_type extent = -1;
+        for (int k = 0; k < 3; ++k) {
+            const scalar_type k_extent = coord(centroids.get_hi(), k) - coord(centroids.get_lo(), k);
+            if (k_extent > extent) {
+                axis = k;
+                extent = k_extent;
+            }
+        }
+        const auto middle = leaves.begin() + static_cast<std::ptrdiff_t>(leaves.size() / 2);
+        std::nth_element(leaves.begin(), middle, leaves.end(), [&](const Build_leaf& l, const Build_leaf& r) {
+            return coord(l.centroid, axis) < coord(r.centroid, axis);
+        });
+
+        const std::uint32_t index = slot != null_index ? slot : allocate_node({});
+        const std::size_t half = leaves.size() / 2;
+        const std::uint32_t left = build(leaves.first(half), index, null_index);
+        const std::uint32_t right = build(leaves.subspan(half), index, null_index);
+        const box bounds = merged(nodes[left].bounds, nodes[right].bounds);
+        nodes[index] = {bounds, bounds.half_area(), parent, left, right};
+        return index;
+    }
+
+    // Calls on_segment(id, d2) for segments of leaves whose boxes are not farther than bound(),
+    // nearer children first.
+    template<typename bound_function, typename segment_function>
+    void traverse(const sector& query, bound_function bound, segment_function on_segment) const {
+        if (stale) {
+            throw std::logic_error("index is not refitted after update");
+        }
+        if (root == null_index) {
+            return;
+        }
+        const Prepared_sector_3D<scalar_type> prepared(query);
+        const box query_box(query);
+
+        struct Entry {
+            std::uint32_t node;
+            scalar_type d2;
+        };
+        std::vector<Entry> stack;
+        stack.reserve(64);
+        stack.push_back({root, impl::bvh_bound2(prepared, query_box, nodes[root].bounds)});
+        while (!stack.empty()) {
+            const Entry entry = stack.back();
+            stack.pop_back();
+            if (entry.d2 > bound()) {
+                continue;
+            }
+            const Node& node = nodes[entry.node];
+            if (is_leaf(node)) {
+                const Prepared_sector_3D<scalar_type> segment(items[node.right].segment);
+                on_segment(node.right, prepared.distance2(segment));
+                continue;
+            }
+            Entry left{node.left, impl::bvh_bound2(prepared, query_box, nodes[node.left].bounds)};
+            Entry right{node.right, impl::bvh_bound2(prepared, query_box, nodes[node.right].bounds)};
+            if (left.d2 > right.d2) {
+                std::swap(left, right);
+            }
+            const scalar_type limit = bound();
+            if (right.d2 <= limit) {
+                stack.push_back(right);
+            }
+            if (left.d2 <= limit) {
+                stack.push_back(left);
+            }
+        }
+    }
+};
+
+} // namespace geom
@@ -0,0 +1,221 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace geom
+{
+
+// Pool of threads running parallel loops over chunks with work stealing.
+// Every worker owns a contiguous range of chunks and takes them from the front,
+// a worker that is out of chunks steals the back half of the biggest range of the others.
+// So both cheap and expensive chunks are spread over all threads, and chunks next
+// to each other mostly go to one thread.
+// The calling thread works as worker 0, so Executor(1) runs everything in place.
+class Executor {
+public:
+    using task_type = std::function<void(std::size_t begin, std::size_t end)>;
+
+    // 0 threads - one per hardware thread.
+    explicit Executor(std::size_t threads = 0) {
+        if (!threads) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        workers = std::vector<Worker>(threads);
+        for (std::size_t i = 1; i < threads; ++i) {
+            threads_.emplace_back([this, i] { worker_loop(i); });
+        }
+    }
+
+    Executor(const Executor&) = delete;
+    Executor& operator=(const Executor&) = delete;
+
+    ~Executor() {
+        {
+            std::lock_guard lock(mutex);
+            stop = true;
+        }
+        job_started.notify_all();
+        for (auto& t : threads_) {
+            t.join();
+        }
+    }
+
+    std::size_t size() const { return workers.size(); }
+
+    // Calls task(begin, end) for [0, count) split into chunks of chunk_size, waits for all of them.
+    // The first exception of tasks is rethrown, remaining chunks are skipped then.
+    void parallel_for(std::size_t count, std::size_t chunk_size, const task_type& task) {
+        if (!count) {
+            return;
+        }
+        chunk_size = std::max<std::size_t>(chunk_size, 1);
+        const std::size_t chunks = (count + chunk_size - 1) / chunk_size;
+        if (workers.size() == 1 || chunks == 1) {
+            for (std::size_t begin = 0; begin < count; begin += chunk_size) {
+                task(begin, std::min(count, begin + chunk_size));
+            }
+            return;
+        }
+
+        std::lock_guard run_lock(run_mutex);
+        {
+            std::lock_guard lock(mutex);
+            job = &task;
+            job_count = count;
+            job_chunk_size = chunk_size;
+            chunks_left = chunks;
+            error = nullptr;
+            failed = false;
+            for (std::size_t i = 0; i < workers.size(); ++i) {
+                std::lock_guard worker_lock(workers[i].mutex);
+                workers[i].begin = chunks * i / workers.size();
+                workers[i].end = chunks * (i + 1) / workers.size();
+            }
+            ++generation;
+        }
+        job_started.notify_all();
+
+        run_chunks(0);
+
+        std::unique_lock lock(mutex);
+        job_finished.wait(lock, [this] { return chunks_left == 0 && active == 0; });
+        job = nullptr;
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    std::vector<Worker> workers;
+    std::vector<std::thread> threads_;
+
+    std::mutex run_mutex;
+    std::mutex mutex;
+    std::condition_variable job_started;
+    std::condition_variable job_finished;
+    const task_type* job = nullptr;
+    std::size_t job_count = 0;
+    std::size_t job_chunk_size = 0;
+    std::size_t chunks_left = 0;
+    std::size_t generation = 0;
+    std::size_t active = 0; // workers holding the task
+    std::exception_ptr error;
+    std::atomic<bool> failed = false;
+    bool stop = false;
+
+    void worker_loop(std::size_t index) {
+        std::size_t seen_generation = 0;
+        while (true) {
+            {
+                std::unique_lock lock(mutex);
+                job_started.wait(lock, [&] { return stop || generation != seen_generation; });
+                if (stop) {
+                    return;
+                }
+                seen_generation = generation;
+            }
+            run_chunks(index);
+        }
+    }
+
+    bool pop_own(std::size_t index, std::size_t& chunk) {
+        auto& w = workers[index];
+        std::lock_guard lock(w.mutex);
+        if (w.begin == w.end) {
+            return false;
+        }
+        chunk = w.begin++;
+        return true;
+    }
+
+    bool steal(std::size_t index) {
+        std::size_t victim = index;
+        std::size_t victim_size = 0;
+        for (std::size_t i = 0; i < workers.size(); ++i) {
+            std::lock_guard lock(workers[i].mutex);
+            if (workers[i].end - workers[i].begin > victim_size) {
+                victim = i;
+                victim_size = workers[i].end - workers[i].begin;
+            }
+        }
+        if (!victim_size) {
+            return false;
+        }
+        if (victim == index) {
+            return true;
+        }
+        std::scoped_lock lock(workers[victim].mutex, workers[index].mutex);
+        auto& v = workers[victim];
+        if (v.begin == v.end) {
+            return true; // drained meanwhile, look for another one
+        }
+        std::size_t middle = v.end - (v.end - v.begin) / 2;
+        if (middle == v.end) {
+            middle = v.begin;
+        }
+        workers[index].begin = middle;
+        workers[index].end = v.end;
+        v.end = middle;
+        return true;
+    }
+
+    void run_chunks(std::size_t index) {
+        const task_type* task;
+        std::size_t count, chunk_size;
+        {
+            std::lock_guard lock(mutex);
+            task = job;
+            if (!task) {
+                return;
+            }
+            count = job_count;
+            chunk_size = job_chunk_size;
+            ++active;
+        }
+        std::size_t done = 0;
+        while (true) {
+            std::size_t chunk;
+            if (!pop_own(index, chunk)) {
+                if (steal(index)) {
+                    continue;
+                }
+                break;
+            }
+            if (!failed.load(std::memory_order_relaxed)) {
+                try {
+                    (*task)(chunk * chunk_size, std::min(count, (chunk + 1) * chunk_size));
+                } catch (...) {
+                    std::lock_guard lock(mutex);
+                    if (!error) {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+            ++done;
+        }
+        std::lock_guard lock(mutex);
+        chunks_left -= done;
+        --active;
+        if (!chunks_left && !active) {
+            job_finished.notify_all();
+        }
+    }
+};
+
+} // namespace geom
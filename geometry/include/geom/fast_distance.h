@@ -0,0 +1,213 @@
+#pragma once
+
+#include "sector.h"
+#include "basic_algorithm.h"
+#include "basics.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+
+namespace geom
+{
+
+namespace impl
+{
+// Fixed-capacity storage for segment parameters of candidate points.
+// Segment gets at most 5 candidates: 2 ends, the closest point to the other line
+// and projections of 2 ends of the other segment.
+template<std::floating_point scalar_type, std::size_t capacity = 5>
+class candidate_params {
+public:
+    constexpr void push_back(scalar_type t) noexcept {
+        params[count++] = t;
+    }
+
+    constexpr std::size_t size() const noexcept { return count; }
+    constexpr scalar_type operator[](std::size_t i) const noexcept { return params[i]; }
+    constexpr const scalar_type* begin() const noexcept { return params.data(); }
+    constexpr const scalar_type* end() const noexcept { return params.data() + count; }
+
+private:
+    std::array<scalar_type, capacity> params{};
+    std::size_t count = 0;
+};
+
+// Parameters of the closest points on two segments and squared distance between them.
+template<std::floating_point scalar_type>
+struct closest_params {
+    scalar_type first;
+    scalar_type second;
+    scalar_type distance2;
+};
+
+// Same candidates as geom::distance, but points are kept as parameters on the
+// segments (p = a + t * v, v = b - a), lines are not normalized and only squared
+// distances are compared.
+// c = a1 - a2; vv, ww - squared lengths, inv_vv, inv_ww - their inverses, 0 for degenerate segments.
+template<std::floating_point scalar_type>
+constexpr closest_params<scalar_type> param_closest(const Vector_3D<scalar_type>& c,
+                                          const Vector_3D<scalar_type>& v, scalar_type vv, scalar_type inv_vv,
+                                          const Vector_3D<scalar_type>& w, scalar_type ww, scalar_type inv_ww) noexcept
+{
+    constexpr auto eps = epsilon<scalar_type>;
+
+    const scalar_type vw = dot_product(v, w);
+    const scalar_type cv = dot_product(c, v);
+    const scalar_type cw = dot_product(c, w);
+
+    candidate_params<scalar_type> first_params;
+    candidate_params<scalar_type> second_params;
+    first_params.push_back(0.);
+    first_params.push_back(1.);
+    second_params.push_back(0.);
+    second_params.push_back(1.);
+
+    const auto add_param = [](candidate_params<scalar_type>& params, scalar_type t) {
+        if (t > -eps && t < 1. + eps) {
+            params.push_back(t);
+        }
+    };
+
+    if (vv && ww) {
+        // |v x w|^2 = vv * ww * sin^2, the same check as for normalized lines.
+        scalar_type cross2 = (v * w).len2();
+        if (cross2 > eps * vv * ww) {
+            stats::record(stats::path::skew);
+            add_param(first_params, (vw * cw - cv * ww) / cross2);
+            add_param(second_params, (vv * cw - vw * cv) / cross2);
+        } else {
+            stats::record(stats::path::parallel);
+        }
+    } else {
+        stats::record(stats::path::degenerate);
+    }
+    const std::size_t first_crossing_end = first_params.size();
+    const std::size_t second_crossing_end = second_params.size();
+    if (vv) {
+        add_param(first_params, -cv * inv_vv);
+        add_param(first_params, (vw - cv) * inv_vv);
+    }
+    if (ww) {
+        add_param(second_params, cw * inv_ww);
+        add_param(second_params, (cw + vw) * inv_ww);
+    }
+
+    closest_params<scalar_type> res{0, 0, std::numeric_limits<scalar_type>::infinity()};
+    std::size_t best_first = 0, best_second = 0;
+    for (std::size_t i = 0; i < first_params.size(); ++i) {
+        for (std::size_t j = 0; j < second_params.size(); ++j) {
+            const scalar_type t = first_params[i];
+            const scalar_type u = second_params[j];
+            const scalar_type d2 = (c + (t * v - u * w)).len2();
+            if (d2 < res.distance2) {
+                res = {t, u, d2};
+                best_first = i;
+                best_second = j;
+            }
+        }
+    }
+    stats::record_candidate_pairs(first_params.size() * second_params.size());
+    stats::record_closest(best_first, first_crossing_end, best_second, second_crossing_end);
+    return res;
+}
+
+template<std::floating_point scalar_type>
+constexpr scalar_type param_distance2(const Vector_3D<scalar_type>& c,
+                            const Vector_3D<scalar_type>& v, scalar_type vv, scalar_type inv_vv,
+                            const Vector_3D<scalar_type>& w, scalar_type ww, scalar_type inv_ww) noexcept
+{
+    return param_closest(c, v, vv, inv_vv, w, ww, inv_ww).distance2;
+}
+
+template<std::floating_point scalar_type>
+constexpr scalar_type inverse_or_zero(scalar_type x) noexcept {
+    return x ? 1 / x : 0;
+}
+
+// Lumelsky's clamped parametric closest points: the closest points of lines with the first
+// parameter clamped to the segment, then the second parameter of the closest point to it clamped,
+// then the first one once more for the clamped second one.
+// Clamps are selects, so the only branch left is the parallel check; parallel lines and
+// degenerate segments start from the first parameter 0, the other steps fix it up.
+// Arguments are the same as of param_closest.
+template<std::floating_point scalar_type>
+constexpr closest_params<scalar_type> clamped_closest(const Vector_3D<scalar_type>& c,
+                                            const Vector_3D<scalar_type>& v, scalar_type vv, scalar_type inv_vv,
+                                            const Vector_3D<scalar_type>& w, scalar_type ww, scalar_type inv_ww) noexcept
+{
+    constexpr auto eps = epsilon<scalar_type>;
+    const auto clamp = [](scalar_type t) { return std::min<scalar_type>(std::max<scalar_type>(t, 0), 1); };
+
+    const scalar_type vw = dot_product(v, w);
+    const scalar_type cv = dot_product(c, v);
+    const scalar_type cw = dot_product(c, w);
+
+    // |v x w|^2 rather than vv * ww - vw^2: no cancellation for almost parallel lines.
+    const scalar_type cross2 = (v * w).len2();
+    if constexpr (stats::enabled) {
+        stats::record(!vv || !ww ? stats::path::degenerate
+                      : cross2 > eps * vv * ww ? stats::path::skew : stats::path::parallel);
+    }
+    scalar_type s = cross2 > eps * vv * ww ? clamp((vw * cw - cv * ww) / cross2) : 0;
+    const scalar_type t = clamp((cw + s * vw) * inv_ww);
+    s = clamp((t * vw - cv) * inv_vv);
+    return {s, t, (c + (s * v - t * w)).len2()};
+}
+} // namespace impl
+
+// Algorithms of the segment distance, the policy parameter of geom::distance,
+// geom::fast_distance and geom::closest_points.
+// Enumeration: up to 5 candidate points per segment (ends, the closest points of lines and
+// projections of ends of the other segment) and the best of up to 25 pairs.
+struct Enumeration_policy {
+    template<std::floating_point scalar_type>
+    static constexpr impl::closest_params<scalar_type> closest(const Vector_3D<scalar_type>& c,
+                                                     const Vector_3D<scalar_type>& v, scalar_type vv, scalar_type inv_vv,
+                                                     const Vector_3D<scalar_type>& w, scalar_type ww, scalar_type inv_ww) noexcept
+    {
+        return impl::param_closest(c, v, vv, inv_vv, w, ww, inv_ww);
+    }
+};
+
+// Clamped: Lumelsky's closest points of lines clamped to segments, see impl::clamped_closest.
+struct Clamped_policy {
+    template<std::floating_point scalar_type>
+    static constexpr impl::closest_params<scalar_type> closest(const Vector_3D<scalar_type>& c,
+                                                     const Vector_3D<scalar_type>& v, scalar_type vv, scalar_type inv_vv,
+                                                     const Vector_3D<scalar_type>& w, scalar_type ww, scalar_type inv_ww) noexcept
+    {
+        return impl::clamped_closest(c, v, vv, inv_vv, w, ww, inv_ww);
+    }
+};
+
+namespace impl
+{
+template<typename policy = Enumeration_policy, std::floating_point scalar_type>
+constexpr scalar_type fast_distance2(const Sector_3D<scalar_type>& first_sector,
+                           const Sector_3D<scalar_type>& second_sector) noexcept
+{
+    const auto first_begin = first_sector.get_first_point();
+    const auto second_begin = second_sector.get_first_point();
+    const auto v = first_sector.get_second_point() - first_begin;
+    const auto w = second_sector.get_second_point() - second_begin;
+    const scalar_type vv = v.len2();
+    const scalar_type ww = w.len2();
+    return policy::closest(first_begin - second_begin, v, vv, inverse_or_zero(vv),
+                           w, ww, inverse_or_zero(ww)).distance2;
+}
+} // namespace impl
+
+// Allocation-free version of geom::distance.
+// Never throws: degenerate segments are handled as points.
+template<typename policy = Enumeration_policy, std::floating_point scalar_type>
+constexpr scalar_type fast_distance(const Sector_3D<scalar_type>& first_sector,
+                          const Sector_3D<scalar_type>& second_sector) noexcept
+{
+    return geom::sqrt(impl::fast_distance2<policy>(first_sector, second_sector));
+}
+
+} // namespace geom
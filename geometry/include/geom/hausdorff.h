@@ -0,0 +1,268 @@
+#pragma once
+
+#include "sector.h"
+#include "bvh.h"
+#include "executor.h"
+#include "parallel_distance.h"
+#include "polyline.h"
+#include "prepared_sector.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <vector>
+
+namespace geom
+{
+
+template<std::floating_point scalar_type>
+struct Hausdorff_options {
+    // Points inside segments are checked until points between the checked ones can not be
+    // farther than the result plus tolerance / 2; 0 - ends of segments only (discrete distance).
+    scalar_type tolerance = 0;
+    // Seed of the random order of segments.
+    unsigned seed = 42;
+};
+
+// Point of the first set farthest from the second set: the segment it lies on and its distance.
+template<std::floating_point scalar_type>
+struct Hausdorff_hit {
+    std::size_t segment;
+    Point_3D<scalar_type> point;
+    scalar_type distance;
+};
+
+namespace impl
+{
+// Raises the shared bound to value if it is larger.
+template<std::floating_point scalar_type>
+void atomic_max(std::atomic<scalar_type>& bound, scalar_type value) {
+    scalar_type current = bound.load(std::memory_order_relaxed);
+    while (value > current && !bound.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+
+// Farther point, ties go to the smaller segment.
+template<std::floating_point scalar_type>
+bool farther(const Hausdorff_hit<scalar_type>& l, const Hausdorff_hit<scalar_type>& r) {
+    return l.distance > r.distance || (l.distance == r.distance && l.segment < r.segment);
+}
+
+// No segment of the second set is known to be close.
+inline constexpr std::size_t no_hint = std::numeric_limits<std::size_t>::max();
+
+// Directed distance from count segments given by segment(i) to the set whose distance to a point
+// nearest(point, good_enough, hint) gives: exact one or any value below good_enough.
+// hint is a segment of the set close to the previous point of the same segment, it is checked
+// first and the search updates it.
+// Early break: the largest distance found so far is shared by all threads, the nearest search
+// of a point stops as soon as the set is closer than it, so most points cost a few leaf tests
+// and most points after the first one of a segment cost one test of the hint.
+// Segments go in random order, so the bound grows fast wherever the far points are.
+// A segment whose ends are at d0 and d1 from the set has no point farther than (d0 + d1 + length) / 2,
+// pieces with this bound not above the found distance are skipped, the others are halved.
+// floor - the distance known to be reached in advance (the other direction of the symmetric one).
+template<std::floating_point scalar_type, typename segment_function, typename nearest_function>
+std::optional<Hausdorff_hit<scalar_type>> directed_hausdorff(Executor& executor, std::size_t count,
+                                                             segment_function segment, nearest_function nearest,
+                                                             scalar_type floor,
+                                                             const Hausdorff_options<scalar_type>& options)
+{
+    if (!count) {
+        return std::nullopt;
+    }
+    std::vector<std::size_t> order(count);
+    std::iota(order.begin(), order.end(), std::size_t(0));
+    std::shuffle(order.begin(), order.end(), std::mt19937_64{options.seed});
+
+    std::atomic<scalar_type> found{floor};
+    std::vector<std::optional<Hausdorff_hit<scalar_type>>> best((count + parallel_chunk_size - 1) / parallel_chunk_size);
+    executor.parallel_for(count, parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        auto& res = best[begin / parallel_chunk_size];
+        struct Piece {
+            scalar_type t0, t1, d0, d1;
+        };
+        std::vector<Piece> pieces;
+        for (std::size_t k = begin; k < end; ++k) {
+            const std::size_t i = order[k];
+            const Sector_3D<scalar_type> s = segment(i);
+            const auto direction = s.get_second_point() - s.get_first_point();
+            const scalar_type length = std::sqrt(direction.len2());
+            std::size_t hint = no_hint;
+            // Distance of the point at t, exact if it is not below the found one.
+            const auto check = [&](scalar_type t) {
+                const Point_3D<scalar_type> p = s.get_first_point() + direction * t;
+                const scalar_type bound = found.load(std::memory_order_relaxed);
+                const scalar_type d = nearest(p, bound, hint);
+                if (d >= bound) {
+                    const Hausdorff_hit<scalar_type> hit{i, p, d};
+                    if (!res || farther(hit, *res)) {
+                        res = hit;
+                    }
+                    atomic_max(found, d);
+                }
+                return d;
+            };
+            const scalar_type d0 = check(0);
+            if (!length) {
+                continue;
+            }
+            pieces.assign(1, Piece{0, 1, d0, check(1)});
+            while (options.tolerance > 0 && !pieces.empty()) {
+                const Piece piece = pieces.back();
+                pieces.pop_back();
+                const scalar_type piece_length = (piece.t1 - piece.t0) * length;
+                if ((piece.d0 + piece.d1 + piece_length) / 2 <= found.load(std::memory_order_relaxed)
+                    || piece_length <= options.tolerance) {
+                    continue;
+                }
+                const scalar_type t = (piece.t0 + piece.t1) / 2;
+                const scalar_type d = check(t);
+                pieces.push_back({piece.t0, t, piece.d0, d});
+                pieces.push_back({t, piece.t1, d, piece.d1});
+            }
+        }
+    });
+
+    std::optional<Hausdorff_hit<scalar_type>> res;
+    for (const auto& hit : best) {
+        if (hit && (!res || farther(*hit, *res))) {
+            res = hit;
+        }
+    }
+    // Nothing is farther than the floor: the distance is the floor, the point is not known.
+    if (!res) {
+        res = Hausdorff_hit<scalar_type>{0, segment(0).get_first_point(), floor};
+    }
+    return res;
+}
+
+// Nearest search of directed_hausdorff over segments given by segment(i) and their index.
+template<std::floating_point scalar_type, typename segment_function, typename search_function>
+auto hinted_nearest(segment_function segment, search_function search) {
+    return [segment, search](const Point_3D<scalar_type>& p, scalar_type good_enough, std::size_t& hint) {
+        const Prepared_sector_3D<scalar_type> query({p, p});
+        if (hint != no_hint) {
+            const scalar_type d = query.distance(Prepared_sector_3D<scalar_type>(segment(hint)));
+            if (d < good_enough) {
+                return d;
+            }
+        }
+        const Bvh_hit<scalar_type> hit = search(Sector_3D<scalar_type>{p, p}, good_enough);
+        hint = hit.index;
+        return hit.distance;
+    };
+}
+
+template<std::floating_point scalar_type>
+auto bvh_nearest_function(const SoA_sectors_view<scalar_type>& sectors, const Bvh_3D<scalar_type>& index) {
+    return hinted_nearest<scalar_type>([&sectors](std::size_t i) { return sectors[i]; },
+        [&index](const Sector_3D<scalar_type>& query, scalar_type good_enough) {
+            return *index.nearest(query, good_enough);
+        });
+}
+
+template<std::floating_point scalar_type>
+auto polyline_nearest_function(const Polyline_3D<scalar_type>& polyline) {
+    return hinted_nearest<scalar_type>([&polyline](std::size_t i) { return polyline.segment(i); },
+        [&polyline](const Sector_3D<scalar_type>& query, scalar_type good_enough) {
+            return polyline_nearest(polyline, query, good_enough);
+        });
+}
+} // namespace impl
+
+// Directed Hausdorff distance from the segment set to the second one: the largest distance
+// from a point of the first set to the second, with the farthest point.
+// to_index is the index of the second set built in advance. Nothing if either set is empty.
+template<std::floating_point scalar_type>
+std::optional<Hausdorff_hit<scalar_type>> directed_hausdorff(Executor& executor,
+                                                             const SoA_sectors_view<scalar_type>& from,
+                                                             const SoA_sectors_view<scalar_type>& to,
+                                                             const Bvh_3D<scalar_type>& to_index,
+                                                             const Hausdorff_options<scalar_type>& options = {})
+{
+    if (to_index.empty()) {
+        return std::nullopt;
+    }
+    return impl::directed_hausdorff(executor, from.size(), [&](std::size_t i) { return from[i]; },
+                                    impl::bvh_nearest_function(to, to_index), scalar_type(0), options);
+}
+
+template<std::floating_point scalar_type>
+std::optional<Hausdorff_hit<scalar_type>> directed_hausdorff(Executor& executor,
+                                                             const SoA_sectors_view<scalar_type>& from,
+                                                             const SoA_sectors_view<scalar_type>& to,
+                                                             const Hausdorff_options<scalar_type>& options = {})
+{
+    return directed_hausdorff(executor, from, to, Bvh_3D<scalar_type>(to, executor), options);
+}
+
+// Symmetric Hausdorff distance: the larger of both directed ones, nothing if either set is empty.
+// The second direction starts from the first one as the found distance, so it mostly breaks early.
+template<std::floating_point scalar_type>
+std::optional<scalar_type> hausdorff(Executor& executor,
+                                     const SoA_sectors_view<scalar_type>& first,
+                                     const SoA_sectors_view<scalar_type>& second,
+                                     const Hausdorff_options<scalar_type>& options = {})
+{
+    if (!first.size() || !second.size()) {
+        return std::nullopt;
+    }
+    const auto forward = directed_hausdorff(executor, first, second, options);
+    const Bvh_3D<scalar_type> first_index(first, executor);
+    return impl::directed_hausdorff(executor, second.size(), [&](std::size_t i) { return second[i]; },
+                                    impl::bvh_nearest_function(first, first_index), forward->distance, options)->distance;
+}
+
+// Hausdorff distances between polylines, their hierarchies are the indexes.
+template<std::floating_point scalar_type>
+std::optional<Hausdorff_hit<scalar_type>> directed_hausdorff(Executor& executor,
+                                                             const Polyline_3D<scalar_type>& from,
+                                                             const Polyline_3D<scalar_type>& to,
+                                                             const Hausdorff_options<scalar_type>& options = {})
+{
+    if (to.empty()) {
+        return std::nullopt;
+    }
+    return impl::directed_hausdorff(executor, from.segments_count(), [&](std::size_t i) { return from.segment(i); },
+                                    impl::polyline_nearest_function(to), scalar_type(0), options);
+}
+
+template<std::floating_point scalar_type>
+std::optional<scalar_type> hausdorff(Executor& executor,
+                                     const Polyline_3D<scalar_type>& first,
+                                     const Polyline_3D<scalar_type>& second,
+                                     const Hausdorff_options<scalar_type>& options = {})
+{
+    if (first.empty() || second.empty()) {
+        return std::nullopt;
+    }
+    const auto forward = directed_hausdorff(executor, first, second, options);
+    return impl::directed_hausdorff(executor, second.segments_count(), [&](std::size_t i) { return second.segment(i); },
+                                    impl::polyline_nearest_function(first), forward->distance, options)->distance;
+}
+
+template<std::floating_point scalar_type>
+std::optional<Hausdorff_hit<scalar_type>> directed_hausdorff(const Polyline_3D<scalar_type>& from,
+                                                             const Polyline_3D<scalar_type>& to,
+                                                             const Hausdorff_options<scalar_type>& options = {})
+{
+    Executor executor(1);
+    return directed_hausdorff(executor, from, to, options);
+}
+
+template<std::floating_point scalar_type>
+std::optional<scalar_type> hausdorff(const Polyline_3D<scalar_type>& first, const Polyline_3D<scalar_type>& second,
+                                     const Hausdorff_options<scalar_type>& options = {})
+{
+    Executor executor(1);
+    return hausdorff(executor, first, second, options);
+}
+
+} // namespace geom
@@ -4,6 +4,7 @@
 #include "basics.h"
 #include "sector.h"
 
+#include <optional>
 #include <stdexcept>
 
 namespace geom
@@ -18,27 +19,44 @@ public:
     using vector = Vector_3D<scalar_type>;
     using sector = Sector_3D<scalar_type>;
 
-    Line_3D(const point& a, const point& b) 
-        : a{ a }
-        , v{ base_vector(a, b) }
+    constexpr Line_3D(const point& a, const point& b) 
+        : Line_3D(checked(make(a, b)))
     {}
-    Line_3D(const sector& s)
+    constexpr Line_3D(const sector& s)
         : Line_3D(s.get_first_point(), s.get_second_point()) 
     {}
 
-    const point& get_point() const { return a; };
-    const vector& get_vector() const { return v; };
+    // Line through a and b, nothing if the points are too close to give a direction.
+    static constexpr std::optional<Line_3D> make(const point& a, const point& b) noexcept {
+        const vector base = b - a;
+        if (!(base.len2() >= epsilon<scalar_type>)) {
+            return std::nullopt;
+        }
+        return Line_3D(a, base.normalized(), direction_tag{});
+    }
+    static constexpr std::optional<Line_3D> make(const sector& s) noexcept {
+        return make(s.get_first_point(), s.get_second_point());
+    }
+
+    constexpr const point& get_point() const noexcept { return a; };
+    constexpr const vector& get_vector() const noexcept { return v; };
 
 private:
     point a;
     vector v;
 
-    static vector base_vector(const point& a, const point& b) {
-        vector base = b - a;
-        if (base.len2() < epsilon<scalar_type>) {
+    struct direction_tag {};
+
+    constexpr Line_3D(const point& a, const vector& v, direction_tag) noexcept
+        : a{ a }
+        , v{ v }
+    {}
+
+    static constexpr const Line_3D& checked(const std::optional<Line_3D>& line) {
+        if (!line) {
             throw std::runtime_error("cannot initialize line from 1 point");
         }
-        return base.normalized();
+        return *line;
     }
 };
 } // namespace geom
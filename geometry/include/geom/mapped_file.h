@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace geom::io
+{
+
+// File mapped into memory as a whole: read only, or created with given size for writing.
+// Pages are loaded by OS on demand, so the file may be larger than RAM.
+class Mapped_file {
+public:
+    Mapped_file() = default;
+
+    static Mapped_file open(const std::string& path) {
+        Mapped_file res;
+        res.map(path, false, 0);
+        return res;
+    }
+
+    // Creates (or truncates) file of the given size.
+    static Mapped_file create(const std::string& path, std::size_t size) {
+        Mapped_file res;
+        res.map(path, true, size);
+        return res;
+    }
+
+    Mapped_file(Mapped_file&& oth) noexcept {
+        swap(oth);
+    }
+
+    Mapped_file& operator=(Mapped_file&& oth) noexcept {
+        Mapped_file tmp(std::move(oth));
+        swap(tmp);
+        return *this;
+    }
+
+    Mapped_file(const Mapped_file&) = delete;
+    Mapped_file& operator=(const Mapped_file&) = delete;
+
+    ~Mapped_file() {
+        unmap();
+    }
+
+    std::span<const std::byte> data() const {
+        return {static_cast<const std::byte*>(addr), size};
+    }
+
+    std::span<std::byte> data() {
+        return {static_cast<std::byte*>(addr), size};
+    }
+
+    bool writable() const { return write; }
+
+private:
+    void* addr = nullptr;
+    std::size_t size = 0;
+    bool write = false;
+#ifdef _WIN32
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+
+    void swap(Mapped_file& oth) noexcept {
+        std::swap(addr, oth.addr);
+        std::swap(size, oth.size);
+        std::swap(write, oth.write);
+#ifdef _WIN32
+        std::swap(file, oth.file);
+        std::swap(mapping, oth.mapping);
+#else
+        std::swap(fd, oth.fd);
+#endif
+    }
+
+    [[noreturn]] void fail(const std::string& what, const std::string& path) {
+        unmap();
+        throw std::runtime_error(what + " " + path);
+    }
+
+#ifdef _WIN32
+    void map(const std::string& path, bool create, std::size_t new_size) {
+        write = create;
+        file = CreateFileA(path.c_str(), create ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ,
+                           FILE_SHARE_READ, nullptr, create ? CREATE_ALWAYS : OPEN_EXISTING,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            fail("cannot open", path);
+        }
+        if (create) {
+            size = new_size;
+        } else {
+            LARGE_INTEGER file_size;
+            if (!GetFileSizeEx(file, &file_size)) {
+                fail("cannot get size of", path);
+            }
+            size = static_cast<std::size_t>(file_size.QuadPart);
+        }
+        if (!size) {
+            return;
+        }
+        const auto high = static_cast<DWORD>(static_cast<unsigned long long>(size) >> 32);
+        const auto low = static_cast<DWORD>(size & 0xffffffffu);
+        mapping = CreateFileMappingA(file, nullptr, create ? PAGE_READWRITE : PAGE_READONLY, high, low, nullptr);
+        if (!mapping) {
+            fail("cannot map", path);
+        }
+        addr = MapViewOfFile(mapping, create ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size);
+        if (!addr) {
+            fail("cannot map", path);
+        }
+    }
+
+    void unmap() noexcept {
+        if (addr) {
+            if (write) {
+                FlushViewOfFile(addr, 0);
+            }
+            UnmapViewOfFile(addr);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        addr = nullptr;
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+        size = 0;
+    }
+#else
+    void map(const std::string& path, bool create, std::size_t new_size) {
+        write = create;
+        fd = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                    : ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fail("cannot open", path);
+        }
+        if (create) {
+            size = new_size;
+            if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+                fail("cannot resize", path);
+            }
+        } else {
+            struct stat st;
+            if (::fstat(fd, &st) != 0) {
+                fail("cannot get size of", path);
+            }
+            size = static_cast<std::size_t>(st.st_size);
+        }
+        if (!size) {
+            return;
+        }
+        addr = ::mmap(nullptr, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            addr = nullptr;
+            fail("cannot map", path);
+        }
+        ::madvise(addr, size, MADV_SEQUENTIAL);
+    }
+
+    void unmap() noexcept {
+        if (addr) {
+            ::munmap(addr, size);
+        }
+        if (fd >= 0) {
+            ::close(fd);
+        }
+        addr = nullptr;
+        fd = -1;
+        size = 0;
+    }
+#endif
+};
+
+} // namespace geom::io
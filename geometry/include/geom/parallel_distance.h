@@ -0,0 +1,64 @@
+#pragma once
+
+#include "batch_distance.h"
+#include "executor.h"
+#include "soa.h"
+
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <utility>
+
+namespace geom
+{
+
+// Pair of indices into a segment array.
+using index_pair = std::pair<std::size_t, std::size_t>;
+
+// Pairs per task: gathered coordinates of 1024 pairs of double take 96 KB, they stay in L2.
+inline constexpr std::size_t parallel_chunk_size = 1024;
+
+// out[i] = distance(first[i], second[i]), chunks of pairs are computed by executor threads.
+template<std::floating_point scalar_type>
+void parallel_batch_distance(Executor& executor,
+                             const SoA_sectors_view<scalar_type>& first,
+                             const SoA_sectors_view<scalar_type>& second,
+                             std::span<scalar_type> out)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    executor.parallel_for(out.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        batch_distance(first.subview(begin, end - begin), second.subview(begin, end - begin),
+                       out.subspan(begin, end - begin));
+    });
+}
+
+// out[i] = distance(sectors[pairs[i].first], sectors[pairs[i].second]).
+// Every chunk gathers its pairs into thread local SoA buffers and runs the batch kernel on them.
+template<std::floating_point scalar_type>
+void parallel_distance(Executor& executor,
+                       const SoA_sectors_view<scalar_type>& sectors,
+                       std::span<const index_pair> pairs,
+                       std::span<scalar_type> out)
+{
+    if (pairs.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    executor.parallel_for(pairs.size(), parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        thread_local SoA_sectors<scalar_type> first, second;
+        first.resize(end - begin);
+        second.resize(end - begin);
+        for (std::size_t k = 0; k < end - begin; ++k) {
+            const auto& [i, j] = pairs[begin + k];
+            if (i >= sectors.size() || j >= sectors.size()) {
+                throw std::out_of_range("segment index is out of range");
+            }
+            first.set(k, sectors[i]);
+            second.set(k, sectors[j]);
+        }
+        batch_distance(first.get_view(), second.get_view(), out.subspan(begin, end - begin));
+    });
+}
+
+} // namespace geom
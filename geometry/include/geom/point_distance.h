@@ -0,0 +1,223 @@
+#pragma once
+
+#include "sector.h"
+#include "basic_algorithm.h"
+#include "prepared_sector.h"
+#include "simd.h"
+#include "soa.h"
+
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+
+namespace geom
+{
+
+// Closest point of a segment to a point: its parameter on the segment
+// (0 - the first end, 1 - the second one) and the distance to it.
+template<std::floating_point scalar_type>
+struct Point_projection {
+    scalar_type t;
+    scalar_type distance;
+};
+
+namespace impl
+{
+// projection() of the point onto the segment line clamped to the segment, branch free for lanes:
+// c = point - segment begin, v - segment direction, inv_vv - its inverse squared length.
+// Degenerate segments have zero inverse length, so their parameter is 0 and the begin is the closest.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void lane_point_projection(const lane_type (&c)[3], const lane_type (&v)[3], const lane_type& inv_vv,
+                                             lane_type& t, lane_type& d2) noexcept
+{
+    const lane_type zero{};
+    const lane_type one = zero + scalar_type(1);
+    t = (c[0] * v[0] + c[1] * v[1] + c[2] * v[2]) * inv_vv;
+    t = t > zero ? (t < one ? t : one) : zero;
+    const lane_type dx = c[0] - t * v[0];
+    const lane_type dy = c[1] - t * v[1];
+    const lane_type dz = c[2] - t * v[2];
+    d2 = dx * dx + dy * dy + dz * dz;
+}
+} // namespace impl
+
+template<std::floating_point scalar_type>
+Point_projection<scalar_type> project(const Point_3D<scalar_type>& p, const Prepared_sector_3D<scalar_type>& s) noexcept {
+    const auto c = p - s.get_begin();
+    const auto v = s.get_direction();
+    const scalar_type c_coords[3] = {c.get_x(), c.get_y(), c.get_z()};
+    const scalar_type v_coords[3] = {v.get_x(), v.get_y(), v.get_z()};
+    scalar_type t, d2;
+    impl::lane_point_projection<scalar_type, scalar_type>(c_coords, v_coords, s.get_inv_len2(), t, d2);
+    return {t, std::sqrt(d2)};
+}
+
+template<std::floating_point scalar_type>
+Point_projection<scalar_type> project(const Point_3D<scalar_type>& p, const Sector_3D<scalar_type>& s) noexcept {
+    return project(p, Prepared_sector_3D<scalar_type>(s));
+}
+
+template<std::floating_point scalar_type>
+scalar_type distance(const Point_3D<scalar_type>& p, const Sector_3D<scalar_type>& s) noexcept {
+    return project(p, s).distance;
+}
+
+namespace impl
+{
+// Projections of points onto one segment, or onto segments[i] when pairwise,
+// by lane_type sized blocks, the tail goes by scalars.
+template<typename lane_type, bool pairwise, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void point_projection_loop(const SoA_points_view<scalar_type>& points,
+                                             const Prepared_sector_3D<scalar_type>* query,
+                                             const SoA_sectors_view<scalar_type>* segments,
+                                             scalar_type* t_out, scalar_type* distance_out) noexcept
+{
+    constexpr std::size_t lanes = sizeof(lane_type) / sizeof(scalar_type);
+    const std::size_t n = points.size();
+    const scalar_type* point_coords[3] = {points.x.data(), points.y.data(), points.z.data()};
+
+    std::size_t i = 0;
+    if constexpr (lanes > 1) {
+        const lane_type zero{};
+        lane_type begin[3], v[3], inv_vv;
+        if constexpr (!pairwise) {
+            const auto a = query->get_begin();
+            const auto d = query->get_direction();
+            begin[0] = zero + a.get_x();
+            begin[1] = zero + a.get_y();
+            begin[2] = zero + a.get_z();
+            v[0] = zero + d.get_x();
+            v[1] = zero + d.get_y();
+            v[2] = zero + d.get_z();
+            inv_vv = zero + query->get_inv_len2();
+        }
+        for (; i + lanes <= n; i += lanes) {
+            if constexpr (pairwise) {
+                const scalar_type* segment_coords[6] = {
+                    segments->ax.data(), segments->ay.data(), segments->az.data(),
+                    segments->bx.data(), segments->by.data(), segments->bz.data()};
+                lane_type segment_lanes[6], vv;
+                GEOM_UNROLL
+                for (int k = 0; k < 6; ++k) {
+                    std::memcpy(&segment_lanes[k], segment_coords[k] + i, sizeof(lane_type));
+                }
+                lane_direction<lane_type, scalar_type>(segment_lanes, v, vv, inv_vv);
+                for (int k = 0; k < 3; ++k) {
+                    begin[k] = segment_lanes[k];
+                }
+            }
+            lane_type point_lanes[3], t, d2;
+            // Unrolled, so lanes stay in registers: a rolled copy goes through the stack,
+            // and split unaligned AVX loads stall store forwarding there.
+            GEOM_UNROLL
+            for (int k = 0; k < 3; ++k) {
+                std::memcpy(&point_lanes[k], point_coords[k] + i, sizeof(lane_type));
+            }
+            const lane_type c[3] = {point_lanes[0] - begin[0], point_lanes[1] - begin[1], point_lanes[2] - begin[2]};
+            lane_point_projection<lane_type, scalar_type>(c, v, inv_vv, t, d2);
+            std::memcpy(t_out + i, &t, sizeof(lane_type));
+            for (std::size_t k = 0; k < lanes; ++k) {
+                distance_out[i + k] = std::sqrt(d2[k]);
+            }
+        }
+    }
+    for (; i < n; ++i) {
+        Point_projection<scalar_type> res;
+        if constexpr (pairwise) {
+            res = project(points[i], (*segments)[i]);
+        } else {
+            res = project(points[i], *query);
+        }
+        t_out[i] = res.t;
+        distance_out[i] = res.distance;
+    }
+}
+
+template<bool pairwise, std::floating_point scalar_type>
+void point_projection_sse2(const SoA_points_view<scalar_type>& points, const Prepared_sector_3D<scalar_type>* query,
+                           const SoA_sectors_view<scalar_type>* segments,
+                           scalar_type* t_out, scalar_type* distance_out) noexcept
+{
+#ifdef GEOM_SIMD_DISPATCH
+    point_projection_loop<simd_vector_t<scalar_type, 16>, pairwise>(points, query, segments, t_out, distance_out);
+#else
+    point_projection_loop<scalar_type, pairwise>(points, query, segments, t_out, distance_out);
+#endif
+}
+
+#ifdef GEOM_SIMD_DISPATCH
+
+template<bool pairwise, std::floating_point scalar_type>
+GEOM_TARGET("avx2,fma")
+void point_projection_avx2(const SoA_points_view<scalar_type>& points, const Prepared_sector_3D<scalar_type>* query,
+                           const SoA_sectors_view<scalar_type>* segments,
+                           scalar_type* t_out, scalar_type* distance_out) noexcept
+{
+    point_projection_loop<simd_vector_t<scalar_type, 32>, pairwise>(points, query, segments, t_out, distance_out);
+}
+
+template<bool pairwise, std::floating_point scalar_type>
+GEOM_TARGET("avx512f,avx512dq,avx2,fma")
+void point_projection_avx512(const SoA_points_view<scalar_type>& points, const Prepared_sector_3D<scalar_type>* query,
+                             const SoA_sectors_view<scalar_type>* segments,
+                             scalar_type* t_out, scalar_type* distance_out) noexcept
+{
+    point_projection_loop<simd_vector_t<scalar_type, 64>, pairwise>(points, query, segments, t_out, distance_out);
+}
+#endif
+
+template<bool pairwise, std::floating_point scalar_type>
+void point_projection(const SoA_points_view<scalar_type>& points, const Prepared_sector_3D<scalar_type>* query,
+                      const SoA_sectors_view<scalar_type>* segments,
+                      std::span<scalar_type> t_out, std::span<scalar_type> distance_out, simd_level level)
+{
+    if (t_out.size() != points.size() || distance_out.size() != points.size()
+        || (pairwise && segments->size() != points.size())) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    switch (std::min(level, supported_simd_level())) {
+    case simd_level::scalar:
+        point_projection_loop<scalar_type, pairwise>(points, query, segments, t_out.data(), distance_out.data());
+        break;
+    case simd_level::sse2:
+        point_projection_sse2<pairwise>(points, query, segments, t_out.data(), distance_out.data());
+        break;
+#ifdef GEOM_SIMD_DISPATCH
+    case simd_level::avx2:
+        point_projection_avx2<pairwise>(points, query, segments, t_out.data(), distance_out.data());
+        break;
+    case simd_level::avx512:
+        point_projection_avx512<pairwise>(points, query, segments, t_out.data(), distance_out.data());
+        break;
+#else
+    default:
+        point_projection_sse2<pairwise>(points, query, segments, t_out.data(), distance_out.data());
+        break;
+#endif
+    }
+}
+} // namespace impl
+
+// t_out[i], distance_out[i] = project(points[i], segment): a point cloud against one segment.
+template<std::floating_point scalar_type>
+void batch_project(const SoA_points_view<scalar_type>& points, const Prepared_sector_3D<scalar_type>& segment,
+                   std::span<scalar_type> t_out, std::span<scalar_type> distance_out,
+                   simd_level level = best_simd_level())
+{
+    impl::point_projection<false>(points, &segment, static_cast<const SoA_sectors_view<scalar_type>*>(nullptr),
+                                  t_out, distance_out, level);
+}
+
+// t_out[i], distance_out[i] = project(points[i], segments[i]).
+template<std::floating_point scalar_type>
+void batch_project(const SoA_points_view<scalar_type>& points, const SoA_sectors_view<scalar_type>& segments,
+                   std::span<scalar_type> t_out, std::span<scalar_type> distance_out,
+                   simd_level level = best_simd_level())
+{
+    impl::point_projection<true>(points, static_cast<const Prepared_sector_3D<scalar_type>*>(nullptr), &segments,
+                                 t_out, distance_out, level);
+}
+
+} // namespace geom
@@ -0,0 +1,253 @@
+#pragma once
+
+#include "sector.h"
+#include "bounding.h"
+#include "bvh.h"
+#include "prepared_sector.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace geom
+{
+
+// Polyline as contiguous vertices, segment i goes from vertex i to vertex i + 1;
+// a single vertex is one degenerate segment.
+// Ranges of segments are bounded by a binary hierarchy of boxes: halves of the parent range,
+// flattened in depth first order, leaves of up to leaf_size segments.
+template<std::floating_point scalar_type>
+class Polyline_3D {
+public:
+    using point = Point_3D<scalar_type>;
+    using sector = Sector_3D<scalar_type>;
+    using box = Bounding_box_3D<scalar_type>;
+
+    static constexpr std::size_t leaf_size = 8;
+
+    // Range of segments and their bounds.
+    struct Node {
+        box bounds;
+        std::uint32_t begin = 0;
+        std::uint32_t count = 0;
+        std::uint32_t right = 0; // right child, 0 for leaves: the left one goes right after the node
+    };
+
+    Polyline_3D() = default;
+
+    explicit Polyline_3D(std::vector<point> vertices)
+        : vertices{ std::move(vertices) }
+    {
+        if (this->vertices.size() > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("too many vertices for the polyline");
+        }
+        if (!this->vertices.empty()) {
+            nodes.reserve(2 * (segments_count() / leaf_size + 1));
+            build(0, segments_count());
+        }
+    }
+
+    std::span<const point> get_vertices() const { return vertices; }
+    bool empty() const { return vertices.empty(); }
+
+    std::size_t segments_count() const {
+        return vertices.size() > 1 ? vertices.size() - 1 : vertices.size();
+    }
+
+    sector segment(std::size_t i) const {
+        return vertices.size() > 1 ? sector{vertices[i], vertices[i + 1]} : sector{vertices[i], vertices[i]};
+    }
+
+    box bounds() const { return nodes.empty() ? box{} : nodes.front().bounds; }
+
+    std::span<const Node> get_nodes() const { return nodes; }
+
+private:
+    std::vector<point> vertices;
+    std::vector<Node> nodes;
+
+    std::size_t build(std::size_t begin, std::size_t count) {
+        const std::size_t index = nodes.size();
+        nodes.push_back({box{}, static_cast<std::uint32_t>(begin), static_cast<std::uint32_t>(count), 0});
+        if (count <= leaf_size) {
+            box bounds;
+            for (std::size_t i = begin; i <= std::min(begin + count, vertices.size() - 1); ++i) {
+                bounds.add(vertices[i]);
+            }
+            nodes[index].bounds = bounds;
+            return index;
+        }
+        const std::size_t half = count / 2;
+        build(begin, half);
+        const std::size_t right = build(begin + half, count - half);
+        nodes[index].right = static_cast<std::uint32_t>(right);
+        box bounds = nodes[index + 1].bounds;
+        bounds.add(nodes[right].bounds);
+        nodes[index].bounds = bounds;
+        return index;
+    }
+};
+
+// Closest segments of two polylines and distance between them.
+template<std::floating_point scalar_type>
+struct Polyline_hit {
+    std::size_t first_segment;
+    std::size_t second_segment;
+    scalar_type distance;
+};
+
+// Closest segments of two polylines by simultaneous descent of both hierarchies:
+// pairs of ranges whose boxes are farther than the best distance found are pruned,
+// nearer pairs go first, so the best distance shrinks early. Nothing for empty polylines,
+// or if no distance is a number (NaN coordinates).
+template<std::floating_point scalar_type>
+std::optional<Polyline_hit<scalar_type>> closest_segments(const Polyline_3D<scalar_type>& first,
+                                                          const Polyline_3D<scalar_type>& second)
+{
+    using node = typename Polyline_3D<scalar_type>::Node;
+    using prepared = Prepared_sector_3D<scalar_type>;
+    if (first.empty() || second.empty()) {
+        return std::nullopt;
+    }
+    const auto first_nodes = first.get_nodes();
+    const auto second_nodes = second.get_nodes();
+
+    struct Entry {
+        std::uint32_t first, second;
+        scalar_type d2;
+    };
+    std::vector<Entry> stack{{0, 0, distance2(first_nodes[0].bounds, second_nodes[0].bounds)}};
+    std::vector<prepared> second_leaf;
+    std::optional<Polyline_hit<scalar_type>> res;
+    scalar_type best = std::numeric_limits<scalar_type>::infinity();
+    while (!stack.empty()) {
+        const Entry entry = stack.back();
+        stack.pop_back();
+        if (entry.d2 >= best) {
+            continue;
+        }
+        const node& a = first_nodes[entry.first];
+        const node& b = second_nodes[entry.second];
+        if (!a.right && !b.right) {
+            second_leaf.clear();
+            for (std::size_t j = b.begin; j < b.begin + b.count; ++j) {
+                second_leaf.emplace_back(second.segment(j));
+            }
+            for (std::size_t i = a.begin; i < a.begin + a.count; ++i) {
+                const prepared s(first.segment(i));
+                for (std::size_t j = 0; j < second_leaf.size(); ++j) {
+                    const scalar_type d2 = s.distance2(second_leaf[j]);
+                    if (d2 < best) {
+                        best = d2;
+                        res = Polyline_hit<scalar_type>{i, b.begin + j, d2};
+                    }
+                }
+            }
+            continue;
+        }
+        // The larger range is split, a leaf is never split.
+        const bool split_first = !b.right || (a.right && a.count >= b.count);
+        Entry children[2];
+        if (split_first) {
+            children[0] = {entry.first + 1, entry.second, distance2(first_nodes[entry.first + 1].bounds, b.bounds)};
+            children[1] = {a.right, entry.second, distance2(first_nodes[a.right].bounds, b.bounds)};
+        } else {
+            children[0] = {entry.first, entry.second + 1, distance2(a.bounds, second_nodes[entry.second + 1].bounds)};
+            children[1] = {entry.first, b.right, distance2(a.bounds, second_nodes[b.right].bounds)};
+        }
+        if (children[0].d2 > children[1].d2) {
+            std::swap(children[0], children[1]);
+        }
+        for (const Entry& child : {children[1], children[0]}) {
+            if (child.d2 < best) {
+                stack.push_back(child);
+            }
+        }
+    }
+    if (!res) {
+        return res;
+    }
+    res->distance = std::sqrt(res->distance);
+    return res;
+}
+
+// Distance between polylines, throws for empty ones; NaN if no distance is a number.
+template<std::floating_point scalar_type>
+scalar_type distance(const Polyline_3D<scalar_type>& first, const Polyline_3D<scalar_type>& second)
+{
+    if (first.empty() || second.empty()) {
+        throw std::invalid_argument("empty polyline");
+    }
+    const auto res = closest_segments(first, second);
+    return res ? res->distance : std::numeric_limits<scalar_type>::quiet_NaN();
+}
+
+namespace impl
+{
+// The closest segment of non-empty polyline to the segment, or the first one found closer than good_enough:
+// the descent stops there.
+template<std::floating_point scalar_type>
+Bvh_hit<scalar_type> polyline_nearest(const Polyline_3D<scalar_type>& polyline, const Sector_3D<scalar_type>& s,
+                             scalar_type good_enough)
+{
+    const auto nodes = polyline.get_nodes();
+    const Prepared_sector_3D<scalar_type> query(s);
+    const Bounding_box_3D<scalar_type> query_box(s);
+
+    struct Entry {
+        std::uint32_t node;
+        scalar_type d2;
+    };
+    std::vector<Entry> stack{{0, impl::bvh_bound2(query, query_box, nodes[0].bounds)}};
+    scalar_type best = std::numeric_limits<scalar_type>::infinity();
+    std::size_t res = 0;
+    while (!stack.empty()) {
+        const Entry entry = stack.back();
+        stack.pop_back();
+        if (entry.d2 >= best) {
+            continue;
+        }
+        const auto& node = nodes[entry.node];
+        if (!node.right) {
+            for (std::size_t i = node.begin; i < node.begin + node.count; ++i) {
+                const scalar_type d2 = query.distance2(Prepared_sector_3D<scalar_type>(polyline.segment(i)));
+                if (d2 < best) {
+                    best = d2;
+                    res = i;
+                }
+            }
+            if (std::sqrt(best) < good_enough) {
+                break;
+            }
+            continue;
+        }
+        Entry left{entry.node + 1, impl::bvh_bound2(query, query_box, nodes[entry.node + 1].bounds)};
+        Entry right{node.right, impl::bvh_bound2(query, query_box, nodes[node.right].bounds)};
+        if (left.d2 > right.d2) {
+            std::swap(left, right);
+        }
+        stack.push_back(right);
+        stack.push_back(left);
+    }
+    return {res, std::sqrt(best)};
+}
+} // namespace impl
+
+// Distance from polyline to segment, throws for empty polyline.
+template<std::floating_point scalar_type>
+scalar_type distance(const Polyline_3D<scalar_type>& polyline, const Sector_3D<scalar_type>& s)
+{
+    if (polyline.empty()) {
+        throw std::invalid_argument("empty polyline");
+    }
+    return impl::polyline_nearest(polyline, s, scalar_type(0)).distance;
+}
+
+} // namespace geom
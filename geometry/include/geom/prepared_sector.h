@@ -0,0 +1,208 @@
+#pragma once
+
+#include "sector.h"
+#include "basics.h"
+#include "bounding.h"
+#include "batch_distance.h"
+#include "fast_distance.h"
+#include "simd.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+
+namespace geom
+{
+
+// Segment with direction, squared length and its inverse computed once,
+// for queries of one segment against many ones.
+// Degenerate segment gets zero inverse length and is handled as a point.
+template<std::floating_point scalar_type>
+class Prepared_sector_3D {
+public:
+    using point = Point_3D<scalar_type>;
+    using vector = Vector_3D<scalar_type>;
+    using sector = Sector_3D<scalar_type>;
+
+    explicit Prepared_sector_3D(const sector& s) noexcept
+        : begin{ s.get_first_point() }
+        , direction{ s.get_second_point() - s.get_first_point() }
+        , direction_len2{ direction.len2() }
+        , inv_len2{ impl::inverse_or_zero(direction_len2) }
+        , sphere{ s }
+    {}
+
+    point get_begin() const noexcept { return begin; }
+    vector get_direction() const noexcept { return direction; }
+    scalar_type len2() const noexcept { return direction_len2; }
+    scalar_type get_inv_len2() const noexcept { return inv_len2; }
+    bool is_degenerate() const noexcept { return !direction_len2; }
+    const Bounding_sphere_3D<scalar_type>& get_bounding_sphere() const noexcept { return sphere; }
+
+    // Branch free kernel of batches: candidates of random segments are badly predicted.
+    scalar_type distance2(const Prepared_sector_3D& oth) const noexcept {
+        const auto c = begin - oth.begin;
+        const scalar_type c_coords[3] = {c.get_x(), c.get_y(), c.get_z()};
+        const scalar_type v[3] = {direction.get_x(), direction.get_y(), direction.get_z()};
+        const scalar_type w[3] = {oth.direction.get_x(), oth.direction.get_y(), oth.direction.get_z()};
+        scalar_type res;
+        impl::lane_param_distance2<scalar_type, scalar_type>(c_coords, v, direction_len2, inv_len2,
+                                                             w, oth.direction_len2, oth.inv_len2, res);
+        return res;
+    }
+
+    scalar_type distance(const Prepared_sector_3D& oth) const noexcept {
+        return std::sqrt(distance2(oth));
+    }
+
+    scalar_type distance(const sector& oth) const noexcept {
+        return distance(Prepared_sector_3D(oth));
+    }
+
+private:
+    point begin;
+    vector direction;
+    scalar_type direction_len2;
+    scalar_type inv_len2;
+    Bounding_sphere_3D<scalar_type> sphere;
+};
+
+namespace impl
+{
+// batch_distance_loop with the first segment fixed: its lanes are broadcast once.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void prepared_distance_loop(const Prepared_sector_3D<scalar_type>& query,
+                                              const SoA_sectors_view<scalar_type>& targets,
+                                              std::span<scalar_type> out) noexcept
+{
+    constexpr std::size_t lanes = sizeof(lane_type) / sizeof(scalar_type);
+    const lane_type zero{};
+    const auto a = query.get_begin();
+    const auto v = query.get_direction();
+    const lane_type query_begin[3] = {zero + a.get_x(), zero + a.get_y(), zero + a.get_z()};
+    const lane_type query_v[3] = {zero + v.get_x(), zero + v.get_y(), zero + v.get_z()};
+    const lane_type vv = zero + query.len2();
+    const lane_type inv_vv = zero + query.get_inv_len2();
+
+    const scalar_type* target_coords[6] = {
+        targets.ax.data(), targets.ay.data(), targets.az.data(),
+        targets.bx.data(), targets.by.data(), targets.bz.data()};
+    scalar_type* res = out.data();
+    const std::size_t n = out.size();
+
+    std::size_t i = 0;
+    if constexpr (lanes > 1) {
+        for (; i + lanes <= n; i += lanes) {
+            lane_type target_lanes[6], w[3], ww, inv_ww, d2;
+            for (int k = 0; k < 6; ++k) {
+                std::memcpy(&target_lanes[k], target_coords[k] + i, sizeof(lane_type));
+            }
+            lane_direction<lane_type, scalar_type>(target_lanes, w, ww, inv_ww);
+            const lane_type c[3] = {query_begin[0] - target_lanes[0], query_begin[1] - target_lanes[1],
+                                    query_begin[2] - target_lanes[2]};
+            lane_param_distance2<lane_type, scalar_type>(c, query_v, vv, inv_vv, w, ww, inv_ww, d2);
+            for (std::size_t k = 0; k < lanes; ++k) {
+                res[i + k] = std::sqrt(d2[k]);
+            }
+        }
+    }
+    for (; i < n; ++i) {
+        res[i] = query.distance(targets[i]);
+    }
+}
+
+template<std::floating_point scalar_type>
+void prepared_distance_sse2(const Prepared_sector_3D<scalar_type>& query,
+                            const SoA_sectors_view<scalar_type>& targets,
+                            std::span<scalar_type> out) noexcept
+{
+#ifdef GEOM_SIMD_DISPATCH
+    prepared_distance_loop<simd_vector_t<scalar_type, 16>>(query, targets, out);
+#else
+    prepared_distance_loop<scalar_type>(query, targets, out);
+#endif
+}
+
+#ifdef GEOM_SIMD_DISPATCH
+
+template<std::floating_point scalar_type>
+GEOM_TARGET("avx2,fma")
+void prepared_distance_avx2(const Prepared_sector_3D<scalar_type>& query,
+                            const SoA_sectors_view<scalar_type>& targets,
+                            std::span<scalar_type> out) noexcept
+{
+    prepared_distance_loop<simd_vector_t<scalar_type, 32>>(query, targets, out);
+}
+
+template<std::floating_point scalar_type>
+GEOM_TARGET("avx512f,avx512dq,avx2,fma")
+void prepared_distance_avx512(const Prepared_sector_3D<scalar_type>& query,
+                              const SoA_sectors_view<scalar_type>& targets,
+                              std::span<scalar_type> out) noexcept
+{
+    prepared_distance_loop<simd_vector_t<scalar_type, 64>>(query, targets, out);
+}
+#endif
+} // namespace impl
+
+// out[i] = distance(query, targets[i]).
+template<std::floating_point scalar_type>
+void batch_distance(const Prepared_sector_3D<scalar_type>& query,
+                    const SoA_sectors_view<scalar_type>& targets,
+                    std::span<scalar_type> out,
+                    simd_level level)
+{
+    if (targets.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    switch (std::min(level, supported_simd_level())) {
+    case simd_level::scalar:
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            out[i] = query.distance(targets[i]);
+        }
+        break;
+    case simd_level::sse2:
+        impl::prepared_distance_sse2(query, targets, out);
+        break;
+#ifdef GEOM_SIMD_DISPATCH
+    case simd_level::avx2:
+        impl::prepared_distance_avx2(query, targets, out);
+        break;
+    case simd_level::avx512:
+        impl::prepared_distance_avx512(query, targets, out);
+        break;
+#else
+    default:
+        impl::prepared_distance_sse2(query, targets, out);
+        break;
+#endif
+    }
+}
+
+template<std::floating_point scalar_type>
+void batch_distance(const Prepared_sector_3D<scalar_type>& query,
+                    const SoA_sectors_view<scalar_type>& targets,
+                    std::span<scalar_type> out)
+{
+    batch_distance(query, targets, out, best_simd_level());
+}
+
+// out[i] = distance(query, targets[i]) for prepared targets: no per pair setup at all.
+template<std::floating_point scalar_type>
+void batch_distance(const Prepared_sector_3D<scalar_type>& query,
+                    std::span<const Prepared_sector_3D<scalar_type>> targets,
+                    std::span<scalar_type> out)
+{
+    if (targets.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    for (std::size_t i = 0; i < out.size(); ++i) {
+        out[i] = query.distance(targets[i]);
+    }
+}
+
+} // namespace geom
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace geom::net
+{
+
+// Binary protocol of the query server, host byte order (the socket is local):
+//   request: Request_header, then 12 arrays of `count` float or double numbers, packed,
+//   in the order of binary pair files: ax, ay, az, bx, by, bz of the first segments, then of the second ones;
+//   response: Response_header, then `count` distances of the same scalar type.
+// Requests may be pipelined: a client sends more of them without waiting, the server computes them
+// in parallel and responses come in order of completion, matched to requests by id.
+// A request with a wrong header gets a response with an error status, then the connection is closed.
+enum class request_kind : std::uint8_t {
+    distance = 1, // distances of pairs
+};
+
+enum class response_status : std::uint8_t {
+    ok = 0,
+    bad_request = 1, // wrong signature, unknown kind, scalar size or too many pairs
+};
+
+struct Request_header {
+    static constexpr char signature[4] = {'S', 'E', 'G', 'Q'};
+
+    char magic[4] = {'S', 'E', 'G', 'Q'};
+    std::uint32_t id = 0;
+    std::uint32_t count = 0; // pairs
+    std::uint8_t scalar_size = 0; // 4 - float, 8 - double
+    request_kind kind = request_kind::distance;
+    std::uint8_t reserved[2] = {};
+};
+static_assert(sizeof(Request_header) == 16);
+
+struct Response_header {
+    static constexpr char signature[4] = {'S', 'E', 'G', 'R'};
+
+    char magic[4] = {'S', 'E', 'G', 'R'};
+    std::uint32_t id = 0;
+    std::uint32_t count = 0; // distances
+    std::uint8_t scalar_size = 0;
+    response_status status = response_status::ok;
+    std::uint8_t reserved[2] = {};
+};
+static_assert(sizeof(Response_header) == 16);
+
+inline constexpr std::size_t request_arrays_count = 12;
+
+// Pairs of one request the server takes by default (6 MB of double coordinates); larger batches are split
+// by the client into pipelined requests.
+inline constexpr std::uint32_t max_request_pairs = 1u << 16;
+
+inline std::size_t request_payload_size(const Request_header& header) {
+    return request_arrays_count * header.count * header.scalar_size;
+}
+
+inline std::size_t response_payload_size(const Response_header& header) {
+    return static_cast<std::size_t>(header.count) * header.scalar_size;
+}
+
+template<typename header_type>
+bool has_signature(const header_type& header) {
+    return std::memcmp(header.magic, header_type::signature, sizeof(header_type::signature)) == 0;
+}
+
+} // namespace geom::net
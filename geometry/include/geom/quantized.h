@@ -0,0 +1,434 @@
+#pragma once
+
+#include "sector.h"
+#include "batch_distance.h"
+#include "prepared_sector.h"
+#include "simd.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace geom
+{
+
+// Compact copy of segments for sweeps bound by memory bandwidth.
+// Consecutive segments are grouped by tile_size into tiles with an origin and a step per axis,
+// coordinates are stored as unsigned offsets of bits bits: 16 bits take 12 bytes per segment
+// (six arrays of uint16), 21 bits take 16 bytes (x, y, z of an end packed into one uint64),
+// against 24 or 48 bytes of float or double ends. Steps follow extents of tiles, so segments
+// should be ordered by locality first, e.g. by Sector_order.
+// Each tile keeps a conservative bound of how far decoded ends are from the source ones;
+// distances move by at most that much, which tells where an exact recheck is needed.
+template<std::floating_point scalar_type, unsigned bits = 16>
+class Quantized_sectors {
+    static_assert(bits == 16 || bits == 21, "coordinates are quantized by 16 or 21 bits");
+
+public:
+    using point = Point_3D<scalar_type>;
+    using sector = Sector_3D<scalar_type>;
+    using code_type = std::conditional_t<bits == 16, std::uint16_t, std::uint64_t>;
+
+    static constexpr std::size_t tile_size = 256;
+    static constexpr std::uint64_t max_code = (std::uint64_t(1) << bits) - 1;
+    // ax, ay, az, bx, by, bz for 16 bits; a and b with packed x, y, z for 21 bits.
+    static constexpr std::size_t code_arrays = bits == 16 ? 6 : 2;
+
+    struct Tile {
+        scalar_type origin[3] = {};
+        scalar_type step[3] = {};
+        // Distance between a decoded end and the source one is not more.
+        scalar_type error = 0;
+        // The largest absolute coordinate, for rounding slack of kernels.
+        scalar_type magnitude = 0;
+    };
+
+    Quantized_sectors() = default;
+
+    // Throws std::invalid_argument on infinite or NaN coordinates: they have no offsets.
+    explicit Quantized_sectors(const SoA_sectors_view<scalar_type>& sectors)
+        : count{ sectors.size() }
+    {
+        for (auto& codes : code_storage) {
+            codes.resize(count);
+        }
+        tile_storage.resize((count + tile_size - 1) / tile_size);
+        const std::span<const scalar_type> coords[6] = {sectors.ax, sectors.ay, sectors.az,
+                                                        sectors.bx, sectors.by, sectors.bz};
+        for (std::size_t t = 0; t < tile_storage.size(); ++t) {
+            encode_tile(coords, t);
+        }
+    }
+
+    std::size_t size() const { return count; }
+    std::size_t tiles_count() const { return tile_storage.size(); }
+    const Tile& tile(std::size_t t) const { return tile_storage[t]; }
+
+    // Bound of distance between targets[i] and the source segment, and of change of distances to it.
+    scalar_type error(std::size_t i) const { return tile_storage[i / tile_size].error; }
+
+    scalar_type max_error() const {
+        scalar_type res = 0;
+        for (const auto& t : tile_storage) {
+            res = std::max(res, t.error);
+        }
+        return res;
+    }
+
+    // Memory taken by codes and tiles.
+    std::size_t bytes() const {
+        return code_arrays * count * sizeof(code_type) + tile_storage.size() * sizeof(Tile);
+    }
+
+    // Decoded segment.
+    sector operator[](std::size_t i) const {
+        const Tile& t = tile_storage[i / tile_size];
+        return sector{decode_point(t, i, 0), decode_point(t, i, 1)};
+    }
+
+    // Codes array k, see code_arrays.
+    const code_type* codes(std::size_t k) const { return code_storage[k].data(); }
+
+    // Offset in steps of coordinate axis of end (0 - first, 1 - second) of segment i.
+    std::uint32_t code(std::size_t i, int end, int axis) const {
+        if constexpr (bits == 16) {
+            return code_storage[end * 3 + axis][i];
+        } else {
+            return static_cast<std::uint32_t>((code_storage[end][i] >> (bits * axis)) & max_code);
+        }
+    }
+
+private:
+    std::size_t count = 0;
+    std::array<std::vector<code_type>, code_arrays> code_storage;
+    std::vector<Tile> tile_storage;
+
+    // The same expression as in the kernels: origin + code * step.
+    static scalar_type decode_coord(const Tile& t, std::uint32_t c, int axis) {
+        return t.origin[axis] + static_cast<scalar_type>(static_cast<std::int32_t>(c)) * t.step[axis];
+    }
+
+    point decode_point(const Tile& t, std::size_t i, int end) const {
+        return point{decode_coord(t, code(i, end, 0), 0), decode_coord(t, code(i, end, 1), 1),
+                     decode_coord(t, code(i, end, 2), 2)};
+    }
+
+    void encode_tile(const std::span<const scalar_type> (&coords)[6], std::size_t t) {
+        const std::size_t begin = t * tile_size;
+        const std::size_t end = std::min(begin + tile_size, count);
+        Tile& tile = tile_storage[t];
+        scalar_type lo[3], hi[3];
+        for (int axis = 0; axis < 3; ++axis) {
+            lo[axis] = std::numeric_limits<scalar_type>::infinity();
+            hi[axis] = -lo[axis];
+            for (int e = 0; e < 2; ++e) {
+                for (std::size_t i = begin; i < end; ++i) {
+                    const scalar_type x = coords[e * 3 + axis][i];
+                    if (!std::isfinite(x)) {
+                        throw std::invalid_argument("quantized coordinates must be finite");
+                    }
+                    lo[axis] = std::min(lo[axis], x);
+                    hi[axis] = std::max(hi[axis], x);
+                }
+            }
+            tile.origin[axis] = lo[axis];
+            tile.step[axis] = (hi[axis] - lo[axis]) / static_cast<scalar_type>(max_code);
+            if (!std::isfinite(tile.step[axis])) {
+                throw std::invalid_argument("quantized coordinates span is too large");
+            }
+            tile.magnitude = std::max({tile.magnitude, std::abs(lo[axis]), std::abs(hi[axis])});
+        }
+
+        // Errors are measured on decoded values, plus an ulp or two for kernels decoding by fma.
+        scalar_type axis_error[3] = {};
+        for (std::size_t i = begin; i < end; ++i) {
+            code_type packed[2] = {};
+            for (int e = 0; e < 2; ++e) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    const scalar_type x = coords[e * 3 + axis][i];
+                    const std::uint32_t c = encode(tile, x, axis);
+                    axis_error[axis] = std::max(axis_error[axis], std::abs(decode_coord(tile, c, axis) - x));
+                    if constexpr (bits == 16) {
+                        code_storage[e * 3 + axis][i] = static_cast<code_type>(c);
+                    } else {
+                        packed[e] |= static_cast<code_type>(c) << (bits * axis);
+                    }
+                }
+            }
+            if constexpr (bits == 21) {
+                code_storage[0][i] = packed[0];
+                code_storage[1][i] = packed[1];
+            }
+        }
+        constexpr scalar_type ulp = std::numeric_limits<scalar_type>::epsilon();
+        scalar_type error2 = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+            const scalar_type e = axis_error[axis] + 2 * ulp * tile.magnitude;
+            error2 += e * e;
+        }
+        tile.error = std::sqrt(error2) * (1 + 4 * ulp);
+    }
+
+    // The nearest of decoded values, checked against neighbours: the division may round off by one.
+    static std::uint32_t encode(const Tile& t, scalar_type x, int axis) {
+        if (!t.step[axis]) {
+            return 0;
+        }
+        const scalar_type offset = std::round((x - t.origin[axis]) / t.step[axis]);
+        std::uint32_t res = static_cast<std::uint32_t>(std::clamp<scalar_type>(offset, 0, max_code));
+        if (res > 0 && std::abs(decode_coord(t, res - 1, axis) - x) < std::abs(decode_coord(t, res, axis) - x)) {
+            --res;
+        } else if (res < max_code && std::abs(decode_coord(t, res + 1, axis) - x) < std::abs(decode_coord(t, res, axis) - x)) {
+            ++res;
+        }
+        return res;
+    }
+};
+
+namespace impl
+{
+#ifdef GEOM_SIMD_DISPATCH
+template<typename int_type, std::size_t lanes>
+struct code_vector {
+    typedef int_type type __attribute__((vector_size(lanes * sizeof(int_type))));
+};
+
+// Coordinates of segments i .. i + lanes decoded into lanes: ax, ay, az, bx, by, bz.
+// Codes are converted through int32, which all instruction sets convert to floating point directly.
+template<typename lane_type, std::floating_point scalar_type, unsigned bits>
+GEOM_FORCE_INLINE void decode_lanes(const Quantized_sectors<scalar_type, bits>& targets, std::size_t i,
+                                    const lane_type (&origin)[3], const lane_type (&step)[3],
+                                    lane_type (&res)[6]) noexcept
+{
+    constexpr std::size_t lanes = sizeof(lane_type) / sizeof(scalar_type);
+    using int_lanes = typename code_vector<std::int32_t, lanes>::type;
+    if constexpr (bits == 16) {
+        using code_lanes = typename code_vector<std::uint16_t, lanes>::type;
+        for (int k = 0; k < 6; ++k) {
+            code_lanes c;
+            std::memcpy(&c, targets.codes(k) + i, sizeof(c));
+            const lane_type x = __builtin_convertvector(__builtin_convertvector(c, int_lanes), lane_type);
+            res[k] = origin[k % 3] + x * step[k % 3];
+        }
+    } else {
+        using code_lanes = typename code_vector<std::uint64_t, lanes>::type;
+        for (int e = 0; e < 2; ++e) {
+            code_lanes c;
+            std::memcpy(&c, targets.codes(e) + i, sizeof(c));
+            for (int axis = 0; axis < 3; ++axis) {
+                const code_lanes offset = (c >> (bits * axis)) & Quantized_sectors<scalar_type, bits>::max_code;
+                lane_type x;
+                if constexpr (sizeof(scalar_type) == 8) {
+                    // Offsets put into the mantissa of 2^52, no 64 bit conversions before AVX-512.
+                    constexpr std::uint64_t two_52 = 0x4330000000000000ull;
+                    x = (lane_type)(offset | two_52) - scalar_type(1ull << 52);
+                } else {
+                    x = __builtin_convertvector(__builtin_convertvector(offset, int_lanes), lane_type);
+                }
+                res[e * 3 + axis] = origin[axis] + x * step[axis];
+            }
+        }
+    }
+}
+#endif
+
+// prepared_distance_loop over quantized targets from segment first (a multiple of tile_size)
+// to first + out.size(); lanes do not cross tiles, their origins and steps are broadcast per tile.
+template<typename lane_type, std::floating_point scalar_type, unsigned bits>
+GEOM_FORCE_INLINE void quantized_distance_loop(const Prepared_sector_3D<scalar_type>& query,
+                                               const Quantized_sectors<scalar_type, bits>& targets,
+                                               std::size_t first,
+                                               std::span<scalar_type> out) noexcept
+{
+    constexpr std::size_t tile_size = Quantized_sectors<scalar_type, bits>::tile_size;
+    constexpr std::size_t lanes = sizeof(lane_type) / sizeof(scalar_type);
+    static_assert(tile_size % lanes == 0);
+    scalar_type* res = out.data() - first;
+    const std::size_t n = first + out.size();
+
+    for (std::size_t begin = first; begin < n; begin += tile_size) {
+        const std::size_t end = std::min(begin + tile_size, n);
+        std::size_t i = begin;
+#ifdef GEOM_SIMD_DISPATCH
+        if constexpr (lanes > 1) {
+            const lane_type zero{};
+            const auto a = query.get_begin();
+            const auto v = query.get_direction();
+            const lane_type query_begin[3] = {zero + a.get_x(), zero + a.get_y(), zero + a.get_z()};
+            const lane_type query_v[3] = {zero + v.get_x(), zero + v.get_y(), zero + v.get_z()};
+            const lane_type vv = zero + query.len2();
+            const lane_type inv_vv = zero + query.get_inv_len2();
+            const auto& tile = targets.tile(begin / tile_size);
+            const lane_type origin[3] = {zero + tile.origin[0], zero + tile.origin[1], zero + tile.origin[2]};
+            const lane_type step[3] = {zero + tile.step[0], zero + tile.step[1], zero + tile.step[2]};
+            for (; i + lanes <= end; i += lanes) {
+                lane_type target_lanes[6], w[3], ww, inv_ww, d2;
+                decode_lanes<lane_type>(targets, i, origin, step, target_lanes);
+                lane_direction<lane_type, scalar_type>(target_lanes, w, ww, inv_ww);
+                const lane_type c[3] = {query_begin[0] - target_lanes[0], query_begin[1] - target_lanes[1],
+                                        query_begin[2] - target_lanes[2]};
+                lane_param_distance2<lane_type, scalar_type>(c, query_v, vv, inv_vv, w, ww, inv_ww, d2);
+                for (std::size_t k = 0; k < lanes; ++k) {
+                    res[i + k] = std::sqrt(d2[k]);
+                }
+            }
+        }
+#endif
+        for (; i < end; ++i) {
+            res[i] = query.distance(targets[i]);
+        }
+    }
+}
+
+template<std::floating_point scalar_type, unsigned bits>
+void quantized_distance_sse2(const Prepared_sector_3D<scalar_type>& query,
+                             const Quantized_sectors<scalar_type, bits>& targets,
+                             std::size_t first,
+                             std::span<scalar_type> out) noexcept
+{
+#ifdef GEOM_SIMD_DISPATCH
+    quantized_distance_loop<simd_vector_t<scalar_type, 16>>(query, targets, first, out);
+#else
+    quantized_distance_loop<scalar_type>(query, targets, first, out);
+#endif
+}
+
+#ifdef GEOM_SIMD_DISPATCH
+
+template<std::floating_point scalar_type, unsigned bits>
+GEOM_TARGET("avx2,fma")
+void quantized_distance_avx2(const Prepared_sector_3D<scalar_type>& query,
+                             const Quantized_sectors<scalar_type, bits>& targets,
+                             std::size_t first,
+                             std::span<scalar_type> out) noexcept
+{
+    quantized_distance_loop<simd_vector_t<scalar_type, 32>>(query, targets, first, out);
+}
+
+template<std::floating_point scalar_type, unsigned bits>
+GEOM_TARGET("avx512f,avx512dq,avx2,fma")
+void quantized_distance_avx512(const Prepared_sector_3D<scalar_type>& query,
+                               const Quantized_sectors<scalar_type, bits>& targets,
+                               std::size_t first,
+                               std::span<scalar_type> out) noexcept
+{
+    quantized_distance_loop<simd_vector_t<scalar_type, 64>>(query, targets, first, out);
+}
+#endif
+
+template<std::floating_point scalar_type, unsigned bits>
+void quantized_distance(const Prepared_sector_3D<scalar_type>& query,
+                        const Quantized_sectors<scalar_type, bits>& targets,
+                        std::size_t first,
+                        std::span<scalar_type> out,
+                        simd_level level) noexcept
+{
+    switch (std::min(level, supported_simd_level())) {
+    case simd_level::scalar:
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            out[i] = query.distance(targets[first + i]);
+        }
+        break;
+    case simd_level::sse2:
+        quantized_distance_sse2(query, targets, first, out);
+        break;
+#ifdef GEOM_SIMD_DISPATCH
+    case simd_level::avx2:
+        quantized_distance_avx2(query, targets, first, out);
+        break;
+    case simd_level::avx512:
+        quantized_distance_avx512(query, targets, first, out);
+        break;
+#else
+    default:
+        quantized_distance_sse2(query, targets, first, out);
+        break;
+#endif
+    }
+}
+} // namespace impl
+
+// out[i] = distance(query, targets[i]) to decoded segments: within targets.error(i) of distances
+// to the source ones, up to rounding of the kernel.
+template<std::floating_point scalar_type, unsigned bits>
+void batch_distance(const Prepared_sector_3D<scalar_type>& query,
+                    const Quantized_sectors<scalar_type, bits>& targets,
+                    std::span<scalar_type> out,
+                    simd_level level)
+{
+    if (targets.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    impl::quantized_distance(query, targets, 0, out, level);
+}
+
+template<std::floating_point scalar_type, unsigned bits>
+void batch_distance(const Prepared_sector_3D<scalar_type>& query,
+                    const Quantized_sectors<scalar_type, bits>& targets,
+                    std::span<scalar_type> out)
+{
+    batch_distance(query, targets, out, best_simd_level());
+}
+
+// out[i] = query.distance(exact[i]) <= dist, where targets are quantized from exact: 1 - within, 0 - not.
+// Distances to decoded segments decide wherever they are farther from dist than error bounds
+// and rounding slack of both kernels; only the rest are computed from exact segments.
+// Returns the number of such rechecks.
+template<std::floating_point scalar_type, unsigned bits>
+std::size_t batch_within_distance(const Prepared_sector_3D<scalar_type>& query,
+                                  const Quantized_sectors<scalar_type, bits>& targets,
+                                  const SoA_sectors_view<scalar_type>& exact,
+                                  scalar_type dist,
+                                  std::span<std::uint8_t> out,
+                                  simd_level level)
+{
+    if (targets.size() != out.size() || exact.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    constexpr std::size_t tile_size = Quantized_sectors<scalar_type, bits>::tile_size;
+    constexpr scalar_type slack = 64 * std::numeric_limits<scalar_type>::epsilon();
+    const auto a = query.get_begin();
+    const auto b = a + query.get_direction();
+    const scalar_type query_magnitude = std::max({std::abs(a.get_x()), std::abs(a.get_y()), std::abs(a.get_z()),
+                                                  std::abs(b.get_x()), std::abs(b.get_y()), std::abs(b.get_z())});
+    scalar_type approx[tile_size];
+    std::size_t rechecks = 0;
+    for (std::size_t t = 0, begin = 0; begin < out.size(); ++t, begin += tile_size) {
+        const std::size_t n = std::min(tile_size, out.size() - begin);
+        impl::quantized_distance(query, targets, begin, std::span<scalar_type>(approx, n), level);
+        const auto& tile = targets.tile(t);
+        const scalar_type margin = tile.error + slack * (tile.magnitude + query_magnitude);
+        for (std::size_t k = 0; k < n; ++k) {
+            if (approx[k] + margin <= dist) {
+                out[begin + k] = 1;
+            } else if (approx[k] - margin > dist) {
+                out[begin + k] = 0;
+            } else {
+                out[begin + k] = query.distance(exact[begin + k]) <= dist;
+                ++rechecks;
+            }
+        }
+    }
+    return rechecks;
+}
+
+template<std::floating_point scalar_type, unsigned bits>
+std::size_t batch_within_distance(const Prepared_sector_3D<scalar_type>& query,
+                                  const Quantized_sectors<scalar_type, bits>& targets,
+                                  const SoA_sectors_view<scalar_type>& exact,
+                                  scalar_type dist,
+                                  std::span<std::uint8_t> out)
+{
+    return batch_within_distance(query, targets, exact, dist, out, best_simd_level());
+}
+
+} // namespace geom
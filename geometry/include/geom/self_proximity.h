@@ -0,0 +1,387 @@
+#pragma once
+
+#include "sector.h"
+#include "bounding.h"
+#include "executor.h"
+#include "parallel_distance.h"
+#include "prepared_sector.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+
+namespace geom
+{
+
+// Two segments of one set, first < second, and distance between them.
+template<std::floating_point scalar_type>
+struct Proximity_pair {
+    std::size_t first;
+    std::size_t second;
+    scalar_type distance;
+};
+
+struct Proximity_options {
+    // Segments are a polyline: pairs of neighbours (i, i + 1) touch by construction and are skipped.
+    bool skip_adjacent = false;
+};
+
+namespace impl
+{
+// Uniform grid broad phase over boxes of a segment set grown by half of the search radius:
+// segments whose grown boxes intersect have the per axis gap not larger than the radius.
+// Growth is rounded outwards, so rounding does not lose pairs at exactly the radius.
+// Every segment is listed in all cells its grown box covers, the lists are sorted by cell,
+// and a pair is reported only by the cell of the lower corner of the grown boxes intersection,
+// so once. Narrow phase is the exact distance by geom::fast_distance kernel of prepared segments.
+template<std::floating_point scalar_type>
+class Proximity_grid {
+public:
+    Proximity_grid(Executor& executor, const SoA_sectors_view<scalar_type>& sectors,
+                   scalar_type radius, const Proximity_options& options)
+        : options{ options }
+        , half_radius{ std::nextafter(radius, std::numeric_limits<scalar_type>::infinity()) / 2 }
+    {
+        const std::size_t n = sectors.size();
+        if (n > std::numeric_limits<std::uint32_t>::max()) {
+            throw std::length_error("too many segments for the grid");
+        }
+        boxes.resize(n);
+        grown.resize(n);
+        prepared.reserve(n);
+        for (std::size_t i = 0; i < n; ++i) {
+            prepared.emplace_back(sectors[i]);
+        }
+        box scene;
+        scalar_type extents = 0;
+        for (std::size_t i = 0; i < n; ++i) {
+            boxes[i] = box(sectors[i]);
+            grown[i] = grow(boxes[i]);
+            scene.add(grown[i]);
+            const auto extent = grown[i].get_hi() - grown[i].get_lo();
+            extents += std::max({extent.get_x(), extent.get_y(), extent.get_z()});
+        }
+        if (!n) {
+            return;
+        }
+        origin = scene.get_lo();
+
+        // Cells about as large as boxes, but not much smaller than the space per segment,
+        // so that sparse sets still share cells; not more than 2^21 cells per axis for the key.
+        const auto size = scene.get_hi() - scene.get_lo();
+        const scalar_type mean_extent = extents / static_cast<scalar_type>(n);
+        const scalar_type sx = std::max(size.get_x(), mean_extent);
+        const scalar_type sy = std::max(size.get_y(), mean_extent);
+        const scalar_type sz = std::max(size.get_z(), mean_extent);
+        cell_size = std::max({mean_extent, std::cbrt(sx * sy * sz / static_cast<scalar_type>(n)),
+                              std::max({sx, sy, sz}) / static_cast<scalar_type>(max_cells - 1),
+                              std::numeric_limits<scalar_type>::min()});
+        inv_cell_size = 1 / cell_size;
+        const auto last = cell_of(scene.get_hi());
+        dims = {last[0] + 1, last[1] + 1, last[2] + 1};
+
+        std::vector<std::size_t> offsets(n + 1, 0);
+        executor.parallel_for(n, parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const auto lo = cell_of(grown[i].get_lo());
+                const auto hi = cell_of(grown[i].get_hi());
+                offsets[i + 1] = (hi[0] - lo[0] + 1) * (hi[1] - lo[1] + 1) * (hi[2] - lo[2] + 1);
+            }
+        });
+        std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+        refs.resize(offsets[n]);
+        executor.parallel_for(n, parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+            for (std::size_t i = begin; i < end; ++i) {
+                const auto lo = cell_of(grown[i].get_lo());
+                const auto hi = cell_of(grown[i].get_hi());
+                std::size_t k = offsets[i];
+                for (std::uint64_t x = lo[0]; x <= hi[0]; ++x) {
+                    for (std::uint64_t y = lo[1]; y <= hi[1]; ++y) {
+                        for (std::uint64_t z = lo[2]; z <= hi[2]; ++z) {
+                            refs[k++] = {key_of({x, y, z}), static_cast<std::uint32_t>(i)};
+                        }
+                    }
+                }
+            }
+        });
+        sort_refs();
+        for (std::size_t i = 0; i < refs.size(); ++i) {
+            if (i && refs[i].key != refs[i - 1].key) {
+                cells.push_back(i);
+            }
+        }
+        cells.push_back(refs.size());
+    }
+
+    std::size_t cells_count() const { return cells.size() - 1; }
+
+    // Calls on_pair(first, second, d2) for pairs of cells [begin, end) not farther than the radius
+    // and sqrt(bound()).
+    template<typename bound_function, typename pair_function>
+    void visit(std::size_t begin, std::size_t end, bound_function bound, pair_function on_pair) const {
+        for (std::size_t cell = begin; cell < end; ++cell) {
+            const std::uint64_t key = refs[cells[cell]].key;
+            for (std::size_t a = cells[cell]; a < cells[cell + 1]; ++a) {
+                const std::uint32_t i = refs[a].index;
+                for (std::size_t b = a + 1; b < cells[cell + 1]; ++b) {
+                    const std::uint32_t j = refs[b].index;
+                    if (options.skip_adjacent && i + 1 == j) {
+                        continue;
+                    }
+                    const auto corner = intersection_lo(grown[i], grown[j]);
+                    if (!corner || key_of(cell_of(*corner)) != key) {
+                        continue;
+                    }
+                    // The gap of boxes is rounded, a pair at the bound is not dropped by a few ulps.
+                    const scalar_type limit2 = bound();
+                    if (distance2(boxes[i], boxes[j]) > limit2 + limit2 * gap_slack) {
+                        continue;
+                    }
+                    // Indices are sorted in cells, so the kernel gets pairs in the same order always:
+                    // it is symmetric up to rounding only.
+                    const scalar_type d2 = prepared[i].distance2(prepared[j]);
+                    if (d2 <= limit2) {
+                        on_pair(i, j, d2);
+                    }
+                }
+            }
+        }
+    }
+
+    // Closest of pairs that share a cell with the squared distance, an upper bound of the closest pair.
+    // Pairs are filtered by boxes: the bound gets small soon, and most boxes are farther.
+    std::optional<Proximity_pair<scalar_type>> shared_cell_pair(std::size_t begin, std::size_t end) const {
+        std::optional<Proximity_pair<scalar_type>> res;
+        for (std::size_t cell = begin; cell < end; ++cell) {
+            for (std::size_t a = cells[cell]; a < cells[cell + 1]; ++a) {
+                for (std::size_t b = a + 1; b < cells[cell + 1]; ++b) {
+                    const std::uint32_t i = refs[a].index;
+                    const std::uint32_t j = refs[b].index;
+                    if ((options.skip_adjacent && i + 1 == j) || (res && distance2(boxes[i], boxes[j]) >= res->distance)) {
+                        continue;
+                    }
+                    const scalar_type d2 = prepared[i].distance2(prepared[j]);
+                    if (!res || d2 < res->distance) {
+                        res = Proximity_pair<scalar_type>{i, j, d2};
+                    }
+                }
+            }
+        }
+        return res;
+    }
+
+private:
+    using box = Bounding_box_3D<scalar_type>;
+    using point = Point_3D<scalar_type>;
+    using cell = std::array<std::uint64_t, 3>;
+
+    static constexpr std::uint64_t max_cells = std::uint64_t(1) << 21;
+    static constexpr scalar_type gap_slack = 8 * std::numeric_limits<scalar_type>::epsilon();
+
+    // Segment listed in a cell.
+    struct Cell_ref {
+        std::uint64_t key;
+        std::uint32_t index;
+    };
+
+    Proximity_options options;
+    scalar_type half_radius;
+    point origin{0, 0, 0};
+    scalar_type cell_size = 1;
+    scalar_type inv_cell_size = 1;
+    cell dims{1, 1, 1}; // cells per axis
+    std::vector<box> boxes;
+    std::vector<box> grown; // by the half radius
+    std::vector<Prepared_sector_3D<scalar_type>> prepared;
+    std::vector<Cell_ref> refs;
+    std::vector<std::size_t> cells{0}; // refs of cell i are [cells[i], cells[i + 1])
+
+    std::uint64_t cell_coord(scalar_type x, scalar_type lo) const {
+        const scalar_type c = std::floor((x - lo) * inv_cell_size);
+        return c > 0 ? std::min(static_cast<std::uint64_t>(c), max_cells - 1) : 0;
+    }
+
+    cell cell_of(const point& p) const {
+        return {cell_coord(p.get_x(), origin.get_x()), cell_coord(p.get_y(), origin.get_y()),
+                cell_coord(p.get_z(), origin.get_z())};
+    }
+
+    std::uint64_t key_of(const cell& c) const {
+        return c[0] + dims[0] * (c[1] + dims[1] * c[2]);
+    }
+
+    // Stable radix sort by cell keys: refs are filled by segment index, so it stays sorted in cells.
+    void sort_refs() {
+        constexpr int digit_bits = 11;
+        constexpr std::size_t digits = std::size_t(1) << digit_bits;
+        const std::uint64_t max_key = dims[0] * dims[1] * dims[2] - 1;
+        std::vector<Cell_ref> buffer(refs.size());
+        for (int shift = 0; shift < 64 && (max_key >> shift); shift += digit_bits) {
+            std::vector<std::size_t> offsets(digits + 1, 0);
+            for (const Cell_ref& ref : refs) {
+                ++offsets[((ref.key >> shift) & (digits - 1)) + 1];
+            }
+            std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+            for (const Cell_ref& ref : refs) {
+                buffer[offsets[(ref.key >> shift) & (digits - 1)]++] = ref;
+            }
+            refs.swap(buffer);
+        }
+    }
+
+    static std::optional<point> intersection_lo(const box& l, const box& r) {
+        const point lo{std::max(l.get_lo().get_x(), r.get_lo().get_x()), std::max(l.get_lo().get_y(), r.get_lo().get_y()),
+                       std::max(l.get_lo().get_z(), r.get_lo().get_z())};
+        if (lo.get_x() > std::min(l.get_hi().get_x(), r.get_hi().get_x())
+            || lo.get_y() > std::min(l.get_hi().get_y(), r.get_hi().get_y())
+            || lo.get_z() > std::min(l.get_hi().get_z(), r.get_hi().get_z())) {
+            return std::nullopt;
+        }
+        return lo;
+    }
+
+    box grow(const box& b) const {
+        const auto down = [&](scalar_type x) {
+            return std::nextafter(x - half_radius, -std::numeric_limits<scalar_type>::infinity());
+        };
+        const auto up = [&](scalar_type x) {
+            return std::nextafter(x + half_radius, std::numeric_limits<scalar_type>::infinity());
+        };
+        return box{point{down(b.get_lo().get_x()), down(b.get_lo().get_y()), down(b.get_lo().get_z())},
+                   point{up(b.get_hi().get_x()), up(b.get_hi().get_y()), up(b.get_hi().get_z())}};
+    }
+};
+
+// Pair with smaller distance, ties go to smaller indices, so the result does not depend on threads.
+template<std::floating_point scalar_type>
+bool closer(const Proximity_pair<scalar_type>& l, const Proximity_pair<scalar_type>& r) {
+    return std::tie(l.distance, l.first, l.second) < std::tie(r.distance, r.first, r.second);
+}
+
+// Lowers the shared bound to value if it is smaller.
+template<std::floating_point scalar_type>
+void atomic_min(std::atomic<scalar_type>& bound, scalar_type value) {
+    scalar_type current = bound.load(std::memory_order_relaxed);
+    while (value < current && !bound.compare_exchange_weak(current, value, std::memory_order_relaxed)) {
+    }
+}
+} // namespace impl
+
+// Two closest segments of the set, nothing if there is no pair (with adjacent ones skipped).
+// Segments sharing grid cells give an upper bound of the distance, then the grid with
+// this radius is searched; cells go in parallel and share the best distance found so far.
+template<std::floating_point scalar_type>
+std::optional<Proximity_pair<scalar_type>> closest_pair(Executor& executor,
+                                                        const SoA_sectors_view<scalar_type>& sectors,
+                                                        const Proximity_options& options = {})
+{
+    const std::size_t n = sectors.size();
+    // The pair giving the bound is the result unless a closer one is found, so there is one always.
+    std::optional<Proximity_pair<scalar_type>> res;
+    {
+        const impl::Proximity_grid<scalar_type> grid(executor, sectors, 0, options);
+        const std::size_t cells = grid.cells_count();
+        std::vector<std::optional<Proximity_pair<scalar_type>>> pairs((cells + parallel_chunk_size - 1) / parallel_chunk_size);
+        executor.parallel_for(cells, parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+            pairs[begin / parallel_chunk_size] = grid.shared_cell_pair(begin, end);
+        });
+        for (const auto& pair : pairs) {
+            if (pair && (!res || impl::closer(*pair, *res))) {
+                res = pair;
+            }
+        }
+    }
+    // No segments share a cell: any pair bounds the distance.
+    const std::size_t step = options.skip_adjacent ? 2 : 1;
+    if (!res && n > step) {
+        res = Proximity_pair<scalar_type>{0, step, Prepared_sector_3D<scalar_type>(sectors[0]).distance2(
+                                                       Prepared_sector_3D<scalar_type>(sectors[step]))};
+    }
+    if (!res) {
+        return std::nullopt;
+    }
+
+    const impl::Proximity_grid<scalar_type> grid(executor, sectors, std::sqrt(res->distance), options);
+    std::atomic<scalar_type> bound2{res->distance};
+    const std::size_t cells = grid.cells_count();
+    std::vector<std::optional<Proximity_pair<scalar_type>>> best((cells + parallel_chunk_size - 1) / parallel_chunk_size);
+    executor.parallel_for(cells, parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        auto& found = best[begin / parallel_chunk_size];
+        grid.visit(begin, end, [&] { return bound2.load(std::memory_order_relaxed); },
+            [&](std::size_t first, std::size_t second, scalar_type d2) {
+                const Proximity_pair<scalar_type> pair{first, second, d2};
+                if (!found || impl::closer(pair, *found)) {
+                    found = pair;
+                    impl::atomic_min(bound2, d2);
+                }
+            });
+    });
+
+    for (const auto& pair : best) {
+        if (pair && impl::closer(*pair, *res)) {
+            res = pair;
+        }
+    }
+    res->distance = std::sqrt(res->distance);
+    return res;
+}
+
+template<std::floating_point scalar_type>
+std::optional<Proximity_pair<scalar_type>> closest_pair(const SoA_sectors_view<scalar_type>& sectors,
+                                                        const Proximity_options& options = {})
+{
+    Executor executor(1);
+    return closest_pair(executor, sectors, options);
+}
+
+// All pairs of the set not farther than dist, sorted by indices.
+template<std::floating_point scalar_type>
+std::vector<Proximity_pair<scalar_type>> proximity_pairs(Executor& executor,
+                                                         const SoA_sectors_view<scalar_type>& sectors,
+                                                         scalar_type dist,
+                                                         const Proximity_options& options = {})
+{
+    if (dist < 0) {
+        return {};
+    }
+    const impl::Proximity_grid<scalar_type> grid(executor, sectors, dist, options);
+    const std::size_t cells = grid.cells_count();
+    const scalar_type dist2 = dist * dist;
+    std::vector<std::vector<Proximity_pair<scalar_type>>> found((cells + parallel_chunk_size - 1) / parallel_chunk_size);
+    executor.parallel_for(cells, parallel_chunk_size, [&](std::size_t begin, std::size_t end) {
+        auto& res = found[begin / parallel_chunk_size];
+        grid.visit(begin, end, [&] { return dist2; }, [&](std::size_t first, std::size_t second, scalar_type d2) {
+            res.push_back({first, second, std::sqrt(d2)});
+        });
+    });
+
+    std::vector<Proximity_pair<scalar_type>> res;
+    for (auto& pairs : found) {
+        res.insert(res.end(), pairs.begin(), pairs.end());
+    }
+    std::sort(res.begin(), res.end(), [](const auto& l, const auto& r) {
+        return std::tie(l.first, l.second) < std::tie(r.first, r.second);
+    });
+    return res;
+}
+
+template<std::floating_point scalar_type>
+std::vector<Proximity_pair<scalar_type>> proximity_pairs(const SoA_sectors_view<scalar_type>& sectors,
+                                                         scalar_type dist,
+                                                         const Proximity_options& options = {})
+{
+    Executor executor(1);
+    return proximity_pairs(executor, sectors, dist, options);
+}
+
+} // namespace geom
@@ -0,0 +1,339 @@
+#pragma once
+
+#include "batch_distance.h"
+#include "protocol.h"
+#include "socket.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+
+namespace geom::net
+{
+
+struct Server_options {
+    // Worker threads computing requests, 0 - one per hardware thread.
+    std::size_t threads = 0;
+    // Larger requests are rejected; geom::net::Client does not send more than the protocol default.
+    std::uint32_t max_request_pairs = net::max_request_pairs;
+    // Requests read but not computed yet per worker; readers wait when the queue is full,
+    // so fast clients are slowed down by the socket instead of server memory.
+    std::size_t queue_per_thread = 16;
+    // Requests of one connection read but not answered yet; above it the reader waits, so a client
+    // that does not read responses stalls its own connection only.
+    std::size_t max_pending = 16;
+};
+
+// Query server on a Unix domain socket, see protocol.h.
+// A reader thread per connection reads requests into the queue, worker threads compute them
+// by geom::batch_distance and queue responses to the connection, its writer thread sends them;
+// workers never wait for clients. Pipelined requests of one connection are computed in parallel.
+// Runs from construction until stop() or destruction.
+class Server {
+public:
+    explicit Server(const std::string& path, const Server_options& options = {})
+        : path_{ path }
+        , options{ options }
+        , listener{ listen_unix(path) }
+    {
+        if (::pipe(wake_pipe) != 0) {
+            throw std::runtime_error("cannot create pipe");
+        }
+        std::size_t threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        max_queued = std::max<std::size_t>(options.queue_per_thread, 1) * threads;
+        for (std::size_t i = 0; i < threads; ++i) {
+            workers.emplace_back([this] { worker_loop(); });
+        }
+        acceptor = std::thread([this] { accept_loop(); });
+    }
+
+    Server(const Server&) = delete;
+    Server& operator=(const Server&) = delete;
+
+    ~Server() {
+        stop();
+        ::close(wake_pipe[0]);
+        ::close(wake_pipe[1]);
+    }
+
+    const std::string& path() const { return path_; }
+
+    // Closes the socket and all connections, waits for threads; queued requests are dropped.
+    void stop() {
+        {
+            // Set under the mutex: a thread between the check of its wait predicate and blocking
+            // would miss the notification otherwise.
+            std::lock_guard lock(mutex);
+            if (stopped.exchange(true)) {
+                return;
+            }
+        }
+        const char wake = 0;
+        [[maybe_unused]] const auto written = ::write(wake_pipe[1], &wake, 1);
+        acceptor.join();
+        for (auto& session : sessions) {
+            session.connection->socket.shutdown();
+            close_connection(*session.connection);
+        }
+        queue_changed.notify_all();
+        for (auto& session : sessions) {
+            session.reader.join();
+            session.writer.join();
+        }
+        for (auto& worker : workers) {
+            worker.join();
+        }
+        ::unlink(path_.c_str());
+    }
+
+private:
+    struct Response {
+        Response_header header;
+        std::vector<std::byte> distances;
+    };
+
+    struct Connection {
+        Socket socket;
+        std::mutex mutex;
+        std::condition_variable changed;
+        std::deque<Response> responses;
+        std::size_t pending = 0; // requests read and not answered yet
+        bool reading = true;
+        bool closed = false; // stopped or the client is gone: nothing is sent anymore
+    };
+
+    struct Session {
+        std::shared_ptr<Connection> connection;
+        std::thread reader;
+        std::thread writer;
+        std::atomic<int> running = 2;
+    };
+
+    struct Job {
+        std::shared_ptr<Connection> connection;
+        Request_header header;
+        std::vector<std::byte> payload;
+    };
+
+    static constexpr int accept_retry_ms = 100;
+
+    std::string path_;
+    Server_options options;
+    Socket listener;
+    int wake_pipe[2] = {-1, -1};
+    std::atomic<bool> stopped = false;
+    std::thread acceptor;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable queue_changed;
+    std::deque<Job> queue;
+    std::size_t max_queued = 0;
+    std::list<Session> sessions; // of the accept thread, and of stop() after it is joined
+
+    void accept_loop() {
+        pollfd fds[2] = {{listener.get(), POLLIN, 0}, {wake_pipe[0], POLLIN, 0}};
+        while (!stopped) {
+            if (::poll(fds, 2, -1) < 0 || fds[1].revents) {
+                continue;
+            }
+            Socket socket(::accept(listener.get(), nullptr, nullptr));
+            if (!socket) {
+                // Out of descriptors or memory: the connection stays pending and the listener readable,
+                // so wait for resources to be freed (or for stop) instead of spinning.
+                if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM) {
+                    pollfd wake{wake_pipe[0], POLLIN, 0};
+                    ::poll(&wake, 1, accept_retry_ms);
+                }
+                continue;
+            }
+            auto connection = std::make_shared<Connection>();
+            connection->socket = std::move(socket);
+            // Finished sessions are joined here, so a long running server does not collect them.
+            for (auto it = sessions.begin(); it != sessions.end();) {
+                if (!it->running) {
+                    it->reader.join();
+                    it->writer.join();
+                    it = sessions.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+            Session& session = sessions.emplace_back();
+            session.connection = std::move(connection);
+            session.reader = std::thread([this, &session] {
+                read_loop(session.connection);
+                --session.running;
+            });
+            session.writer = std::thread([&session] {
+                write_loop(*session.connection);
+                --session.running;
+            });
+        }
+    }
+
+    void read_loop(const std::shared_ptr<Connection>& connection) {
+        while (true) {
+            {
+                std::unique_lock lock(connection->mutex);
+                connection->changed.wait(lock, [&] {
+                    return connection->closed || connection->pending < std::max<std::size_t>(options.max_pending, 1);
+                });
+                if (connection->closed) {
+                    break;
+                }
+            }
+            Job job{connection, {}, {}};
+            if (!recv_all(connection->socket, std::as_writable_bytes(std::span(&job.header, 1)))) {
+                break;
+            }
+            if (!has_signature(job.header)
+                || job.header.kind != request_kind::distance
+                || (job.header.scalar_size != sizeof(float) && job.header.scalar_size != sizeof(double))
+                || job.header.count > options.max_request_pairs) {
+                add_pending(*connection);
+                respond(*connection, job.header, response_status::bad_request, {});
+                break;
+            }
+            if (!receive_payload(connection->socket, request_payload_size(job.header), job.payload)) {
+                break;
+            }
+            add_pending(*connection);
+            std::unique_lock lock(mutex);
+            queue_changed.wait(lock, [this] { return stopped || queue.size() < max_queued; });
+            if (stopped) {
+                break;
+            }
+            queue.push_back(std::move(job));
+            lock.unlock();
+            queue_changed.notify_all();
+        }
+        {
+            std::lock_guard lock(connection->mutex);
+            connection->reading = false;
+        }
+        connection->changed.notify_all();
+    }
+
+    // Sends queued responses until the client is gone, or it sent everything and got all answers;
+    // then the socket is shut down, which also stops the reader.
+    static void write_loop(Connection& connection) {
+        std::unique_lock lock(connection.mutex);
+        while (true) {
+            connection.changed.wait(lock, [&] {
+                return connection.closed || !connection.responses.empty()
+                    || (!connection.reading && !connection.pending);
+            });
+            if (connection.closed || connection.responses.empty()) {
+                break;
+            }
+            const Response response = std::move(connection.responses.front());
+            connection.responses.pop_front();
+            lock.unlock();
+            const std::span<const std::byte> buffers[] = {std::as_bytes(std::span(&response.header, 1)),
+                                                          response.distances};
+            const bool sent = send_all(connection.socket, buffers);
+            lock.lock();
+            --connection.pending;
+            connection.closed = connection.closed || !sent;
+            connection.changed.notify_all();
+        }
+        lock.unlock();
+        close_connection(connection);
+        connection.socket.shutdown();
+    }
+
+    static void add_pending(Connection& connection) {
+        std::lock_guard lock(connection.mutex);
+        ++connection.pending;
+    }
+
+    static void close_connection(Connection& connection) {
+        {
+            std::lock_guard lock(connection.mutex);
+            connection.closed = true;
+        }
+        connection.changed.notify_all();
+    }
+
+    // The payload grows as bytes arrive, so a header alone does not allocate the size it announces.
+    static bool receive_payload(const Socket& socket, std::size_t size, std::vector<std::byte>& payload) {
+        constexpr std::size_t chunk = std::size_t(1) << 20;
+        while (payload.size() < size) {
+            const std::size_t begin = payload.size();
+            payload.resize(std::min(size, begin + chunk));
+            if (!recv_all(socket, std::span(payload).subspan(begin))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void worker_loop() {
+        while (true) {
+            std::unique_lock lock(mutex);
+            queue_changed.wait(lock, [this] { return stopped || !queue.empty(); });
+            if (stopped) {
+                return;
+            }
+            Job job = std::move(queue.front());
+            queue.pop_front();
+            lock.unlock();
+            queue_changed.notify_all();
+
+            if (job.header.scalar_size == sizeof(float)) {
+                compute<float>(job);
+            } else {
+                compute<double>(job);
+            }
+        }
+    }
+
+    template<std::floating_point scalar_type>
+    void compute(const Job& job) {
+        const std::size_t count = job.header.count;
+        const auto* coords = reinterpret_cast<const scalar_type*>(job.payload.data());
+        const auto array = [&](std::size_t i) { return std::span<const scalar_type>(coords + i * count, count); };
+        const SoA_sectors_view<scalar_type> first{array(0), array(1), array(2), array(3), array(4), array(5)};
+        const SoA_sectors_view<scalar_type> second{array(6), array(7), array(8), array(9), array(10), array(11)};
+        // Distances are computed right into the response buffer; new storage is aligned for any scalar.
+        std::vector<std::byte> out(count * sizeof(scalar_type));
+        batch_distance(first, second, std::span<scalar_type>(reinterpret_cast<scalar_type*>(out.data()), count));
+        respond(*job.connection, job.header, response_status::ok, std::move(out));
+    }
+
+    // Queues the response for the writer of the connection; dropped if the client is gone.
+    static void respond(Connection& connection, const Request_header& request, response_status status,
+                        std::vector<std::byte> distances) {
+        Response response;
+        response.header.id = request.id;
+        response.header.count = status == response_status::ok ? request.count : 0;
+        response.header.scalar_size = request.scalar_size;
+        response.header.status = status;
+        response.distances = std::move(distances);
+        {
+            std::lock_guard lock(connection.mutex);
+            if (connection.closed) {
+                return;
+            }
+            connection.responses.push_back(std::move(response));
+        }
+        connection.changed.notify_all();
+    }
+};
+
+} // namespace geom::net
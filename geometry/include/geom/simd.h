@@ -0,0 +1,79 @@
+#pragma once
+
+#include <algorithm>
+#include <concepts>
+#include <cstddef>
+
+// Batch kernels are compiled for several instruction sets in one binary
+// by target attributes and picked at runtime.
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GEOM_SIMD_DISPATCH 1
+#define GEOM_TARGET(isa) __attribute__((target(isa)))
+#define GEOM_FORCE_INLINE inline __attribute__((always_inline))
+#define GEOM_UNROLL _Pragma("GCC unroll 5")
+#elif defined(_MSC_VER)
+#define GEOM_TARGET(isa)
+#define GEOM_FORCE_INLINE __forceinline
+#define GEOM_UNROLL
+#else
+#define GEOM_TARGET(isa)
+#define GEOM_FORCE_INLINE inline
+#define GEOM_UNROLL
+#endif
+
+namespace geom
+{
+
+// Instruction sets of batch kernels, ordered from the weakest.
+enum class simd_level {
+    scalar,
+    sse2,
+    avx2,
+    avx512,
+};
+
+// The strongest instruction set supported by CPU.
+inline simd_level supported_simd_level() {
+    static const simd_level level = [] {
+#ifdef GEOM_SIMD_DISPATCH
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq")) {
+            return simd_level::avx512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return simd_level::avx2;
+        }
+#endif
+        return simd_level::sse2;
+    }();
+    return level;
+}
+
+// Instruction set used by default.
+// AVX-512 kernel is bound by 512 bit divisions and measured slower than AVX2
+// (Sapphire Rapids), so it runs only on explicit request.
+inline simd_level best_simd_level() {
+    return std::min(supported_simd_level(), simd_level::avx2);
+}
+
+namespace impl
+{
+#ifdef GEOM_SIMD_DISPATCH
+// GCC vector extension types: one register of SSE2, AVX2 or AVX-512.
+template<std::floating_point scalar_type, std::size_t bytes>
+struct simd_vector {};
+
+template<> struct simd_vector<float, 16> { typedef float type __attribute__((vector_size(16))); };
+template<> struct simd_vector<float, 32> { typedef float type __attribute__((vector_size(32))); };
+template<> struct simd_vector<float, 64> { typedef float type __attribute__((vector_size(64))); };
+template<> struct simd_vector<double, 16> { typedef double type __attribute__((vector_size(16))); };
+template<> struct simd_vector<double, 32> { typedef double type __attribute__((vector_size(32))); };
+template<> struct simd_vector<double, 64> { typedef double type __attribute__((vector_size(64))); };
+
+template<std::floating_point scalar_type, std::size_t bytes>
+using simd_vector_t = typename simd_vector<scalar_type, bytes>::type;
+#endif
+
+} // namespace impl
+
+} // namespace geom
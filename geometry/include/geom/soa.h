@@ -0,0 +1,162 @@
+#pragma once
+
+#include "sector.h"
+
+#include <cstddef>
+#include <span>
+#include <vector>
+
+namespace geom
+{
+
+// Structure of arrays view over segments:
+// i-th segment is (ax[i], ay[i], az[i]) - (bx[i], by[i], bz[i]).
+template<std::floating_point scalar_type>
+struct SoA_sectors_view {
+    using sector = Sector_3D<scalar_type>;
+
+    std::span<const scalar_type> ax, ay, az;
+    std::span<const scalar_type> bx, by, bz;
+
+    std::size_t size() const { return ax.size(); }
+
+    sector operator[](std::size_t i) const {
+        return sector{{ax[i], ay[i], az[i]}, {bx[i], by[i], bz[i]}};
+    }
+
+    SoA_sectors_view subview(std::size_t offset, std::size_t count) const {
+        return {ax.subspan(offset, count), ay.subspan(offset, count), az.subspan(offset, count),
+                bx.subspan(offset, count), by.subspan(offset, count), bz.subspan(offset, count)};
+    }
+};
+
+// Owning structure of arrays storage for segments.
+template<std::floating_point scalar_type>
+class SoA_sectors {
+public:
+    using sector = Sector_3D<scalar_type>;
+    using view = SoA_sectors_view<scalar_type>;
+
+    SoA_sectors() = default;
+    explicit SoA_sectors(std::span<const sector> sectors) {
+        reserve(sectors.size());
+        for (const auto& s : sectors) {
+            push_back(s);
+        }
+    }
+
+    void reserve(std::size_t n) {
+        for (auto* coords : {&ax, &ay, &az, &bx, &by, &bz}) {
+            coords->reserve(n);
+        }
+    }
+
+    void push_back(const sector& s) {
+        const auto a = s.get_first_point();
+        const auto b = s.get_second_point();
+        ax.push_back(a.get_x());
+        ay.push_back(a.get_y());
+        az.push_back(a.get_z());
+        bx.push_back(b.get_x());
+        by.push_back(b.get_y());
+        bz.push_back(b.get_z());
+    }
+
+    void resize(std::size_t n) {
+        for (auto* coords : {&ax, &ay, &az, &bx, &by, &bz}) {
+            coords->resize(n);
+        }
+    }
+
+    void set(std::size_t i, const sector& s) {
+        const auto a = s.get_first_point();
+        const auto b = s.get_second_point();
+        ax[i] = a.get_x();
+        ay[i] = a.get_y();
+        az[i] = a.get_z();
+        bx[i] = b.get_x();
+        by[i] = b.get_y();
+        bz[i] = b.get_z();
+    }
+
+    void clear() {
+        for (auto* coords : {&ax, &ay, &az, &bx, &by, &bz}) {
+            coords->clear();
+        }
+    }
+
+    std::size_t size() const { return ax.size(); }
+    sector operator[](std::size_t i) const { return get_view()[i]; }
+
+    view get_view() const {
+        return {ax, ay, az, bx, by, bz};
+    }
+
+private:
+    std::vector<scalar_type> ax, ay, az;
+    std::vector<scalar_type> bx, by, bz;
+};
+
+// Structure of arrays view over points: i-th point is (x[i], y[i], z[i]).
+template<std::floating_point scalar_type>
+struct SoA_points_view {
+    using point = Point_3D<scalar_type>;
+
+    std::span<const scalar_type> x, y, z;
+
+    std::size_t size() const { return x.size(); }
+
+    point operator[](std::size_t i) const {
+        return point{x[i], y[i], z[i]};
+    }
+
+    SoA_points_view subview(std::size_t offset, std::size_t count) const {
+        return {x.subspan(offset, count), y.subspan(offset, count), z.subspan(offset, count)};
+    }
+};
+
+// Owning structure of arrays storage for points.
+template<std::floating_point scalar_type>
+class SoA_points {
+public:
+    using point = Point_3D<scalar_type>;
+    using view = SoA_points_view<scalar_type>;
+
+    SoA_points() = default;
+    explicit SoA_points(std::span<const point> points) {
+        reserve(points.size());
+        for (const auto& p : points) {
+            push_back(p);
+        }
+    }
+
+    void reserve(std::size_t n) {
+        for (auto* coords : {&x, &y, &z}) {
+            coords->reserve(n);
+        }
+    }
+
+    void push_back(const point& p) {
+        x.push_back(p.get_x());
+        y.push_back(p.get_y());
+        z.push_back(p.get_z());
+    }
+
+    void clear() {
+        for (auto* coords : {&x, &y, &z}) {
+            coords->clear();
+        }
+    }
+
+    std::size_t size() const { return x.size(); }
+    point operator[](std::size_t i) const { return get_view()[i]; }
+
+    view get_view() const {
+        return {x, y, z};
+    }
+
+private:
+    std::vector<scalar_type> x, y, z;
+};
+
+} // namespace geom
@@ -0,0 +1,193 @@
+#pragma once
+
+#ifdef _WIN32
+#error "geom/socket.h: Unix domain sockets are POSIX only"
+#endif
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace geom::net
+{
+
+// Owned socket descriptor.
+class Socket {
+public:
+    Socket() = default;
+    explicit Socket(int fd) : fd{ fd } {}
+
+    Socket(Socket&& oth) noexcept : fd{ std::exchange(oth.fd, -1) } {}
+
+    Socket& operator=(Socket&& oth) noexcept {
+        Socket tmp(std::move(oth));
+        std::swap(fd, tmp.fd);
+        return *this;
+    }
+
+    Socket(const Socket&) = delete;
+    Socket& operator=(const Socket&) = delete;
+
+    ~Socket() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    int get() const { return fd; }
+    explicit operator bool() const { return fd >= 0; }
+
+    // Wakes up threads blocked on the socket: their reads return end of stream.
+    void shutdown() const {
+        if (fd >= 0) {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+    }
+
+private:
+    int fd = -1;
+};
+
+namespace impl
+{
+inline sockaddr_un unix_address(const std::string& path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+        throw std::invalid_argument("bad socket path: " + path);
+    }
+    std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+    return address;
+}
+
+inline Socket unix_socket() {
+    Socket res(::socket(AF_UNIX, SOCK_STREAM, 0));
+    if (!res) {
+        throw std::runtime_error(std::string("cannot create socket: ") + std::strerror(errno));
+    }
+#if defined(SO_NOSIGPIPE)
+    // No MSG_NOSIGNAL there: writes to closed connections must not raise SIGPIPE.
+    int on = 1;
+    ::setsockopt(res.get(), SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#endif
+    return res;
+}
+
+// Removes a socket file at the path left by a server that is gone; throws if the path is taken
+// by another file or by a running server.
+inline void remove_stale_socket(const std::string& path, const sockaddr_un& address) {
+    struct stat status;
+    if (::lstat(path.c_str(), &status) != 0) {
+        if (errno == ENOENT) {
+            return;
+        }
+        throw std::runtime_error("cannot check " + path + ": " + std::strerror(errno));
+    }
+    if (!S_ISSOCK(status.st_mode)) {
+        throw std::runtime_error("cannot listen on " + path + ": not a socket");
+    }
+    const Socket probe = unix_socket();
+    if (::connect(probe.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0) {
+        throw std::runtime_error("cannot listen on " + path + ": a server is running there");
+    }
+    if (errno != ECONNREFUSED) {
+        throw std::runtime_error("cannot listen on " + path + ": " + std::strerror(errno));
+    }
+    ::unlink(path.c_str());
+}
+
+#if defined(MSG_NOSIGNAL)
+inline constexpr int send_flags = MSG_NOSIGNAL;
+#else
+inline constexpr int send_flags = 0;
+#endif
+} // namespace impl
+
+// Socket bound to the path and listening. A stale socket file at the path - nobody accepts
+// connections on it - is replaced; other files and sockets of running servers are left, it throws.
+inline Socket listen_unix(const std::string& path, int backlog = 64) {
+    const sockaddr_un address = impl::unix_address(path);
+    Socket res = impl::unix_socket();
+    impl::remove_stale_socket(path, address);
+    if (::bind(res.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || ::listen(res.get(), backlog) != 0) {
+        throw std::runtime_error("cannot listen on " + path + ": " + std::strerror(errno));
+    }
+    return res;
+}
+
+inline Socket connect_unix(const std::string& path) {
+    const sockaddr_un address = impl::unix_address(path);
+    Socket res = impl::unix_socket();
+    if (::connect(res.get(), reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        throw std::runtime_error("cannot connect to " + path + ": " + std::strerror(errno));
+    }
+    return res;
+}
+
+// Writes all buffers by as few calls as the socket takes; false if the connection is closed.
+inline bool send_all(const Socket& socket, std::span<const std::span<const std::byte>> buffers) {
+    constexpr std::size_t max_buffers = 16;
+    iovec vectors[max_buffers];
+    std::size_t count = 0;
+    for (const auto& buffer : buffers) {
+        if (!buffer.empty()) {
+            if (count == max_buffers) {
+                throw std::invalid_argument("too many buffers to send");
+            }
+            vectors[count++] = {const_cast<std::byte*>(buffer.data()), buffer.size()};
+        }
+    }
+    iovec* next = vectors;
+    while (count) {
+        msghdr message{};
+        message.msg_iov = next;
+        message.msg_iovlen = count;
+        const ssize_t sent = ::sendmsg(socket.get(), &message, impl::send_flags);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        // Skips written buffers, the partly written one is advanced.
+        std::size_t left = static_cast<std::size_t>(sent);
+        while (count && left >= next->iov_len) {
+            left -= next->iov_len;
+            ++next;
+            --count;
+        }
+        if (count) {
+            next->iov_base = static_cast<std::byte*>(next->iov_base) + left;
+            next->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+// Reads exactly buffer.size() bytes; false if the connection is closed before.
+inline bool recv_all(const Socket& socket, std::span<std::byte> buffer) {
+    while (!buffer.empty()) {
+        const ssize_t received = ::recv(socket.get(), buffer.data(), buffer.size(), 0);
+        if (received < 0 && errno == EINTR) {
+            continue;
+        }
+        if (received <= 0) {
+            return false;
+        }
+        buffer = buffer.subspan(static_cast<std::size_t>(received));
+    }
+    return true;
+}
+
+} // namespace geom::net
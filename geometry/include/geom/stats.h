@@ -0,0 +1,282 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Instrumentation of distance kernels: counters of their paths per thread.
+// Compiled in with GEOM_STATS defined (cmake -DSEGMENT_DISTANSE_STATS=ON), without it
+// recording functions are empty and kernels have no extra work.
+namespace geom::stats
+{
+
+#ifdef GEOM_STATS
+inline constexpr bool enabled = true;
+#else
+inline constexpr bool enabled = false;
+#endif
+
+// Paths of geom::distance and the scalar kernels of geom::fast_distance and geom::closest_points.
+// Each call counts one of skew, parallel and degenerate; enumeration calls also count one of
+// ends, projection and crossing - the candidates of the closest pair, crossing first.
+enum class path : std::size_t {
+    skew,       // lines are not parallel, the closest points of lines are candidates
+    parallel,   // parallel lines
+    degenerate, // one of segments is too short for a line
+    ends,       // the closest pair is ends of segments
+    projection, // the closest pair has a projection of an end of the other segment
+    crossing,   // the closest pair has a closest point of lines
+};
+
+inline constexpr path all_paths[] = {
+    path::skew, path::parallel, path::degenerate, path::ends, path::projection, path::crossing,
+};
+
+inline constexpr std::size_t paths_count = std::size(all_paths);
+
+// Enumeration compares up to 5 x 5 pairs of candidate points.
+inline constexpr std::size_t max_candidate_pairs = 25;
+
+inline std::string_view to_string(path p) {
+    switch (p) {
+    case path::skew: return "skew";
+    case path::parallel: return "parallel";
+    case path::degenerate: return "degenerate";
+    case path::ends: return "ends";
+    case path::projection: return "projection";
+    case path::crossing: return "crossing";
+    }
+    return "unknown";
+}
+
+struct Counters {
+    std::array<std::uint64_t, paths_count> paths{};
+    // candidate_pairs[k] - enumeration calls which compared k pairs of candidate points.
+    std::array<std::uint64_t, max_candidate_pairs + 1> candidate_pairs{};
+
+    std::uint64_t operator[](path p) const noexcept { return paths[static_cast<std::size_t>(p)]; }
+
+    Counters& operator+=(const Counters& oth) noexcept {
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            paths[i] += oth.paths[i];
+        }
+        for (std::size_t i = 0; i < candidate_pairs.size(); ++i) {
+            candidate_pairs[i] += oth.candidate_pairs[i];
+        }
+        return *this;
+    }
+};
+
+namespace impl
+{
+// Counters of one thread. Only the thread writes them, so increments are a load and a store;
+// atomics let snapshots read them from other threads.
+struct Thread_counters {
+    std::array<std::atomic<std::uint64_t>, paths_count> paths{};
+    std::array<std::atomic<std::uint64_t>, max_candidate_pairs + 1> candidate_pairs{};
+
+    Thread_counters();
+    ~Thread_counters();
+
+    Counters load() const noexcept {
+        Counters res;
+        for (std::size_t i = 0; i < paths.size(); ++i) {
+            res.paths[i] = paths[i].load(std::memory_order_relaxed);
+        }
+        for (std::size_t i = 0; i < candidate_pairs.size(); ++i) {
+            res.candidate_pairs[i] = candidate_pairs[i].load(std::memory_order_relaxed);
+        }
+        return res;
+    }
+};
+
+// Counters of live threads and the sum of finished ones.
+struct Registry {
+    std::mutex mutex;
+    std::vector<Thread_counters*> threads;
+    Counters finished;
+};
+
+inline Registry& registry() {
+    static Registry res;
+    return res;
+}
+
+inline Thread_counters::Thread_counters() {
+    Registry& r = registry();
+    std::lock_guard lock(r.mutex);
+    r.threads.push_back(this);
+}
+
+inline Thread_counters::~Thread_counters() {
+    Registry& r = registry();
+    std::lock_guard lock(r.mutex);
+    r.finished += load();
+    std::erase(r.threads, this);
+}
+
+inline Thread_counters& thread_counters() {
+    thread_local Thread_counters res;
+    return res;
+}
+
+inline void increment(std::atomic<std::uint64_t>& counter) noexcept {
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+} // namespace impl
+
+// Recording functions, callable from constexpr kernels: constant evaluation records nothing.
+constexpr void record(path p) noexcept {
+    if constexpr (enabled) {
+        if (!std::is_constant_evaluated()) {
+            impl::increment(impl::thread_counters().paths[static_cast<std::size_t>(p)]);
+        }
+    }
+}
+
+constexpr void record_candidate_pairs(std::size_t count) noexcept {
+    if constexpr (enabled) {
+        if (!std::is_constant_evaluated()) {
+            impl::increment(impl::thread_counters().candidate_pairs[std::min(count, max_candidate_pairs)]);
+        }
+    }
+}
+
+// Records the path of the closest pair of enumeration: candidates of a segment are its 2 ends,
+// then closest points of lines up to crossing_end, then projections; first and second are
+// the indices of the closest pair.
+constexpr void record_closest(std::size_t first, std::size_t first_crossing_end,
+                              std::size_t second, std::size_t second_crossing_end) noexcept {
+    if constexpr (enabled) {
+        if (first >= 2 && first < first_crossing_end) {
+            record(path::crossing);
+        } else if (second >= 2 && second < second_crossing_end) {
+            record(path::crossing);
+        } else if (first >= 2 || second >= 2) {
+            record(path::projection);
+        } else {
+            record(path::ends);
+        }
+    }
+}
+
+// Sum of counters of all threads, live and finished ones.
+inline Counters snapshot() {
+    impl::Registry& r = impl::registry();
+    std::lock_guard lock(r.mutex);
+    Counters res = r.finished;
+    for (const auto* thread : r.threads) {
+        res += thread->load();
+    }
+    return res;
+}
+
+// Zeroes all counters; kernels should not run meanwhile, or their increments may be lost or kept.
+inline void reset() {
+    impl::Registry& r = impl::registry();
+    std::lock_guard lock(r.mutex);
+    r.finished = {};
+    for (auto* thread : r.threads) {
+        for (auto& c : thread->paths) {
+            c.store(0, std::memory_order_relaxed);
+        }
+        for (auto& c : thread->candidate_pairs) {
+            c.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+
+// Histogram of durations by powers of two: bucket k counts durations in [2^(k-1), 2^k) ns,
+// bucket 0 - shorter than 1 ns. Not synchronized, one per thread or per measuring loop.
+class Latency_histogram {
+public:
+    static constexpr std::size_t buckets_count = 64;
+
+    void add(std::chrono::nanoseconds duration) noexcept {
+        const std::uint64_t ns = duration.count() > 0 ? static_cast<std::uint64_t>(duration.count()) : 0;
+        ++counts[std::min<std::size_t>(std::bit_width(ns), buckets_count - 1)];
+        if (!total || ns < min_ns) {
+            min_ns = ns;
+        }
+        max_ns = std::max(max_ns, ns);
+        sum_ns += ns;
+        ++total;
+    }
+
+    std::uint64_t count() const noexcept { return total; }
+    std::uint64_t sum() const noexcept { return sum_ns; }
+    std::uint64_t min() const noexcept { return min_ns; }
+    std::uint64_t max() const noexcept { return max_ns; }
+    const std::array<std::uint64_t, buckets_count>& buckets() const noexcept { return counts; }
+
+    // Upper bound of bucket k in ns.
+    static std::uint64_t bucket_bound(std::size_t k) noexcept { return std::uint64_t(1) << k; }
+
+    // Upper bound of the bucket of the q-quantile (0 <= q <= 1), capped by the maximum; 0 if empty.
+    std::uint64_t quantile(double q) const noexcept {
+        const double rank = q * static_cast<double>(total);
+        std::uint64_t seen = 0;
+        for (std::size_t k = 0; k < buckets_count; ++k) {
+            seen += counts[k];
+            if (seen && static_cast<double>(seen) >= rank) {
+                return std::min(bucket_bound(k), max_ns);
+            }
+        }
+        return max_ns;
+    }
+
+private:
+    std::array<std::uint64_t, buckets_count> counts{};
+    std::uint64_t total = 0;
+    std::uint64_t sum_ns = 0;
+    std::uint64_t min_ns = 0;
+    std::uint64_t max_ns = 0;
+};
+
+// JSON objects of the machine readable dump.
+// {"count":..,"min_ns":..,"max_ns":..,"mean_ns":..,"p50_ns":..,"p90_ns":..,"p99_ns":..,
+//  "buckets":[{"below_ns":..,"count":..},..]} - non-empty buckets only.
+inline std::string to_json(const Latency_histogram& histogram) {
+    const auto field = [](std::string_view name, std::uint64_t value) {
+        return "\"" + std::string(name) + "\":" + std::to_string(value);
+    };
+    std::string res = "{" + field("count", histogram.count()) + "," + field("min_ns", histogram.min())
+        + "," + field("max_ns", histogram.max())
+        + "," + field("mean_ns", histogram.count() ? histogram.sum() / histogram.count() : 0)
+        + "," + field("p50_ns", histogram.quantile(.5)) + "," + field("p90_ns", histogram.quantile(.9))
+        + "," + field("p99_ns", histogram.quantile(.99)) + ",\"buckets\":[";
+    bool first = true;
+    for (std::size_t k = 0; k < Latency_histogram::buckets_count; ++k) {
+        if (histogram.buckets()[k]) {
+            res += std::string(first ? "" : ",") + "{" + field("below_ns", Latency_histogram::bucket_bound(k))
+                + "," + field("count", histogram.buckets()[k]) + "}";
+            first = false;
+        }
+    }
+    return res + "]}";
+}
+
+// {"skew":..,"parallel":..,..,"candidate_pairs":[..]}, candidate_pairs[k] as in Counters.
+inline std::string to_json(const Counters& counters) {
+    std::string res = "{";
+    for (path p : all_paths) {
+        res += "\"" + std::string(to_string(p)) + "\":" + std::to_string(counters[p]) + ",";
+    }
+    res += "\"candidate_pairs\":[";
+    for (std::size_t k = 0; k < counters.candidate_pairs.size(); ++k) {
+        res += (k ? "," : "") + std::to_string(counters.candidate_pairs[k]);
+    }
+    return res + "]}";
+}
+
+} // namespace geom::stats
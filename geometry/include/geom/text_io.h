@@ -0,0 +1,200 @@
+#pragma once
+
+#include "soa.h"
+
+#include <charconv>
+#include <concepts>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <vector>
+
+namespace geom::io
+{
+
+// Reads segment pairs from text, one pair per line: 12 numbers - begin and end
+// of the first segment, begin and end of the second one.
+// Numbers are separated by spaces, tabs or commas, blank lines are skipped.
+// File is read by big chunks and parsed with std::from_chars.
+template<std::floating_point scalar_type>
+class Text_pairs_reader {
+public:
+    explicit Text_pairs_reader(std::FILE* file, std::size_t buffer_size = 1 << 20)
+        : file{ file }
+        , buffer(buffer_size)
+        , pos{ buffer.data() }
+        , end{ buffer.data() }
+    {}
+
+    // Replaces content of first and second with at most max_pairs next pairs.
+    // Returns count of read pairs, 0 - end of input.
+    std::size_t read(SoA_sectors<scalar_type>& first, SoA_sectors<scalar_type>& second, std::size_t max_pairs) {
+        first.clear();
+        second.clear();
+        while (first.size() < max_pairs) {
+            const char* line_end = pos == end ? nullptr
+                : static_cast<const char*>(std::memchr(pos, '\n', end - pos));
+            if (!line_end) {
+                if (!fill()) {
+                    if (pos == end) {
+                        break;
+                    }
+                    line_end = end;
+                } else {
+                    continue;
+                }
+            }
+            ++line_number;
+            parse_line(pos, line_end, first, second);
+            pos = line_end == end ? end : line_end + 1;
+        }
+        return first.size();
+    }
+
+    // Number of the last read line, for error messages.
+    std::size_t line() const { return line_number; }
+
+private:
+    static constexpr std::size_t numbers_count = 12;
+
+    std::FILE* file;
+    std::vector<char> buffer;
+    const char* pos;
+    const char* end;
+    bool eof = false;
+    std::size_t line_number = 0;
+
+    // Moves the incomplete line to the buffer begin and reads the next chunk after it.
+    bool fill() {
+        if (eof) {
+            return false;
+        }
+        std::size_t offset = pos - buffer.data();
+        std::size_t tail = end - pos;
+        if (tail == buffer.size()) {
+            buffer.resize(buffer.size() * 2);
+        }
+        if (tail) {
+            std::memmove(buffer.data(), buffer.data() + offset, tail);
+        }
+        std::size_t count = std::fread(buffer.data() + tail, 1, buffer.size() - tail, file);
+        if (count < buffer.size() - tail) {
+            if (std::ferror(file)) {
+                throw std::runtime_error("cannot read input");
+            }
+            eof = true;
+        }
+        pos = buffer.data();
+        end = buffer.data() + tail + count;
+        return count != 0;
+    }
+
+    static bool is_separator(char c) {
+        return c == ' ' || c == '\t' || c == ',' || c == '\r';
+    }
+
+    void parse_line(const char* first_char, const char* last_char,
+                    SoA_sectors<scalar_type>& first, SoA_sectors<scalar_type>& second) const {
+        scalar_type numbers[numbers_count];
+        std::size_t count = 0;
+        for (const char* p = first_char;;) {
+            while (p != last_char && is_separator(*p)) {
+                ++p;
+            }
+            if (p == last_char) {
+                break;
+            }
+            if (count == numbers_count) {
+                error("too many numbers");
+            }
+            if (*p == '+') {
+                ++p;
+            }
+            auto [next, ec] = std::from_chars(p, last_char, numbers[count]);
+            if (ec != std::errc{} || (next != last_char && !is_separator(*next))) {
+                error("cannot parse number");
+            }
+            ++count;
+            p = next;
+        }
+        if (count == 0) {
+            return;
+        }
+        if (count != numbers_count) {
+            error("expected 12 numbers");
+        }
+        first.push_back({{numbers[0], numbers[1], numbers[2]}, {numbers[3], numbers[4], numbers[5]}});
+        second.push_back({{numbers[6], numbers[7], numbers[8]}, {numbers[9], numbers[10], numbers[11]}});
+    }
+
+    [[noreturn]] void error(const char* what) const {
+        throw std::runtime_error("line " + std::to_string(line_number) + ": " + what);
+    }
+};
+
+// Writes numbers in fixed format, one per line, through a buffer with std::to_chars.
+class Text_writer {
+public:
+    explicit Text_writer(std::FILE* file, int digits, std::size_t buffer_size = 1 << 20)
+        : file{ file }
+        , digits{ checked_digits(digits) }
+        , buffer(buffer_size + max_number_size + digits)
+        , pos{ buffer.data() }
+        , flush_limit{ buffer.data() + buffer_size }
+    {}
+
+    Text_writer(const Text_writer&) = delete;
+    Text_writer& operator=(const Text_writer&) = delete;
+
+    ~Text_writer() {
+        try {
+            flush();
+        } catch (...) {
+        }
+    }
+
+    template<std::floating_point scalar_type>
+    void write(scalar_type value) {
+        auto [next, ec] = std::to_chars(pos, buffer.data() + buffer.size() - 1, value,
+                                        std::chars_format::fixed, digits);
+        if (ec != std::errc{}) {
+            throw std::runtime_error("cannot format number");
+        }
+        *next = '\n';
+        pos = next + 1;
+        if (pos >= flush_limit) {
+            flush();
+        }
+    }
+
+    void flush() {
+        std::size_t size = pos - buffer.data();
+        if (size && std::fwrite(buffer.data(), 1, size, file) != size) {
+            throw std::runtime_error("cannot write output");
+        }
+        pos = buffer.data();
+        std::fflush(file);
+    }
+
+private:
+    // Fixed format of the largest double with sign and point.
+    static constexpr std::size_t max_number_size = 512;
+
+    static int checked_digits(int digits) {
+        if (digits < 0) {
+            throw std::invalid_argument("digits must be non-negative");
+        }
+        return digits;
+    }
+
+    std::FILE* file;
+    int digits;
+    std::vector<char> buffer;
+    char* pos;
+    char* flush_limit;
+};
+
+} // namespace geom::io
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "point.h"
+#include "constexpr_math.h"
 
 #include <algorithm>
 #include <cmath>
@@ -13,66 +14,74 @@ template<std::floating_point scalar_type>
 class Vector_3D;
 
 template<std::floating_point scalar_type>
-Vector_3D<scalar_type> cross_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b);
+constexpr Vector_3D<scalar_type> cross_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) noexcept;
 
 template<std::floating_point scalar_type>
-scalar_type dot_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b);
+constexpr scalar_type dot_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) noexcept;
 
 template<std::floating_point scalar_type>
 class Vector_3D {
 
 public:
-    Vector_3D(scalar_type x, scalar_type y, scalar_type z)
+    constexpr Vector_3D(scalar_type x, scalar_type y, scalar_type z) noexcept
         : x(x)
         , y(y)
         , z(z)
     {}
 
-    static Vector_3D zero() {
+    static constexpr Vector_3D zero() noexcept {
         return Vector_3D{ 0., 0., 0. };
     }
    
-    const scalar_type& get_x() const { return x; }
-    const scalar_type& get_y() const { return y; }
-    const scalar_type& get_z() const { return z; }
+    constexpr const scalar_type& get_x() const noexcept { return x; }
+    constexpr const scalar_type& get_y() const noexcept { return y; }
+    constexpr const scalar_type& get_z() const noexcept { return z; }
 
-    const scalar_type len2() const {
+    constexpr scalar_type len2() const noexcept {
         return x * x + y * y + z * z;
     }
 
-    const scalar_type len() const {
-        return std::sqrt(len2());
+    constexpr scalar_type len() const noexcept {
+        return geom::sqrt(len2());
     }
 
-    Vector_3D operator* (scalar_type k) const {
+    constexpr Vector_3D operator* (scalar_type k) const noexcept {
         return {x * k, y * k, z * k};
     }
 
-    Vector_3D operator* (const Vector_3D& oth) const {
+    constexpr Vector_3D operator* (const Vector_3D& oth) const noexcept {
         return cross_product(*this, oth);
     }
 
-    Vector_3D normalized() const {
-        scalar_type invert_len = 1. / len();
+    constexpr Vector_3D operator+ (const Vector_3D& oth) const noexcept {
+        return {x + oth.x, y + oth.y, z + oth.z};
+    }
+
+    constexpr Vector_3D operator- (const Vector_3D& oth) const noexcept {
+        return {x - oth.x, y - oth.y, z - oth.z};
+    }
+
+    constexpr Vector_3D normalized() const noexcept {
+        scalar_type invert_len = 1 / len();
         return *this * invert_len;
     }
 
 private:
     scalar_type x, y, z;
 
-    friend Vector_3D<scalar_type> cross_product<>(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b);
-    friend scalar_type dot_product<>(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b);
+    friend constexpr Vector_3D<scalar_type> cross_product<>(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) noexcept;
+    friend constexpr scalar_type dot_product<>(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) noexcept;
 }; 
 
 template<std::floating_point scalar_type>
-Vector_3D<scalar_type> operator* (scalar_type k, const Vector_3D<scalar_type>& vec) {
+constexpr Vector_3D<scalar_type> operator* (scalar_type k, const Vector_3D<scalar_type>& vec) noexcept {
     return vec * k;
 }
 
 template<std::floating_point scalar_type>
-bool vector_eq(const Vector_3D<scalar_type>& l, const Vector_3D<scalar_type>& r, scalar_type eps) {
+constexpr bool vector_eq(const Vector_3D<scalar_type>& l, const Vector_3D<scalar_type>& r, scalar_type eps) noexcept {
     auto eq = [eps](auto l, auto r) {
-        return std::abs(l - r) < eps;
+        return geom::abs(l - r) < eps;
     };
     return eq(l.get_x(), r.get_x()) && 
            eq(l.get_y(), r.get_y()) &&
@@ -80,16 +89,16 @@ bool vector_eq(const Vector_3D<scalar_type>& l, const Vector_3D<scalar_type>& r,
 }
 
 template<std::floating_point scalar_type>
-Vector_3D<scalar_type> cross_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) {
+constexpr Vector_3D<scalar_type> cross_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) noexcept {
     return Vector_3D<scalar_type>{ 
         a.y * b.z - a.z * b.y,
-        a.x * b.z - a.z * b.x,
+        a.z * b.x - a.x * b.z,
         a.x * b.y - a.y * b.x  
     };
 }
 
 template<std::floating_point scalar_type>
-scalar_type dot_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) {
+constexpr scalar_type dot_product(const Vector_3D<scalar_type>& a, const Vector_3D<scalar_type>& b) noexcept {
     return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
@@ -0,0 +1,222 @@
+#pragma once
+
+#include "sector.h"
+#include "basics.h"
+#include "batch_distance.h"
+#include "bounding.h"
+#include "fast_distance.h"
+#include "prepared_sector.h"
+#include "simd.h"
+#include "soa.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <stdexcept>
+
+namespace geom
+{
+
+// Squared distance between segments, geom::fast_distance without the final sqrt.
+template<std::floating_point scalar_type>
+scalar_type distance2(const Sector_3D<scalar_type>& first_sector,
+                      const Sector_3D<scalar_type>& second_sector) noexcept
+{
+    return impl::fast_distance2(first_sector, second_sector);
+}
+
+// distance(first, second) <= dist. Segments with disjoint boxes grown by dist
+// are rejected before the candidates enumeration.
+template<std::floating_point scalar_type>
+bool within_distance(const Sector_3D<scalar_type>& first_sector,
+                     const Sector_3D<scalar_type>& second_sector,
+                     scalar_type dist) noexcept
+{
+    if (dist < 0 || separated(Bounding_box_3D(first_sector), Bounding_box_3D(second_sector), dist)) {
+        return false;
+    }
+    return impl::fast_distance2(first_sector, second_sector) <= dist * dist;
+}
+
+// The same for prepared segments, rejected by their bounding spheres.
+template<std::floating_point scalar_type>
+bool within_distance(const Prepared_sector_3D<scalar_type>& first_sector,
+                     const Prepared_sector_3D<scalar_type>& second_sector,
+                     scalar_type dist) noexcept
+{
+    if (dist < 0 || separated(first_sector.get_bounding_sphere(), second_sector.get_bounding_sphere(), dist)) {
+        return false;
+    }
+    return first_sector.distance2(second_sector) <= dist * dist;
+}
+
+namespace impl
+{
+// Squared distance between bounding boxes of segments of lanes.
+template<typename lane_type>
+GEOM_FORCE_INLINE void lane_box_gap2(const lane_type (&first)[6], const lane_type (&second)[6],
+                                     lane_type& res) noexcept
+{
+    const lane_type zero{};
+    res = zero;
+    for (int k = 0; k < 3; ++k) {
+        const lane_type lo1 = first[k] < first[k + 3] ? first[k] : first[k + 3];
+        const lane_type hi1 = first[k] < first[k + 3] ? first[k + 3] : first[k];
+        const lane_type lo2 = second[k] < second[k + 3] ? second[k] : second[k + 3];
+        const lane_type hi2 = second[k] < second[k + 3] ? second[k + 3] : second[k];
+        const lane_type left = lo2 - hi1;
+        const lane_type right = lo1 - hi2;
+        lane_type gap = left > right ? left : right;
+        gap = gap > zero ? gap : zero;
+        res += gap * gap;
+    }
+}
+
+// out[i] = distance(first[i], second[i]) <= dist by lane blocks:
+// the distance kernel runs only for blocks with a pair whose boxes are close enough.
+template<typename lane_type, std::floating_point scalar_type>
+GEOM_FORCE_INLINE void batch_within_loop(const SoA_sectors_view<scalar_type>& first,
+                                         const SoA_sectors_view<scalar_type>& second,
+                                         scalar_type dist,
+                                         std::span<std::uint8_t> out) noexcept
+{
+    constexpr std::size_t lanes = sizeof(lane_type) / sizeof(scalar_type);
+    const scalar_type* first_coords[6] = {
+        first.ax.data(), first.ay.data(), first.az.data(),
+        first.bx.data(), first.by.data(), first.bz.data()};
+    const scalar_type* second_coords[6] = {
+        second.ax.data(), second.ay.data(), second.az.data(),
+        second.bx.data(), second.by.data(), second.bz.data()};
+    std::uint8_t* res = out.data();
+    const std::size_t n = out.size();
+    const scalar_type dist2 = dist * dist;
+
+    std::size_t i = 0;
+    if constexpr (lanes > 1) {
+        const lane_type lane_dist2 = lane_type{} + dist2;
+        for (; i + lanes <= n; i += lanes) {
+            lane_type first_lanes[6], second_lanes[6], gap2, d2;
+            for (int k = 0; k < 6; ++k) {
+                std::memcpy(&first_lanes[k], first_coords[k] + i, sizeof(lane_type));
+                std::memcpy(&second_lanes[k], second_coords[k] + i, sizeof(lane_type));
+            }
+            lane_box_gap2(first_lanes, second_lanes, gap2);
+            const auto near = gap2 <= lane_dist2;
+            bool any_near = false;
+            for (std::size_t k = 0; k < lanes; ++k) {
+                any_near |= near[k] != 0;
+            }
+            if (!any_near) {
+                std::memset(res + i, 0, lanes);
+                continue;
+            }
+            lane_distance2<lane_type, scalar_type>(first_lanes, second_lanes, d2);
+            for (std::size_t k = 0; k < lanes; ++k) {
+                res[i + k] = d2[k] <= dist2;
+            }
+        }
+    }
+    for (; i < n; ++i) {
+        scalar_type first_lane[6], second_lane[6], gap2, d2;
+        for (int k = 0; k < 6; ++k) {
+            first_lane[k] = first_coords[k][i];
+            second_lane[k] = second_coords[k][i];
+        }
+        lane_box_gap2(first_lane, second_lane, gap2);
+        if (gap2 > dist2) {
+            res[i] = 0;
+            continue;
+        }
+        lane_distance2<scalar_type, scalar_type>(first_lane, second_lane, d2);
+        res[i] = d2 <= dist2;
+    }
+}
+
+template<std::floating_point scalar_type>
+void batch_within_sse2(const SoA_sectors_view<scalar_type>& first,
+                       const SoA_sectors_view<scalar_type>& second,
+                       scalar_type dist,
+                       std::span<std::uint8_t> out) noexcept
+{
+#ifdef GEOM_SIMD_DISPATCH
+    batch_within_loop<simd_vector_t<scalar_type, 16>>(first, second, dist, out);
+#else
+    batch_within_loop<scalar_type>(first, second, dist, out);
+#endif
+}
+
+#ifdef GEOM_SIMD_DISPATCH
+
+template<std::floating_point scalar_type>
+GEOM_TARGET("avx2,fma")
+void batch_within_avx2(const SoA_sectors_view<scalar_type>& first,
+                       const SoA_sectors_view<scalar_type>& second,
+                       scalar_type dist,
+                       std::span<std::uint8_t> out) noexcept
+{
+    batch_within_loop<simd_vector_t<scalar_type, 32>>(first, second, dist, out);
+}
+
+template<std::floating_point scalar_type>
+GEOM_TARGET("avx512f,avx512dq,avx2,fma")
+void batch_within_avx512(const SoA_sectors_view<scalar_type>& first,
+                         const SoA_sectors_view<scalar_type>& second,
+                         scalar_type dist,
+                         std::span<std::uint8_t> out) noexcept
+{
+    batch_within_loop<simd_vector_t<scalar_type, 64>>(first, second, dist, out);
+}
+#endif
+} // namespace impl
+
+// out[i] = within_distance(first[i], second[i], dist): 1 - within, 0 - not.
+template<std::floating_point scalar_type>
+void batch_within_distance(const SoA_sectors_view<scalar_type>& first,
+                           const SoA_sectors_view<scalar_type>& second,
+                           scalar_type dist,
+                           std::span<std::uint8_t> out,
+                           simd_level level)
+{
+    if (first.size() != out.size() || second.size() != out.size()) {
+        throw std::invalid_argument("batch sizes mismatch");
+    }
+    if (dist < 0) {
+        std::ranges::fill(out, 0);
+        return;
+    }
+    switch (std::min(level, supported_simd_level())) {
+    case simd_level::scalar:
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            out[i] = within_distance(first[i], second[i], dist);
+        }
+        break;
+    case simd_level::sse2:
+        impl::batch_within_sse2(first, second, dist, out);
+        break;
+#ifdef GEOM_SIMD_DISPATCH
+    case simd_level::avx2:
+        impl::batch_within_avx2(first, second, dist, out);
+        break;
+    case simd_level::avx512:
+        impl::batch_within_avx512(first, second, dist, out);
+        break;
+#else
+    default:
+        impl::batch_within_sse2(first, second, dist, out);
+        break;
+#endif
+    }
+}
+
+template<std::floating_point scalar_type>
+void batch_within_distance(const SoA_sectors_view<scalar_type>& first,
+                           const SoA_sectors_view<scalar_type>& second,
+                           scalar_type dist,
+                           std::span<std::uint8_t> out)
+{
+    batch_within_distance(first, second, dist, out, best_simd_level());
+}
+
+} // namespace geom
@@ -5,18 +5,34 @@
 #include <geom/sector.h>
 #include <geom/line.h>
 #include <geom/distance.h>
+#include <geom/batch_distance.h>
+#include <geom/parallel_distance.h>
+#include <geom/distance_cache.h>
+#include <geom/text_io.h>
+#include <geom/binary_io.h>
+#include <geom/stats.h>
+#ifndef _WIN32
+#include <geom/server.h>
+#include <csignal>
+#include <pthread.h>
+#endif
 #include "argparse/argparse.hpp"
 
 #include <iostream>
 #include <format>
 #include <ranges>
 #include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <limits>
+#include <memory>
+#include <optional>
 
 
 using point = geom::Point_3D<double>;
 using sector = geom::Sector_3D<double>;
 
-double sector_distanse(const point& a, const point& b, const point& c, const point& d) {
+double sector_distanse(const point& a, const point& b, const point& c, const point& d) noexcept {
 	sector l{a, b};
 	sector r{c, d};
 
@@ -28,6 +44,205 @@ point from_span(std::span<double> arr) {
 	return point{arr[0], arr[1], arr[2]};
 }
 
+using file_ptr = std::unique_ptr<std::FILE, int(*)(std::FILE*)>;
+
+file_ptr open_file(const std::string& path, const char* mode, std::FILE* standard) {
+	if (path == "-") {
+		return file_ptr(standard, [](std::FILE*) { return 0; });
+	}
+	std::FILE* file = std::fopen(path.c_str(), mode);
+	if (!file) {
+		throw std::runtime_error("cannot open " + path);
+	}
+	return file_ptr(file, std::fclose);
+}
+
+// Pairs are read, computed and written by chunks of this size per thread.
+constexpr std::size_t batch_size = 4096;
+
+// Kernel time per chunk of batch mode and counters of the --cache result cache, written by --stats.
+struct Batch_stats {
+	geom::stats::Latency_histogram latency;
+	std::size_t pairs = 0;
+	// Entries of result caches, 0 - no cache; a cache per scalar type is made by the first chunk.
+	std::size_t cache_capacity = 0;
+	std::unique_ptr<geom::Distance_cache<float>> float_cache;
+	std::unique_ptr<geom::Distance_cache<double>> double_cache;
+
+	template<std::floating_point scalar_type>
+	void run(geom::Executor& executor, const geom::SoA_sectors_view<scalar_type>& first,
+		const geom::SoA_sectors_view<scalar_type>& second, std::span<scalar_type> out) {
+		const auto start = std::chrono::steady_clock::now();
+		if (auto* cache = get_cache<scalar_type>()) {
+			geom::parallel_batch_distance(executor, *cache, first, second, out);
+		} else {
+			geom::parallel_batch_distance(executor, first, second, out);
+		}
+		latency.add(std::chrono::steady_clock::now() - start);
+		pairs += out.size();
+	}
+
+	template<std::floating_point scalar_type>
+	geom::Distance_cache<scalar_type>* get_cache() {
+		auto& cache = [this]() -> auto& {
+			if constexpr (std::is_same_v<scalar_type, float>) {
+				return float_cache;
+			} else {
+				return double_cache;
+			}
+		}();
+		if (!cache && cache_capacity) {
+			cache = std::make_unique<geom::Distance_cache<scalar_type>>(cache_capacity);
+		}
+		return cache.get();
+	}
+
+	// JSON counters of the used cache, null without --cache.
+	std::string cache_json() const {
+		const auto json = [](const auto& cache) {
+			const auto counters = cache.counters();
+			return std::format("{{\"capacity\":{},\"hits\":{},\"misses\":{},\"evictions\":{}}}",
+				cache.capacity(), counters.hits, counters.misses, counters.evictions);
+		};
+		return float_cache ? json(*float_cache) : double_cache ? json(*double_cache) : "null";
+	}
+};
+
+// One JSON object: pairs, chunk latencies, counters of kernel paths, null if they are not compiled in,
+// and of the result cache.
+void write_stats(const std::string& path, const Batch_stats& stats, std::size_t threads) {
+	auto file = open_file(path, "wb", stderr);
+	const std::string counters = geom::stats::enabled ? geom::stats::to_json(geom::stats::snapshot()) : "null";
+	const std::string json = std::format("{{\"pairs\":{},\"threads\":{},\"chunk_pairs\":{},\"latency\":{},\"paths\":{},\"cache\":{}}}\n",
+		stats.pairs, threads, batch_size * threads, geom::stats::to_json(stats.latency), counters, stats.cache_json());
+	if (std::fputs(json.c_str(), file.get()) < 0) {
+		throw std::runtime_error("cannot write stats");
+	}
+}
+
+void batch_distanse(geom::Executor& executor, std::FILE* input, std::FILE* output, int digits, Batch_stats& stats) {
+	const std::size_t chunk_size = batch_size * executor.size();
+	geom::io::Text_pairs_reader<double> reader(input);
+	geom::io::Text_writer writer(output, digits);
+	geom::SoA_sectors<double> first, second;
+	std::vector<double> distanses(chunk_size);
+
+	while (std::size_t count = reader.read(first, second, chunk_size)) {
+		auto out = std::span<double>(distanses).first(count);
+		stats.run(executor, first.get_view(), second.get_view(), out);
+		for (double d : out) {
+			writer.write(d);
+		}
+	}
+	writer.flush();
+}
+
+// Binary pairs are passed to the kernel right from the mapped input,
+// binary output is written to the mapped file, text one - to stdout.
+template<std::floating_point scalar_type>
+void binary_batch_distanse(geom::Executor& executor, const geom::io::Mapped_file& input,
+	const std::optional<std::string>& output, int digits, Batch_stats& stats) {
+	const auto header = geom::io::read_binary_header(input.data());
+	if (header.kind != geom::io::binary_kind::pairs) {
+		throw std::runtime_error("binary input must contain pairs of segments");
+	}
+	const auto first = geom::io::binary_sectors<scalar_type>(input.data(), header, 0);
+	const auto second = geom::io::binary_sectors<scalar_type>(input.data(), header, 1);
+	const std::size_t chunk_size = batch_size * executor.size();
+
+	if (output) {
+		auto output_file = geom::io::create_binary<scalar_type>(*output, geom::io::binary_kind::distances, first.size());
+		const auto output_header = geom::io::read_binary_header(output_file.data());
+		const auto out = geom::io::binary_array<scalar_type>(output_file.data(), output_header, 0);
+		for (std::size_t offset = 0; offset < first.size(); offset += chunk_size) {
+			std::size_t count = std::min(chunk_size, first.size() - offset);
+			stats.run(executor, first.subview(offset, count), second.subview(offset, count), out.subspan(offset, count));
+		}
+		return;
+	}
+
+	geom::io::Text_writer writer(stdout, digits);
+	std::vector<scalar_type> distanses(chunk_size);
+	for (std::size_t offset = 0; offset < first.size(); offset += chunk_size) {
+		std::size_t count = std::min(chunk_size, first.size() - offset);
+		auto out = std::span<scalar_type>(distanses).first(count);
+		stats.run(executor, first.subview(offset, count), second.subview(offset, count), out);
+		for (scalar_type d : out) {
+			writer.write(d);
+		}
+	}
+	writer.flush();
+}
+
+void run_batch(const argparse::ArgumentParser& program) {
+	const auto input_path = program.get<std::string>("input");
+	const auto output_path = program.present<std::string>("output");
+	const int digits = program.get<int>("digits");
+	const int threads = program.get<int>("threads");
+	if (threads < 0) {
+		throw std::runtime_error("threads must be non-negative");
+	}
+	geom::Executor executor(static_cast<std::size_t>(threads));
+	const auto stats_path = program.present<std::string>("stats");
+	const int cache_capacity = program.get<int>("cache");
+	if (cache_capacity < 0) {
+		throw std::runtime_error("cache must be non-negative");
+	}
+	Batch_stats stats;
+	stats.cache_capacity = static_cast<std::size_t>(cache_capacity);
+
+	if (input_path != "-") {
+		auto input = geom::io::Mapped_file::open(input_path);
+		if (geom::io::is_binary(input.data())) {
+			if (geom::io::read_binary_header(input.data()).scalar_size == sizeof(float)) {
+				binary_batch_distanse<float>(executor, input, output_path, digits, stats);
+			} else {
+				binary_batch_distanse<double>(executor, input, output_path, digits, stats);
+			}
+			if (stats_path) {
+				write_stats(*stats_path, stats, executor.size());
+			}
+			return;
+		}
+	}
+
+	auto input = open_file(input_path, "rb", stdin);
+	if (auto binary_path = program.present<std::string>("write-binary")) {
+		geom::io::Text_pairs_reader<double> reader(input.get());
+		geom::SoA_sectors<double> first, second;
+		reader.read(first, second, std::numeric_limits<std::size_t>::max());
+		geom::io::write_binary_pairs(*binary_path, first.get_view(), second.get_view());
+		return;
+	}
+	auto output = open_file(output_path.value_or("-"), "wb", stdout);
+	batch_distanse(executor, input.get(), output.get(), digits, stats);
+	if (stats_path) {
+		write_stats(*stats_path, stats, executor.size());
+	}
+}
+
+// Serves distance queries on the Unix socket until SIGINT or SIGTERM.
+void run_server(const std::string& path, int threads) {
+	if (threads < 0) {
+		throw std::runtime_error("threads must be non-negative");
+	}
+#ifndef _WIN32
+	// Blocked before the server threads start, so they inherit the mask and the signals come to sigwait.
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	geom::net::Server server(path, {.threads = static_cast<std::size_t>(threads)});
+	std::cerr << std::format("serving on {}", path) << std::endl;
+	int signal = 0;
+	sigwait(&signals, &signal);
+	server.stop();
+#else
+	throw std::runtime_error("server mode is not supported on this platform");
+#endif
+}
+
 int main(int argc, char *argv[])
 {
 	argparse::ArgumentParser program("Segments distance");
@@ -36,13 +251,43 @@ int main(int argc, char *argv[])
 	program.add_argument("points")
 		.help("4 points - boundaries of 2 segments")
 		.nargs(4 * 3)
-		.scan<'g', double>();
+		.scan<'g', double>()
+		.default_value(std::vector<double>{});
 	program.add_argument("-d", "--digits")
 		.help("digits after point")
 		.scan<'i', int>()
 		.default_value(4);
+	program.add_argument("-b", "--batch")
+		.help("read pairs of segments from input, 12 numbers per line, write distance per line")
+		.default_value(false)
+		.implicit_value(true);
+	program.add_argument("-i", "--input")
+		.help("input file of batch mode: text or binary pairs, - for stdin")
+		.default_value(std::string("-"));
+	program.add_argument("-o", "--output")
+		.help("output file of batch mode, binary for binary input");
+	program.add_argument("-t", "--threads")
+		.help("threads of batch and server modes, 0 for all hardware threads")
+		.scan<'i', int>()
+		.default_value(1);
+	program.add_argument("--write-binary")
+		.help("convert text pairs of batch input to the binary file");
+	program.add_argument("--stats")
+		.help("write JSON stats of batch mode to the file, - for stderr: latency histogram of chunks, "
+			"counters of kernel paths if built with SEGMENT_DISTANSE_STATS");
+	program.add_argument("--cache")
+		.help("cache distances of up to N recurring pairs of batch mode, capacity, hits, misses and evictions "
+			"go to --stats; off by default: cached pairs take the scalar kernel and a lookup costs more than "
+			"a pair of the vectorized one, so batch runs get slower")
+		.scan<'i', int>()
+		.default_value(0);
+	program.add_argument("--serve")
+		.help("serve distance queries on the Unix domain socket, see geom/protocol.h");
 	try {
 		program.parse_args(argc, argv);
+		if (!program.get<bool>("batch") && !program.present<std::string>("serve") && program.get<std::vector<double>>("points").size() != 4 * 3) {
+			throw std::runtime_error("expected 12 numbers - coordinates of 4 points");
+		}
 	} 
 	catch (const std::exception& err) {
 		std::cerr << err.what() << std::endl;
@@ -50,6 +295,28 @@ int main(int argc, char *argv[])
 		return 1;
 	}
 
+	if (auto serve_path = program.present<std::string>("serve")) {
+		try {
+			run_server(*serve_path, program.get<int>("threads"));
+		}
+		catch (const std::exception& err) {
+			std::cerr << err.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
+	if (program.get<bool>("batch")) {
+		try {
+			run_batch(program);
+		}
+		catch (const std::exception& err) {
+			std::cerr << err.what() << std::endl;
+			return 1;
+		}
+		return 0;
+	}
+
 	auto points_v = program.get<std::vector<double>>("points");
 	auto points = std::span<double>(points_v);
 
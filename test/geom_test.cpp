@@ -3,8 +3,39 @@
 #include <geom/vector.h>
 #include <geom/basic_algorithm.h>
 #include <geom/distance.h>
+#include <geom/fast_distance.h>
+#include <geom/batch_distance.h>
+#include <geom/parallel_distance.h>
+#include <geom/prepared_sector.h>
+#include <geom/closest_points.h>
+#include <geom/within_distance.h>
+#include <geom/bvh.h>
+#include <geom/dynamic_bvh.h>
+#include <geom/self_proximity.h>
+#include <geom/distance_matrix.h>
+#include <geom/polyline.h>
+#include <geom/hausdorff.h>
+#include <geom/point_distance.h>
+#include <geom/distance_cache.h>
+#include <geom/curve_order.h>
+#include <geom/quantized.h>
+#include <geom/closest_approach.h>
+#include <geom/text_io.h>
+#include <geom/binary_io.h>
+#ifndef _WIN32
+#include <geom/server.h>
+#include <geom/client.h>
+#endif
 
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <map>
+#include <mutex>
 #include <numeric>
+#include <random>
+#include <thread>
+#include <tuple>
 
 #include "test_algorithm.h"
 
@@ -124,6 +155,8 @@ TYPED_TEST(GeomTest, CrossProduct) {
 
     TestFixture::expect_vector_eq(geom::cross_product(ox, oy), oz);
     TestFixture::expect_vector_eq(geom::cross_product(ox, ox), vector::zero());
+    TestFixture::expect_vector_eq(geom::cross_product(oz, ox), oy);
+    TestFixture::expect_vector_eq(geom::cross_product(ox, oz), oy * -1.);
 }
 
 TYPED_TEST(GeomTest, BasicAlgs) {
@@ -164,6 +197,96 @@ TYPED_TEST(GeomTest, DistanceLine) {
     TestFixture::expect_point_eq(p4, point{0., 0., 1.});
 }
 
+TYPED_TEST(GeomTest, Constexpr) {
+    using vector =  typename TestFixture::vector; 
+    using point =  typename TestFixture::point;
+    using line =  typename TestFixture::line;
+    using sector =  typename TestFixture::sector;
+    using scalar_type = typename TestFixture::scalar_type;
+
+    static_assert(std::is_trivially_copyable_v<point> && std::is_trivially_copyable_v<vector>);
+    static_assert(std::is_trivially_copyable_v<sector> && std::is_trivially_copyable_v<line>);
+    static_assert(noexcept(geom::fast_distance(std::declval<sector>(), std::declval<sector>())));
+
+    constexpr point a{0., 0., 1.};
+    constexpr point b{0., 0., 2.};
+    constexpr sector s{a, b};
+    static_assert(s.get_first_point().get_z() == 1.);
+    static_assert(geom::vector_eq<scalar_type>((b - a).normalized(), vector{0., 0., 1.}, TestFixture::eps));
+    static_assert(line(a, b).get_vector().get_z() == 1.);
+    static_assert(!line::make(a, a));
+
+    constexpr sector t{point{1., 0., 0.}, point{2., 0., 0.}};
+    constexpr scalar_type ans = 1.4142135623730951;
+    constexpr scalar_type dist = geom::distance(s, t);
+    static_assert(ans - TestFixture::eps < dist && dist < ans + TestFixture::eps);
+    constexpr scalar_type fast = geom::fast_distance(s, t);
+    static_assert(ans - TestFixture::eps < fast && fast < ans + TestFixture::eps);
+    constexpr scalar_type clamped = geom::distance<geom::Clamped_policy>(s, t);
+    static_assert(ans - TestFixture::eps < clamped && clamped < ans + TestFixture::eps);
+    constexpr auto closest = geom::closest_points(s, t);
+    static_assert(closest.first_param == 0. && closest.second_param == 0.);
+
+    // Crossing lines: the closest points are inside both segments.
+    constexpr sector u{point{-1., 0., -1.}, point{1., 0., -1.}};
+    constexpr sector w{point{0., -1., 1.}, point{0., 1., 1.}};
+    static_assert(geom::distance(u, w) > 2 - TestFixture::eps && geom::distance(u, w) < 2 + TestFixture::eps);
+    EXPECT_EQ(geom::distance(u, w), geom::distance(sector(u), sector(w)));
+
+    // The constant evaluation fallback of sqrt is within an ulp of std::sqrt.
+    for (scalar_type x : {0., 1e-30, 1e-7, .5, 1., 2., 3., 1e7, 1e30}) {
+        EXPECT_NEAR(geom::impl::constexpr_sqrt(x), std::sqrt(x), std::sqrt(x) * std::numeric_limits<scalar_type>::epsilon());
+    }
+    EXPECT_TRUE(std::isnan(geom::impl::constexpr_sqrt(scalar_type(-1))));
+    static_assert(geom::sqrt(scalar_type(4)) == 2 && geom::abs(scalar_type(-2)) == 2);
+}
+
+TYPED_TEST(GeomTest, DistanceDegenerate) {
+    using vector =  typename TestFixture::vector; 
+    using point =  typename TestFixture::point;
+    using line =  typename TestFixture::line;
+    using sector =  typename TestFixture::sector;
+    using scalar_type = typename TestFixture::scalar_type;
+
+    const point o{1., 2., 3.};
+    const scalar_type short_length = std::sqrt(TestFixture::eps) / 2;
+    EXPECT_FALSE(line::make(o, o));
+    EXPECT_FALSE(line::make(sector{o, o + vector{short_length, 0., 0.}}));
+    EXPECT_THROW(line(o, o), std::runtime_error);
+    const auto ox = line::make(o, o + vector{2., 0., 0.});
+    ASSERT_TRUE(ox);
+    TestFixture::expect_vector_eq(ox->get_vector(), vector{1., 0., 0.});
+
+    // Opposite directions are parallel too.
+    const line back(point{0., 1., 0.}, point{-1., 1., 0.});
+    EXPECT_FALSE(geom::impl::try_closest_point_on_cross_lines(*ox, back));
+    EXPECT_FALSE(geom::impl::try_closest_point_on_cross_lines(*ox, *ox));
+    EXPECT_THROW(geom::impl::closest_point_on_cross_lines(*ox, back), std::runtime_error);
+
+    static_assert(noexcept(geom::distance(std::declval<sector>(), std::declval<sector>())));
+    // Angles around the parallel threshold: sin^2 from eps / 4 to 16 eps, both directions.
+    for (scalar_type scale : {.5, .9, 1., 1.1, 1.5, 2., 4.}) {
+        const scalar_type angle = scale * std::sqrt(TestFixture::eps);
+        for (scalar_type sign : {1., -1.}) {
+            const vector w{sign * std::cos(angle), std::sin(angle), 0.};
+            for (scalar_type shift : {-3., -.5, 0., .5, 3.}) {
+                const sector a{point{0., 0., 0.}, point{1., 0., 0.}};
+                const point p{shift, 0., .25};
+                const sector b{p, p + w * scalar_type(2.)};
+                EXPECT_NEAR(geom::distance(a, b), geom::fast_distance(a, b), TestFixture::eps);
+                EXPECT_NEAR(geom::distance(b, a), geom::fast_distance(a, b), TestFixture::eps);
+            }
+        }
+    }
+
+    // Segments too short for a line are handled by their ends.
+    for (const auto& a : TestFixture::gen_sectors(-1., 1.)) {
+        const sector b{o, o + vector{0., short_length, 0.}};
+        EXPECT_NEAR(geom::distance(a, b), geom::fast_distance(a, b), short_length / 2 + TestFixture::eps);
+        EXPECT_NEAR(geom::distance(b, a), geom::fast_distance(a, b), short_length / 2 + TestFixture::eps);
+    }
+}
+
 TYPED_TEST(GeomTest, DistanceSector) {
     using vector =  typename TestFixture::vector; 
     using point =  typename TestFixture::point;
@@ -217,3 +340,1348 @@ TYPED_TEST(GeomTest, DistanceOneStaticSectorSorted) {
         }
     }
 }
+
+TYPED_TEST(GeomTest, FastDistanceAllPointsInSmallCube) {
+    auto sectors = TestFixture::gen_sectors(-1., 1.);
+    for (auto a : sectors) {
+        for (auto b : sectors) {
+            EXPECT_NEAR(geom::fast_distance(a, b), geom::distance(a, b), TestFixture::eps);
+        }
+    }
+}
+
+TYPED_TEST(GeomTest, FastDistanceOneStaticSector) {
+    using point =  typename TestFixture::point;
+    using sector =  typename TestFixture::sector;
+    using scalar_type = typename TestFixture::scalar_type;
+
+    auto sectors = TestFixture::gen_sectors(-2., 3.);
+    for (scalar_type len : {0., .5, 2., 3., 5., 10.}) {
+        sector b{point{-len, 0., 0.}, point{len, 0., 0.}};
+        for (auto a : sectors) {
+            EXPECT_NEAR(geom::fast_distance(a, b), geom::distance(a, b), TestFixture::eps);
+            EXPECT_NEAR(geom::fast_distance(b, a), geom::distance(a, b), TestFixture::eps);
+        }
+    }
+}
+
+TYPED_TEST(GeomTest, BatchDistance) {
+    using scalar_type = typename TestFixture::scalar_type;
+
+    auto sectors = TestFixture::gen_sectors(-1., 1.);
+    geom::SoA_sectors<scalar_type> first, second;
+    for (auto a : sectors) {
+        for (auto b : sectors) {
+            first.push_back(a);
+            second.push_back(b);
+        }
+    }
+
+    // Odd offset and size, so both vector blocks and the scalar tail are checked.
+    const size_t offset = 3;
+    const auto first_view = first.get_view().subview(offset, first.size() - offset);
+    const auto second_view = second.get_view().subview(offset, second.size() - offset);
+    for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2,
+                       geom::simd_level::avx2, geom::simd_level::avx512}) {
+        std::vector<scalar_type> out(first_view.size());
+        geom::batch_distance(first_view, second_view, std::span<scalar_type>(out), level);
+        for (size_t i = 0; i < out.size(); ++i) {
+            EXPECT_NEAR(out[i], geom::fast_distance(first[offset + i], second[offset + i]), TestFixture::eps);
+        }
+    }
+
+    std::vector<scalar_type> out(first.size() - 1);
+    EXPECT_THROW(geom::batch_distance(first.get_view(), second.get_view(), std::span<scalar_type>(out)),
+                 std::invalid_argument);
+}
+
+TYPED_TEST(GeomTest, TextPairsReader) {
+    using point =  typename TestFixture::point;
+    using scalar_type = typename TestFixture::scalar_type;
+
+    std::FILE* file = std::tmpfile();
+    ASSERT_NE(file, nullptr);
+    std::fputs("1 0 0  2 0 0   0 1 0  0 2 0\n\n0,0,0,1,0,0, 0,0,1,1,0,1\r\n+1 2 3 4 5 6 7 8 9 10 11 12", file);
+    std::rewind(file);
+
+    // Small buffer, so lines are split between chunks.
+    geom::io::Text_pairs_reader<scalar_type> reader(file, 8);
+    geom::SoA_sectors<scalar_type> first, second;
+    EXPECT_EQ(reader.read(first, second, 2), 2u);
+    TestFixture::expect_point_eq(first[0].get_second_point(), point{2., 0., 0.});
+    TestFixture::expect_point_eq(second[1].get_first_point(), point{0., 0., 1.});
+    EXPECT_EQ(reader.read(first, second, 2), 1u);
+    TestFixture::expect_point_eq(first[0].get_first_point(), point{1., 2., 3.});
+    TestFixture::expect_point_eq(second[0].get_second_point(), point{10., 11., 12.});
+    EXPECT_EQ(reader.read(first, second, 2), 0u);
+    std::fclose(file);
+
+    file = std::tmpfile();
+    std::fputs("1 2 3\n", file);
+    std::rewind(file);
+    geom::io::Text_pairs_reader<scalar_type> bad_reader(file);
+    EXPECT_THROW(bad_reader.read(first, second, 2), std::runtime_error);
+    std::fclose(file);
+}
+
+TYPED_TEST(GeomTest, BinaryFile) {
+    using scalar_type = typename TestFixture::scalar_type;
+
+    auto sectors = TestFixture::gen_sectors(-1., 1.);
+    geom::SoA_sectors<scalar_type> first, second;
+    for (size_t i = 0; i < sectors.size(); ++i) {
+        first.push_back(sectors[i]);
+        second.push_back(sectors[sectors.size() - 1 - i]);
+    }
+
+    const auto dir = std::filesystem::temp_directory_path();
+    const auto pairs_path = (dir / ("geom_test_pairs_" + std::to_string(sizeof(scalar_type)) + ".segd")).string();
+    const auto distances_path = (dir / ("geom_test_distances_" + std::to_string(sizeof(scalar_type)) + ".segd")).string();
+    geom::io::write_binary_pairs(pairs_path, first.get_view(), second.get_view());
+    {
+        auto input = geom::io::Mapped_file::open(pairs_path);
+        const auto header = geom::io::read_binary_header(input.data());
+        EXPECT_EQ(header.kind, geom::io::binary_kind::pairs);
+        EXPECT_EQ(header.count, first.size());
+        using other_type = std::conditional_t<std::is_same_v<scalar_type, float>, double, float>;
+        EXPECT_THROW(geom::io::binary_sectors<other_type>(input.data(), header, 0), std::invalid_argument);
+        EXPECT_THROW(geom::io::read_binary_header(input.data().first(100)), std::runtime_error);
+
+        const auto mapped_first = geom::io::binary_sectors<scalar_type>(input.data(), header, 0);
+        const auto mapped_second = geom::io::binary_sectors<scalar_type>(input.data(), header, 1);
+        auto output = geom::io::create_binary<scalar_type>(distances_path, geom::io::binary_kind::distances, header.count);
+        geom::batch_distance(mapped_first, mapped_second,
+            geom::io::binary_array<scalar_type>(output.data(), geom::io::read_binary_header(output.data()), 0));
+    }
+    {
+        auto output = geom::io::Mapped_file::open(distances_path);
+        const auto distances = geom::io::binary_array<scalar_type>(
+            output.data(), geom::io::read_binary_header(output.data()), 0);
+        ASSERT_EQ(distances.size(), first.size());
+        for (size_t i = 0; i < distances.size(); ++i) {
+            EXPECT_NEAR(distances[i], geom::fast_distance(first[i], second[i]), TestFixture::eps);
+        }
+    }
+    std::filesystem::remove(pairs_path);
+    std::filesystem::remove(distances_path);
+}
+
+TYPED_TEST(GeomTest, ParallelDistance) {
+    using scalar_type = typename TestFixture::scalar_type;
+
+    auto sectors = TestFixture::gen_sectors(-1., 2.);
+    geom::SoA_sectors<scalar_type> soa(sectors);
+    std::vector<geom::index_pair> pairs;
+    for (size_t i = 0; i < sectors.size(); ++i) {
+        for (size_t j = 0; j < sectors.size(); j += 7) {
+            pairs.emplace_back(i, j);
+        }
+    }
+
+    geom::Executor executor(4);
+    std::vector<scalar_type> out(pairs.size());
+    geom::parallel_distance(executor, soa.get_view(), std::span<const geom::index_pair>(pairs),
+                            std::span<scalar_type>(out));
+    for (size_t i = 0; i < out.size(); ++i) {
+        EXPECT_NEAR(out[i], geom::fast_distance(sectors[pairs[i].first], sectors[pairs[i].second]),
+                    TestFixture::eps);
+    }
+
+    geom::SoA_sectors<scalar_type> first, second;
+    for (const auto& [i, j] : pairs) {
+        first.push_back(sectors[i]);
+        second.push_back(sectors[j]);
+    }
+    std::vector<scalar_type> batch_out(pairs.size());
+    geom::parallel_batch_distance(executor, first.get_view(), second.get_view(), std::span<scalar_type>(batch_out));
+    EXPECT_EQ(batch_out, out);
+
+    // Error of one chunk reaches the caller, the executor stays usable.
+    pairs[pairs.size() / 2].second = sectors.size();
+    EXPECT_THROW(geom::parallel_distance(executor, soa.get_view(), std::span<const geom::index_pair>(pairs),
+                                         std::span<scalar_type>(out)), std::out_of_range);
+    size_t count = 0;
+    std::mutex mutex;
+    executor.parallel_for(1000, 10, [&](size_t begin, size_t end) {
+        std::lock_guard lock(mutex);
+        count += end - begin;
+    });
+    EXPECT_EQ(count, 1000u);
+}
+
+TYPED_TEST(GeomTest, PreparedSector) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    auto sectors = TestFixture::gen_sectors(-1., 1.);
+    geom::SoA_sectors<scalar_type> targets(sectors);
+    std::vector<prepared> prepared_targets;
+    for (const auto& s : sectors) {
+        prepared_targets.emplace_back(s);
+    }
+
+    std::vector<scalar_type> out(sectors.size());
+    std::vector<scalar_type> prepared_out(sectors.size());
+    for (const auto& s : sectors) {
+        const prepared query(s);
+        EXPECT_EQ(query.is_degenerate(), s.len2() == 0);
+        geom::batch_distance(query, std::span<const prepared>(prepared_targets), std::span<scalar_type>(prepared_out));
+        for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2,
+                           geom::simd_level::avx2, geom::simd_level::avx512}) {
+            geom::batch_distance(query, targets.get_view(), std::span<scalar_type>(out), level);
+            for (size_t i = 0; i < out.size(); ++i) {
+                const scalar_type expected = geom::fast_distance(s, sectors[i]);
+                EXPECT_NEAR(out[i], expected, TestFixture::eps);
+                EXPECT_NEAR(prepared_out[i], expected, TestFixture::eps);
+            }
+        }
+    }
+    EXPECT_THROW(geom::batch_distance(prepared(sectors[0]), targets.get_view(), std::span<scalar_type>(out).first(1)),
+                 std::invalid_argument);
+}
+
+TYPED_TEST(GeomTest, ClosestPoints) {
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+
+    auto res = geom::closest_points(sector{point{0., 0., 0.}, point{2., 0., 0.}},
+                                    sector{point{1., -1., 1.}, point{1., 1., 1.}});
+    EXPECT_NEAR(res.first_param, .5, TestFixture::eps);
+    EXPECT_NEAR(res.second_param, .5, TestFixture::eps);
+    TestFixture::expect_point_eq(res.first_point, point{1., 0., 0.});
+    TestFixture::expect_point_eq(res.second_point, point{1., 0., 1.});
+    EXPECT_NEAR(res.distance2, 1., TestFixture::eps);
+
+    auto sectors = TestFixture::gen_sectors(-1., 1.);
+    for (const auto& a : sectors) {
+        for (const auto& b : sectors) {
+            res = geom::closest_points(a, b);
+            EXPECT_GE(res.first_param, 0.);
+            EXPECT_LE(res.first_param, 1.);
+            EXPECT_GE(res.second_param, 0.);
+            EXPECT_LE(res.second_param, 1.);
+            TestFixture::expect_point_eq(res.first_point,
+                a.get_first_point() + (a.get_second_point() - a.get_first_point()) * res.first_param);
+            TestFixture::expect_point_eq(res.second_point,
+                b.get_first_point() + (b.get_second_point() - b.get_first_point()) * res.second_param);
+            EXPECT_NEAR(res.distance(), geom::fast_distance(a, b), TestFixture::eps);
+        }
+    }
+}
+
+TYPED_TEST(GeomTest, WithinDistance) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    auto sectors = TestFixture::gen_sectors(-1., 2.);
+    geom::SoA_sectors<scalar_type> first, second;
+    for (size_t i = 0; i < sectors.size(); ++i) {
+        for (size_t j = i % 5; j < sectors.size(); j += 5) {
+            first.push_back(sectors[i]);
+            second.push_back(sectors[j]);
+        }
+    }
+
+    // Distances of grid segments are far enough from these thresholds for both types.
+    std::vector<std::uint8_t> out(first.size());
+    for (scalar_type dist : {scalar_type(-1.), scalar_type(.3), scalar_type(.7), scalar_type(1.2)}) {
+        for (size_t i = 0; i < first.size(); i += 13) {
+            const bool expected = dist >= 0 && geom::fast_distance(first[i], second[i]) <= dist;
+            EXPECT_EQ(geom::within_distance(first[i], second[i], dist), expected);
+            EXPECT_EQ(geom::within_distance(prepared(first[i]), prepared(second[i]), dist), expected);
+            EXPECT_NEAR(geom::distance2(first[i], second[i]),
+                        geom::fast_distance(first[i], second[i]) * geom::fast_distance(first[i], second[i]),
+                        TestFixture::eps);
+        }
+        for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2,
+                           geom::simd_level::avx2, geom::simd_level::avx512}) {
+            geom::batch_within_distance(first.get_view(), second.get_view(), dist, std::span<std::uint8_t>(out), level);
+            for (size_t i = 0; i < out.size(); ++i) {
+                EXPECT_EQ(out[i], dist >= 0 && geom::fast_distance(first[i], second[i]) <= dist);
+            }
+        }
+    }
+}
+
+TYPED_TEST(GeomTest, Bvh) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    // Grid segments: many duplicates and degenerate ones, enough for parallel subtrees.
+    auto sectors = TestFixture::gen_sectors(-2., 3.);
+    geom::SoA_sectors<scalar_type> soa(sectors);
+    geom::Executor executor(4);
+    const geom::Bvh_3D<scalar_type> serial_bvh(soa.get_view());
+    const geom::Bvh_3D<scalar_type> parallel_bvh(soa.get_view(), executor);
+    EXPECT_EQ(serial_bvh.size(), sectors.size());
+
+    std::vector<sector> queries;
+    for (const auto& s : TestFixture::gen_sectors(-1., 2.)) {
+        const auto a = s.get_first_point();
+        const auto b = s.get_second_point();
+        queries.push_back(sector{point{a.get_x() + scalar_type(.3), a.get_y() - scalar_type(.2), a.get_z()},
+                                 point{b.get_x(), b.get_y() + scalar_type(.1), b.get_z() * 2}});
+    }
+    for (size_t q = 0; q < queries.size(); q += 37) {
+        std::vector<scalar_type> distances;
+        for (const auto& s : sectors) {
+            distances.push_back(prepared(queries[q]).distance(prepared(s)));
+        }
+        auto sorted = distances;
+        std::sort(sorted.begin(), sorted.end());
+
+        for (const auto* bvh : {&serial_bvh, &parallel_bvh}) {
+            const auto nearest = bvh->nearest(queries[q]);
+            ASSERT_TRUE(nearest);
+            // Box bounds are rounded too, so ties are broken up to rounding.
+            EXPECT_NEAR(nearest->distance, sorted[0], TestFixture::eps);
+            EXPECT_EQ(distances[nearest->index], nearest->distance);
+
+            const auto k_nearest = bvh->k_nearest(queries[q], 10);
+            ASSERT_EQ(k_nearest.size(), 10u);
+            for (size_t i = 0; i < k_nearest.size(); ++i) {
+                EXPECT_NEAR(k_nearest[i].distance, sorted[i], TestFixture::eps);
+                EXPECT_EQ(distances[k_nearest[i].index], k_nearest[i].distance);
+            }
+
+            // Between two distances, so that rounding of squares does not matter.
+            size_t m = sorted.size() / 20;
+            while (sorted[m + 1] - sorted[m] < TestFixture::eps) {
+                ++m;
+            }
+            const scalar_type radius = (sorted[m] + sorted[m + 1]) / 2;
+            const auto within = bvh->within(queries[q], radius);
+            EXPECT_EQ(within.size(), static_cast<size_t>(std::upper_bound(sorted.begin(), sorted.end(), radius) - sorted.begin()));
+            for (const auto& hit : within) {
+                EXPECT_LE(distances[hit.index], radius);
+            }
+        }
+    }
+
+    EXPECT_EQ(serial_bvh.k_nearest(queries[0], sectors.size() + 5).size(), sectors.size());
+    EXPECT_FALSE(geom::Bvh_3D<scalar_type>().nearest(queries[0]));
+}
+
+TYPED_TEST(GeomTest, DynamicBvh) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+    using index_type = geom::Dynamic_bvh_3D<scalar_type>;
+
+    const auto sectors = TestFixture::gen_sectors(-1., 2.);
+    const auto shifted = [](const sector& s, scalar_type dx, scalar_type dy) {
+        const auto a = s.get_first_point();
+        const auto b = s.get_second_point();
+        return sector{point{a.get_x() + dx, a.get_y() + dy, a.get_z()}, point{b.get_x() + dx, b.get_y(), b.get_z() - dy}};
+    };
+    std::vector<sector> queries;
+    for (size_t i = 0; i < sectors.size(); i += 29) {
+        queries.push_back(shifted(sectors[i], scalar_type(.3), scalar_type(-.2)));
+    }
+
+    // Compares queries with brute force over live segments of the index.
+    const auto check = [&](const index_type& index) {
+        for (const auto& q : queries) {
+            std::vector<std::pair<scalar_type, size_t>> expected;
+            for (size_t id = 0; id < sectors.size() + 10; ++id) {
+                if (index.contains(id)) {
+                    expected.push_back({prepared(q).distance(prepared(index.get(id))), id});
+                }
+            }
+            std::sort(expected.begin(), expected.end());
+            const auto nearest = index.nearest(q);
+            ASSERT_TRUE(nearest);
+            EXPECT_NEAR(nearest->distance, expected[0].first, TestFixture::eps);
+            EXPECT_EQ(prepared(q).distance(prepared(index.get(nearest->index))), nearest->distance);
+
+            size_t m = expected.size() / 10;
+            while (expected[m + 1].first - expected[m].first < TestFixture::eps) {
+                ++m;
+            }
+            const scalar_type radius = (expected[m].first + expected[m + 1].first) / 2;
+            auto within = index.within(q, radius);
+            ASSERT_EQ(within.size(), m + 1);
+            std::sort(within.begin(), within.end(), [](const auto& l, const auto& r) { return l.index < r.index; });
+            std::vector<size_t> expected_ids;
+            for (size_t i = 0; i <= m; ++i) {
+                expected_ids.push_back(expected[i].second);
+            }
+            std::sort(expected_ids.begin(), expected_ids.end());
+            for (size_t i = 0; i <= m; ++i) {
+                EXPECT_EQ(within[i].index, expected_ids[i]);
+            }
+        }
+    };
+
+    geom::SoA_sectors<scalar_type> soa(sectors);
+    index_type bulk(soa.get_view());
+    index_type incremental;
+    for (const auto& s : sectors) {
+        incremental.insert(s);
+    }
+    for (auto* index : {&bulk, &incremental}) {
+        EXPECT_EQ(index->size(), sectors.size());
+        check(*index);
+
+        for (size_t id = 0; id < sectors.size(); id += 3) {
+            index->remove(id);
+        }
+        EXPECT_FALSE(index->contains(0));
+        EXPECT_THROW(index->remove(0), std::out_of_range);
+        EXPECT_THROW(index->get(3), std::out_of_range);
+        check(*index);
+
+        // Removed ids are reused.
+        EXPECT_EQ(index->insert(shifted(sectors[7], 1, 1)) % 3, 0u);
+
+        for (size_t id = 1; id < sectors.size(); id += 3) {
+            index->update(id, shifted(index->get(id), scalar_type(.7), scalar_type(.4)));
+        }
+        EXPECT_TRUE(index->needs_refit());
+        EXPECT_THROW(index->nearest(queries[0]), std::logic_error);
+        index->refit();
+        check(*index);
+
+        for (size_t id = 2; id < sectors.size(); id += 3) {
+            index->update(id, shifted(index->get(id), scalar_type(-3), scalar_type(2)));
+        }
+        EXPECT_GT(index->rebuild_degraded(), 0u);
+        EXPECT_FALSE(index->needs_refit());
+        check(*index);
+        index->rebuild();
+        check(*index);
+    }
+
+    index_type single;
+    EXPECT_FALSE(single.nearest(queries[0]));
+    const auto id = single.insert(sectors[5]);
+    EXPECT_EQ(single.nearest(queries[0])->index, id);
+    single.remove(id);
+    EXPECT_TRUE(single.empty());
+    EXPECT_FALSE(single.nearest(queries[0]));
+}
+
+TYPED_TEST(GeomTest, SelfProximity) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    // Short random segments and a random walk polyline through the same cube.
+    std::mt19937 gen{17};
+    std::uniform_real_distribution<scalar_type> coord(-5, 5), step(-.3, .3);
+    std::vector<sector> sectors;
+    for (size_t i = 0; i < 700; ++i) {
+        const point a{coord(gen), coord(gen), coord(gen)};
+        sectors.push_back(sector{a, point{a.get_x() + step(gen), a.get_y() + step(gen), a.get_z() + step(gen)}});
+    }
+    const size_t polyline_begin = sectors.size();
+    point a{0, 0, 0};
+    for (size_t i = 0; i < 700; ++i) {
+        const point b{a.get_x() + step(gen), a.get_y() + step(gen), a.get_z() + step(gen)};
+        sectors.push_back(sector{a, b});
+        a = b;
+    }
+    const geom::SoA_sectors<scalar_type> all(sectors);
+    std::vector<sector> polyline_sectors(sectors.begin() + polyline_begin, sectors.end());
+    const geom::SoA_sectors<scalar_type> polyline(polyline_sectors);
+
+    geom::Executor executor(4);
+    for (bool skip_adjacent : {false, true}) {
+        const geom::Proximity_options options{skip_adjacent};
+        for (const auto* set : {&all, &polyline}) {
+            const auto view = set->get_view();
+            std::vector<geom::Proximity_pair<scalar_type>> expected;
+            for (size_t i = 0; i < view.size(); ++i) {
+                for (size_t j = i + 1; j < view.size(); ++j) {
+                    if (!skip_adjacent || j != i + 1) {
+                        expected.push_back({i, j, prepared(view[i]).distance(prepared(view[j]))});
+                    }
+                }
+            }
+            const auto nearer = [](const auto& l, const auto& r) { return l.distance < r.distance; };
+            const auto best = *std::min_element(expected.begin(), expected.end(), nearer);
+            if (!skip_adjacent && set == &polyline) {
+                EXPECT_EQ(best.distance, 0);
+            }
+
+            const auto serial = geom::closest_pair(view, options);
+            const auto parallel = geom::closest_pair(executor, view, options);
+            ASSERT_TRUE(serial && parallel);
+            EXPECT_EQ(serial->distance, best.distance);
+            EXPECT_EQ(parallel->first, serial->first);
+            EXPECT_EQ(parallel->second, serial->second);
+            EXPECT_EQ(prepared(view[serial->first]).distance(prepared(view[serial->second])), serial->distance);
+
+            // Radius between two distances, so that rounding of squares does not matter.
+            std::sort(expected.begin(), expected.end(), nearer);
+            size_t m = std::min<size_t>(1000, expected.size() - 2);
+            while (expected[m + 1].distance - expected[m].distance < TestFixture::eps) {
+                ++m;
+            }
+            const scalar_type radius = (expected[m].distance + expected[m + 1].distance) / 2;
+            expected.resize(m + 1);
+            std::sort(expected.begin(), expected.end(), [](const auto& l, const auto& r) {
+                return std::tie(l.first, l.second) < std::tie(r.first, r.second);
+            });
+            for (const auto& pairs : {geom::proximity_pairs(view, radius, options),
+                                      geom::proximity_pairs(executor, view, radius, options)}) {
+                ASSERT_EQ(pairs.size(), expected.size());
+                for (size_t i = 0; i < pairs.size(); ++i) {
+                    EXPECT_EQ(pairs[i].first, expected[i].first);
+                    EXPECT_EQ(pairs[i].second, expected[i].second);
+                    EXPECT_EQ(pairs[i].distance, expected[i].distance);
+                }
+            }
+        }
+    }
+
+    const geom::SoA_sectors<scalar_type> two(std::vector<sector>(sectors.begin(), sectors.begin() + 2));
+    EXPECT_FALSE(geom::closest_pair(two.get_view(), geom::Proximity_options{true}));
+    EXPECT_TRUE(geom::closest_pair(two.get_view()));
+    EXPECT_TRUE(geom::proximity_pairs(all.get_view(), scalar_type(-1)).empty());
+
+    // The pair giving the bound is at the grown radius, rounding must not drop it.
+    const sector near_first{point{-3, 3, 2}, point{-3, 1, 2}}, near_second{point{-1, 0, 0}, point{-2, 2, 1}};
+    for (const auto& near : {std::vector<sector>{near_first, near_second},
+                             std::vector<sector>{near_first, near_second, sector{point{10, 10, 10}, point{11, 10, 10}}}}) {
+        const geom::SoA_sectors<scalar_type> set(near);
+        const auto pair = geom::closest_pair(set.get_view());
+        ASSERT_TRUE(pair);
+        EXPECT_EQ(pair->first, 0u);
+        EXPECT_EQ(pair->second, 1u);
+        EXPECT_EQ(pair->distance, prepared(near_first).distance(prepared(near_second)));
+    }
+    std::uniform_int_distribution<int> small(-3, 3);
+    for (int it = 0; it < 2000; ++it) {
+        std::vector<sector> few;
+        for (int i = 0; i < 4; ++i) {
+            few.push_back(sector{point(small(gen), small(gen), small(gen)), point(small(gen), small(gen), small(gen))});
+        }
+        scalar_type best = std::numeric_limits<scalar_type>::infinity();
+        for (size_t i = 0; i < few.size(); ++i) {
+            for (size_t j = i + 1; j < few.size(); ++j) {
+                best = std::min(best, prepared(few[i]).distance(prepared(few[j])));
+            }
+        }
+        const geom::SoA_sectors<scalar_type> set(few);
+        const auto pair = geom::closest_pair(set.get_view());
+        ASSERT_TRUE(pair);
+        EXPECT_EQ(pair->distance, best);
+    }
+}
+
+TYPED_TEST(GeomTest, DistanceMatrix) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using sector = typename TestFixture::sector;
+    using other_type = std::conditional_t<std::is_same_v<scalar_type, float>, double, float>;
+
+    // More than one tile both ways, with partial tiles at the ends.
+    const auto all = TestFixture::gen_sectors(-2., 2.);
+    const std::vector<sector> row_sectors(all.begin(), all.begin() + 150);
+    const std::vector<sector> col_sectors(all.begin() + 1000, all.begin() + 2300);
+    const geom::SoA_sectors<scalar_type> rows(row_sectors), cols(col_sectors);
+    geom::Executor executor(4);
+
+    std::vector<scalar_type> out(rows.size() * cols.size());
+    std::vector<other_type> other_out(out.size());
+    geom::distance_matrix(executor, rows.get_view(), cols.get_view(), std::span<scalar_type>(out));
+    geom::distance_matrix(executor, rows.get_view(), cols.get_view(), std::span<other_type>(other_out),
+                          geom::simd_level::scalar);
+    for (size_t i = 0; i < rows.size(); ++i) {
+        for (size_t j = 0; j < cols.size(); ++j) {
+            const scalar_type expected = geom::fast_distance(row_sectors[i], col_sectors[j]);
+            EXPECT_NEAR(out[i * cols.size() + j], expected, TestFixture::eps);
+            EXPECT_NEAR(other_out[i * cols.size() + j], expected, TestFixture::eps);
+        }
+    }
+
+    // Upper triangle of the symmetric case, written to a mapped file.
+    const geom::SoA_sectors<scalar_type> set(col_sectors);
+    const size_t n = set.size();
+    const auto path = (std::filesystem::temp_directory_path()
+                       / ("geom_test_matrix_" + std::to_string(sizeof(scalar_type)) + ".segd")).string();
+    {
+        auto file = geom::io::create_binary<scalar_type>(path, geom::io::binary_kind::distances,
+                                                         geom::upper_triangle_size(n));
+        geom::distance_matrix_upper(executor, set.get_view(),
+            geom::io::binary_array<scalar_type>(file.data(), geom::io::read_binary_header(file.data()), 0));
+    }
+    {
+        auto file = geom::io::Mapped_file::open(path);
+        const auto upper = geom::io::binary_array<scalar_type>(file.data(), geom::io::read_binary_header(file.data()), 0);
+        ASSERT_EQ(upper.size(), n * (n + 1) / 2);
+        size_t k = 0;
+        for (size_t i = 0; i < n; ++i) {
+            for (size_t j = i; j < n; ++j, ++k) {
+                ASSERT_EQ(geom::upper_triangle_index(i, j, n), k);
+                EXPECT_NEAR(upper[k], geom::fast_distance(col_sectors[i], col_sectors[j]), TestFixture::eps);
+            }
+        }
+    }
+    std::filesystem::remove(path);
+
+    EXPECT_THROW(geom::distance_matrix(executor, rows.get_view(), cols.get_view(), std::span<scalar_type>(out).first(10)),
+                 std::invalid_argument);
+    EXPECT_THROW(geom::distance_matrix_upper(executor, set.get_view(), std::span<scalar_type>(out)),
+                 std::invalid_argument);
+}
+
+TYPED_TEST(GeomTest, Polyline) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+    using polyline = geom::Polyline_3D<scalar_type>;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    // Random walks around two centers, tangled enough for close pairs all over.
+    std::mt19937 gen{5};
+    std::uniform_real_distribution<scalar_type> step(-.5, .5);
+    const auto walk = [&](point a, size_t n) {
+        std::vector<point> res{a};
+        for (size_t i = 1; i < n; ++i) {
+            a = point{a.get_x() + step(gen), a.get_y() + step(gen), a.get_z() + step(gen)};
+            res.push_back(a);
+        }
+        return res;
+    };
+
+    const auto brute_force = [](const polyline& first, const polyline& second) {
+        geom::Polyline_hit<scalar_type> res{0, 0, std::numeric_limits<scalar_type>::infinity()};
+        for (size_t i = 0; i < first.segments_count(); ++i) {
+            for (size_t j = 0; j < second.segments_count(); ++j) {
+                const scalar_type d = prepared(first.segment(i)).distance(prepared(second.segment(j)));
+                if (d < res.distance) {
+                    res = {i, j, d};
+                }
+            }
+        }
+        return res;
+    };
+
+    for (size_t n : {1, 2, 9, 100, 1000}) {
+        for (scalar_type offset : {0., 3., 20.}) {
+            const polyline first(walk(point{0, 0, 0}, n));
+            const polyline second(walk(point{offset, 0, 1}, 700));
+            EXPECT_EQ(first.segments_count(), n > 1 ? n - 1 : 1);
+            const auto expected = brute_force(first, second);
+            const auto hit = geom::closest_segments(first, second);
+            ASSERT_TRUE(hit);
+            EXPECT_NEAR(hit->distance, expected.distance, TestFixture::eps);
+            EXPECT_EQ(prepared(first.segment(hit->first_segment)).distance(prepared(second.segment(hit->second_segment))),
+                      hit->distance);
+            EXPECT_EQ(geom::distance(first, second), hit->distance);
+
+            const sector s{point{offset / 2, 1, 0}, point{offset / 2 + 1, -1, 2}};
+            scalar_type to_segment = std::numeric_limits<scalar_type>::infinity();
+            for (size_t j = 0; j < second.segments_count(); ++j) {
+                to_segment = std::min(to_segment, prepared(s).distance(prepared(second.segment(j))));
+            }
+            EXPECT_NEAR(geom::distance(second, s), to_segment, TestFixture::eps);
+        }
+    }
+
+    const polyline empty;
+    EXPECT_FALSE(geom::closest_segments(empty, polyline(walk(point{0, 0, 0}, 10))));
+    EXPECT_THROW(geom::distance(empty, empty), std::invalid_argument);
+    // No distance is a number: no hit, but not an empty polyline either.
+    const scalar_type nan = std::numeric_limits<scalar_type>::quiet_NaN();
+    const polyline broken(std::vector<point>{point{nan, 0, 0}, point{nan, 1, 0}});
+    EXPECT_FALSE(geom::closest_segments(broken, polyline(walk(point{0, 0, 0}, 10))));
+    EXPECT_TRUE(std::isnan(geom::distance(broken, broken)));
+}
+
+TYPED_TEST(GeomTest, Hausdorff) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    // A reference random walk and its noisy fit with a few outliers.
+    std::mt19937 gen{23};
+    std::uniform_real_distribution<scalar_type> step(-.3, .3), noise(-.05, .05);
+    std::vector<point> reference{point{0, 0, 0}};
+    for (size_t i = 1; i < 600; ++i) {
+        const point& a = reference.back();
+        reference.push_back(point{a.get_x() + step(gen), a.get_y() + step(gen), a.get_z() + step(gen)});
+    }
+    std::vector<point> fitted;
+    for (size_t i = 0; i < reference.size(); i += 2) {
+        const point& a = reference[i];
+        const scalar_type outlier = i % 97 == 5 ? 1 : 0;
+        fitted.push_back(point{a.get_x() + noise(gen) + outlier, a.get_y() + noise(gen), a.get_z() + noise(gen)});
+    }
+    const geom::Polyline_3D<scalar_type> first(reference), second(fitted);
+    const auto segments = [](const geom::Polyline_3D<scalar_type>& p) {
+        std::vector<sector> res;
+        for (size_t i = 0; i < p.segments_count(); ++i) {
+            res.push_back(p.segment(i));
+        }
+        return geom::SoA_sectors<scalar_type>(res);
+    };
+    const auto first_set = segments(first), second_set = segments(second);
+
+    // Largest distance over points at samples + 1 even steps of every segment.
+    const auto brute_force = [](const geom::SoA_sectors_view<scalar_type>& from,
+                                const geom::SoA_sectors_view<scalar_type>& to, size_t samples) {
+        scalar_type res = 0;
+        for (size_t i = 0; i < from.size(); ++i) {
+            const auto a = from[i].get_first_point();
+            const auto v = from[i].get_second_point() - a;
+            for (size_t k = 0; k <= samples; ++k) {
+                const auto p = a + v * (scalar_type(k) / samples);
+                scalar_type d2 = std::numeric_limits<scalar_type>::infinity();
+                for (size_t j = 0; j < to.size(); ++j) {
+                    d2 = std::min(d2, prepared(sector{p, p}).distance2(prepared(to[j])));
+                }
+                res = std::max(res, std::sqrt(d2));
+            }
+        }
+        return res;
+    };
+
+    geom::Executor executor(4), serial(1);
+    for (const auto& [from, to] : {std::pair{first_set.get_view(), second_set.get_view()},
+                                   std::pair{second_set.get_view(), first_set.get_view()}}) {
+        // Ends of segments only: the exact discrete distance whatever the order and threads.
+        const scalar_type discrete = brute_force(from, to, 1);
+        for (unsigned seed : {1u, 2u}) {
+            const auto hit = geom::directed_hausdorff(executor, from, to, geom::Hausdorff_options<scalar_type>{0, seed});
+            ASSERT_TRUE(hit);
+            EXPECT_EQ(hit->distance, discrete);
+            EXPECT_EQ(geom::directed_hausdorff(serial, from, to)->distance, discrete);
+            ASSERT_LT(hit->segment, from.size());
+            const auto s = from[hit->segment];
+            EXPECT_NEAR(prepared(s).distance(prepared(sector{hit->point, hit->point})), 0, TestFixture::eps);
+        }
+
+        // With tolerance the result is within it from dense samples,
+        // these ones are within half of a step (segments are shorter than 3) from the exact distance.
+        const scalar_type tolerance = .01;
+        const scalar_type dense = brute_force(from, to, 32);
+        const auto hit = geom::directed_hausdorff(executor, from, to, geom::Hausdorff_options<scalar_type>{tolerance});
+        ASSERT_TRUE(hit);
+        EXPECT_GE(hit->distance, discrete);
+        EXPECT_LE(dense, hit->distance + tolerance / 2 + TestFixture::eps);
+        EXPECT_LE(hit->distance, dense + scalar_type(3) / 64 + TestFixture::eps);
+    }
+
+    const scalar_type forward = brute_force(first_set.get_view(), second_set.get_view(), 1);
+    const scalar_type backward = brute_force(second_set.get_view(), first_set.get_view(), 1);
+    EXPECT_GT(backward, forward); // the outliers
+    EXPECT_EQ(geom::hausdorff(executor, first_set.get_view(), second_set.get_view()), std::max(forward, backward));
+    EXPECT_EQ(geom::hausdorff(first, second), std::max(forward, backward));
+    EXPECT_EQ(geom::directed_hausdorff(first, second)->distance, forward);
+    EXPECT_EQ(geom::directed_hausdorff(executor, second, first)->distance, backward);
+
+    const geom::SoA_sectors<scalar_type> empty;
+    EXPECT_FALSE(geom::hausdorff(executor, empty.get_view(), first_set.get_view()));
+    EXPECT_FALSE(geom::directed_hausdorff(executor, first_set.get_view(), empty.get_view()));
+    EXPECT_FALSE(geom::directed_hausdorff(geom::Polyline_3D<scalar_type>{}, first));
+}
+
+TYPED_TEST(GeomTest, PointDistance) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+    using prepared = geom::Prepared_sector_3D<scalar_type>;
+
+    const sector s{point{0, 0, 0}, point{2, 0, 0}};
+    const auto inside = geom::project(point{.5, 1, 0}, s);
+    EXPECT_NEAR(inside.t, .25, TestFixture::eps);
+    EXPECT_NEAR(inside.distance, 1, TestFixture::eps);
+    EXPECT_EQ(geom::project(point{-1, 0, 1}, s).t, 0);
+    EXPECT_EQ(geom::project(point{5, 4, 0}, s).t, 1);
+    EXPECT_NEAR(geom::distance(point{5, 4, 0}, s), 5, TestFixture::eps);
+    const auto degenerate = geom::project(point{3, 4, 0}, sector{point{0, 0, 0}, point{0, 0, 0}});
+    EXPECT_EQ(degenerate.t, 0);
+    EXPECT_NEAR(degenerate.distance, 5, TestFixture::eps);
+
+    // Against the distance to a degenerate segment, and the point at t is at the distance.
+    const auto sectors = TestFixture::gen_sectors(0, 2);
+    const auto points = TestFixture::gen_points(-1, 3);
+    for (const auto& seg : sectors) {
+        const auto a = seg.get_first_point();
+        const auto v = seg.get_second_point() - a;
+        for (const auto& p : points) {
+            const auto res = geom::project(p, seg);
+            EXPECT_GE(res.t, 0);
+            EXPECT_LE(res.t, 1);
+            EXPECT_NEAR(res.distance, prepared(seg).distance(prepared(sector{p, p})), TestFixture::eps);
+            EXPECT_NEAR(res.distance, std::sqrt(((a + v * res.t) - p).len2()), TestFixture::eps);
+        }
+    }
+
+    // Batches over all kernels, odd sizes check the scalar tail.
+    geom::SoA_points<scalar_type> cloud;
+    geom::SoA_sectors<scalar_type> pairs;
+    for (size_t i = 0; i < points.size(); ++i) {
+        for (size_t j = i % 5; j < sectors.size(); j += 7) {
+            cloud.push_back(points[i]);
+            pairs.push_back(sectors[j]);
+        }
+    }
+    const auto cloud_view = cloud.get_view().subview(3, cloud.size() - 3);
+    const auto pairs_view = pairs.get_view().subview(3, pairs.size() - 3);
+    const prepared query(sector{point{-1, .5, 2}, point{3, 1, -1}});
+    for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2,
+                       geom::simd_level::avx2, geom::simd_level::avx512}) {
+        std::vector<scalar_type> t(cloud_view.size()), d(cloud_view.size());
+        geom::batch_project(cloud_view, query, std::span<scalar_type>(t), std::span<scalar_type>(d), level);
+        for (size_t i = 0; i < t.size(); ++i) {
+            const auto expected = geom::project(cloud_view[i], query);
+            EXPECT_NEAR(t[i], expected.t, TestFixture::eps);
+            EXPECT_NEAR(d[i], expected.distance, TestFixture::eps);
+        }
+        geom::batch_project(cloud_view, pairs_view, std::span<scalar_type>(t), std::span<scalar_type>(d), level);
+        for (size_t i = 0; i < t.size(); ++i) {
+            const auto expected = geom::project(cloud_view[i], pairs_view[i]);
+            EXPECT_NEAR(t[i], expected.t, TestFixture::eps);
+            EXPECT_NEAR(d[i], expected.distance, TestFixture::eps);
+        }
+    }
+    std::vector<scalar_type> short_out(cloud.size() - 1), out(cloud.size());
+    EXPECT_THROW(geom::batch_project(cloud.get_view(), query, std::span<scalar_type>(short_out), std::span<scalar_type>(out)),
+                 std::invalid_argument);
+    EXPECT_THROW(geom::batch_project(cloud.get_view(), pairs_view, std::span<scalar_type>(out), std::span<scalar_type>(out)),
+                 std::invalid_argument);
+
+    // The nearest segment of an index per point against all segments.
+    std::mt19937 gen{31};
+    std::uniform_real_distribution<scalar_type> coord(-5, 5), step(-.5, .5);
+    geom::SoA_sectors<scalar_type> set;
+    for (size_t i = 0; i < 2000; ++i) {
+        const point a{coord(gen), coord(gen), coord(gen)};
+        set.push_back(sector{a, point{a.get_x() + step(gen), a.get_y() + step(gen), a.get_z() + step(gen)}});
+    }
+    geom::SoA_points<scalar_type> queries;
+    for (size_t i = 0; i < 3000; ++i) {
+        queries.push_back(point{coord(gen), coord(gen), coord(gen)});
+    }
+    geom::Executor executor(4);
+    const geom::Bvh_3D<scalar_type> index(set.get_view(), executor);
+    std::vector<geom::Bvh_point_hit<scalar_type>> hits(queries.size(), {0, 0, 0});
+    geom::nearest_segments(executor, index, queries.get_view(), std::span<geom::Bvh_point_hit<scalar_type>>(hits));
+    for (size_t i = 0; i < queries.size(); ++i) {
+        scalar_type best = std::numeric_limits<scalar_type>::infinity();
+        for (size_t j = 0; j < set.size(); ++j) {
+            best = std::min(best, geom::project(queries[i], prepared(set[j])).distance);
+        }
+        EXPECT_EQ(hits[i].distance, best);
+        const auto expected = geom::project(queries[i], prepared(set[hits[i].index]));
+        EXPECT_EQ(hits[i].t, expected.t);
+        EXPECT_EQ(hits[i].distance, expected.distance);
+    }
+    EXPECT_FALSE(geom::Bvh_3D<scalar_type>().nearest(point{0, 0, 0}));
+}
+
+TYPED_TEST(GeomTest, DistancePolicy) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using point = typename TestFixture::point;
+    using sector = typename TestFixture::sector;
+
+    // Grid segments: crossing, parallel, collinear, touching and degenerate pairs.
+    const auto sectors = TestFixture::gen_sectors(0, 2);
+    for (const auto& a : sectors) {
+        for (const auto& b : sectors) {
+            const scalar_type expected = geom::fast_distance(a, b);
+            EXPECT_NEAR(geom::fast_distance<geom::Clamped_policy>(a, b), expected, TestFixture::eps);
+            EXPECT_EQ(geom::distance<geom::Clamped_policy>(a, b), geom::fast_distance<geom::Clamped_policy>(a, b));
+
+            const auto closest = geom::closest_points<geom::Clamped_policy>(a, b);
+            EXPECT_GE(closest.first_param, 0);
+            EXPECT_LE(closest.first_param, 1);
+            EXPECT_GE(closest.second_param, 0);
+            EXPECT_LE(closest.second_param, 1);
+            EXPECT_NEAR(closest.distance(), expected, TestFixture::eps);
+            EXPECT_NEAR(std::sqrt((closest.first_point - closest.second_point).len2()), expected, TestFixture::eps);
+        }
+    }
+
+    // Random segments, the clamped points are never farther than the enumerated ones.
+    std::mt19937 gen{41};
+    std::uniform_real_distribution<scalar_type> coord(-1, 1);
+    for (size_t i = 0; i < 10000; ++i) {
+        const sector a{point{coord(gen), coord(gen), coord(gen)}, point{coord(gen), coord(gen), coord(gen)}};
+        const sector b{point{coord(gen), coord(gen), coord(gen)}, point{coord(gen), coord(gen), coord(gen)}};
+        EXPECT_NEAR(geom::distance<geom::Clamped_policy>(a, b), geom::fast_distance(a, b), TestFixture::eps);
+    }
+}
+
+#ifndef _WIN32
+TYPED_TEST(GeomTest, Server) {
+    using scalar_type = typename TestFixture::scalar_type;
+
+    const auto sectors = TestFixture::gen_sectors(-1., 2.);
+    const auto pairs = [&](std::size_t count, std::size_t shift) {
+        std::pair<geom::SoA_sectors<scalar_type>, geom::SoA_sectors<scalar_type>> res;
+        for (std::size_t i = 0; i < count; ++i) {
+            res.first.push_back(sectors[(i + shift) % sectors.size()]);
+            res.second.push_back(sectors[(i * 7 + 3) % sectors.size()]);
+        }
+        return res;
+    };
+    const auto expect_distances = [&](const auto& batch, const std::vector<scalar_type>& out) {
+        ASSERT_EQ(out.size(), batch.first.size());
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            EXPECT_NEAR(out[i], geom::fast_distance(batch.first.get_view()[i], batch.second.get_view()[i]),
+                        TestFixture::eps);
+        }
+    };
+
+    // Own path per process, so concurrent test runs do not meet.
+    const auto path = (std::filesystem::temp_directory_path()
+                       / ("geom_test_" + std::to_string(::getpid()) + "_" + std::to_string(sizeof(scalar_type)) + ".sock")).string();
+    {
+        // A stale socket file, nobody listens on it.
+        const auto stale = geom::net::listen_unix(path);
+    }
+    ASSERT_TRUE(std::filesystem::is_socket(path));
+    geom::net::Server server(path, {.threads = 3});
+    // A running server and other files are not replaced.
+    EXPECT_THROW(geom::net::Server(path, {.threads = 1}), std::runtime_error);
+    const auto file_path = path + ".txt";
+    std::FILE* file = std::fopen(file_path.c_str(), "w");
+    ASSERT_TRUE(file);
+    std::fclose(file);
+    EXPECT_THROW(geom::net::listen_unix(file_path), std::runtime_error);
+    EXPECT_TRUE(std::filesystem::is_regular_file(file_path));
+    std::filesystem::remove(file_path);
+
+    // Pipelined requests: all are sent first, responses come in any order.
+    auto client = geom::net::Client::connect(path);
+    const std::vector<std::size_t> counts = {0, 1, 7, 1000, 5000};
+    std::vector<std::pair<geom::SoA_sectors<scalar_type>, geom::SoA_sectors<scalar_type>>> batches;
+    std::map<std::uint32_t, std::size_t> sent;
+    for (std::size_t k = 0; k < counts.size(); ++k) {
+        batches.push_back(pairs(counts[k], k));
+        sent[client.send(batches[k].first.get_view(), batches[k].second.get_view())] = k;
+    }
+    for (std::size_t k = 0; k < counts.size(); ++k) {
+        std::vector<scalar_type> out;
+        const std::uint32_t id = client.receive(out);
+        ASSERT_EQ(sent.count(id), 1u);
+        expect_distances(batches[sent[id]], out);
+        sent.erase(id);
+    }
+
+    // Concurrent clients with round trips.
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            auto own = geom::net::Client::connect(path);
+            for (std::size_t k = 0; k < 20; ++k) {
+                const auto batch = pairs(k * 13, t + k);
+                std::vector<scalar_type> out(batch.first.size());
+                own.distance(batch.first.get_view(), batch.second.get_view(), std::span<scalar_type>(out));
+                expect_distances(batch, out);
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    // Batches above the request limit go as parts.
+    {
+        const auto large = pairs(2 * geom::net::max_request_pairs + 123, 5);
+        std::vector<scalar_type> out(large.first.size());
+        client.distance(large.first.get_view(), large.second.get_view(), std::span<scalar_type>(out));
+        expect_distances(large, out);
+        EXPECT_THROW(client.send(large.first.get_view(), large.second.get_view()), std::length_error);
+    }
+
+    // A client that sends requests without reading responses stalls its own connection only.
+    {
+        const auto stalled = geom::net::connect_unix(path);
+        const auto flood_batch = pairs(4096, 0);
+        std::thread flood([&] {
+            const auto first = flood_batch.first.get_view();
+            const auto second = flood_batch.second.get_view();
+            geom::net::Request_header header;
+            header.count = static_cast<std::uint32_t>(first.size());
+            header.scalar_size = sizeof(scalar_type);
+            const std::span<const std::byte> buffers[] = {
+                std::as_bytes(std::span(&header, 1)),
+                std::as_bytes(first.ax), std::as_bytes(first.ay), std::as_bytes(first.az),
+                std::as_bytes(first.bx), std::as_bytes(first.by), std::as_bytes(first.bz),
+                std::as_bytes(second.ax), std::as_bytes(second.ay), std::as_bytes(second.az),
+                std::as_bytes(second.bx), std::as_bytes(second.by), std::as_bytes(second.bz)};
+            for (int k = 0; k < 256 && geom::net::send_all(stalled, buffers); ++k) {
+            }
+        });
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        for (std::size_t k = 0; k < 8; ++k) {
+            const auto batch = pairs(1000, k);
+            std::vector<scalar_type> out(batch.first.size());
+            client.distance(batch.first.get_view(), batch.second.get_view(), std::span<scalar_type>(out));
+            expect_distances(batch, out);
+        }
+        stalled.shutdown();
+        flood.join();
+    }
+
+    // A bad request - wrong scalar size or signature, too many pairs - gets an error status, then the
+    // connection is closed; too large ones are rejected by the header, before their payloads are read.
+    for (const std::uint32_t count : {0u, 1u, geom::net::Server_options{}.max_request_pairs + 1}) {
+        const auto raw = geom::net::connect_unix(path);
+        geom::net::Request_header header;
+        header.id = 42;
+        header.count = count;
+        header.scalar_size = count ? sizeof(scalar_type) : 3;
+        if (count == 1) {
+            header.magic[0] = 'X';
+        }
+        const std::span<const std::byte> buffers[] = {std::as_bytes(std::span(&header, 1))};
+        ASSERT_TRUE(geom::net::send_all(raw, buffers));
+        geom::net::Response_header response;
+        ASSERT_TRUE(geom::net::recv_all(raw, std::as_writable_bytes(std::span(&response, 1))));
+        EXPECT_TRUE(geom::net::has_signature(response));
+        EXPECT_EQ(response.id, 42u);
+        EXPECT_EQ(response.status, geom::net::response_status::bad_request);
+        std::byte rest;
+        EXPECT_FALSE(geom::net::recv_all(raw, std::span(&rest, 1)));
+    }
+    // The server is still there for others.
+    std::vector<scalar_type> out(1);
+    const auto batch = pairs(1, 0);
+    client.distance(batch.first.get_view(), batch.second.get_view(), std::span<scalar_type>(out));
+    expect_distances(batch, out);
+
+    server.stop();
+    EXPECT_THROW(client.distance(batch.first.get_view(), batch.second.get_view(), std::span<scalar_type>(out)),
+                 std::runtime_error);
+    EXPECT_THROW(geom::net::Client::connect(path), std::runtime_error);
+}
+#endif
+
+TYPED_TEST(GeomTest, DistanceCache) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using sector = typename TestFixture::sector;
+
+    const auto sectors = TestFixture::gen_sectors(-1., 2.);
+    ASSERT_GE(sectors.size(), 64u);
+    const auto reversed = [](const sector& s) { return sector{s.get_second_point(), s.get_first_point()}; };
+
+    // Big enough for every pair of the first 16 segments: nothing is evicted.
+    geom::Distance_cache<scalar_type> cache(1024);
+    EXPECT_EQ(cache.capacity(), 1024u);
+    for (std::size_t i = 0; i < 16; ++i) {
+        for (std::size_t j = 0; j < 16; ++j) {
+            EXPECT_NEAR(cache.distance(sectors[i], sectors[j]), geom::distance(sectors[i], sectors[j]), TestFixture::eps);
+        }
+    }
+    // (i, j) and (j, i) are one entry: 16 * 17 / 2 distinct pairs.
+    auto counters = cache.counters();
+    EXPECT_EQ(counters.misses, 136u);
+    EXPECT_EQ(counters.hits, 256u - 136u);
+    EXPECT_EQ(counters.evictions, 0u);
+    // Reversed ends hit too.
+    EXPECT_TRUE(cache.find(reversed(sectors[3]), reversed(sectors[5])).has_value());
+    EXPECT_FALSE(cache.find(sectors[3], sectors[20]).has_value());
+    // Other bits of the same coordinates miss.
+    const sector negative_zero{{-scalar_type(0), 0, 0}, {1, 0, 0}};
+    cache.insert(sector{{0, 0, 0}, {1, 0, 0}}, sectors[0], 1);
+    EXPECT_FALSE(cache.find(negative_zero, sectors[0]).has_value());
+
+    // Small cache: bounded, evicts, stays correct.
+    geom::Distance_cache<scalar_type> small(8);
+    EXPECT_EQ(small.capacity(), 8u);
+    for (std::size_t i = 0; i < 64; ++i) {
+        EXPECT_NEAR(small.distance(sectors[i], sectors[i + 1]), geom::distance(sectors[i], sectors[i + 1]),
+                    TestFixture::eps);
+    }
+    EXPECT_EQ(small.counters().misses, 64u);
+    EXPECT_EQ(small.counters().evictions, 64u - 8u);
+    // CLOCK keeps the referenced entry: a pair hit before every insert is never evicted.
+    small.clear();
+    EXPECT_EQ(small.counters().misses, 0u);
+    small.distance(sectors[0], sectors[1]);
+    for (std::size_t i = 2; i < 64; ++i) {
+        EXPECT_TRUE(small.find(sectors[1], sectors[0]).has_value());
+        small.distance(sectors[i], sectors[i + 1]);
+    }
+    EXPECT_TRUE(small.find(sectors[0], sectors[1]).has_value());
+
+    // Batch API, repeated pairs over executor threads.
+    geom::SoA_sectors<scalar_type> first, second;
+    for (std::size_t i = 0; i < 5000; ++i) {
+        first.push_back(sectors[i % 50]);
+        second.push_back(sectors[(i * 7) % 30]);
+    }
+    std::vector<scalar_type> out(first.size());
+    geom::Distance_cache<scalar_type> shared(4096);
+    geom::Executor executor(4);
+    for (int round = 0; round < 2; ++round) {
+        std::fill(out.begin(), out.end(), scalar_type(-1));
+        geom::parallel_batch_distance(executor, shared, first.get_view(), second.get_view(), std::span<scalar_type>(out));
+        // Entries come from geom::distance only, of the first seen order of the pair.
+        for (std::size_t i = 0; i < out.size(); ++i) {
+            const sector a = first.get_view()[i], b = second.get_view()[i];
+            EXPECT_TRUE(out[i] == geom::distance(a, b) || out[i] == geom::distance(b, a));
+            EXPECT_EQ(out[i], shared.distance(a, b));
+        }
+    }
+    // Two rounds of the batch and of the checks; all but the first batch round hit.
+    counters = shared.counters();
+    EXPECT_EQ(counters.hits + counters.misses, 4 * first.size());
+    EXPECT_GE(counters.hits, 3 * first.size());
+    EXPECT_THROW(geom::batch_distance(shared, first.get_view(), second.get_view(), std::span<scalar_type>(out).first(1)),
+                 std::invalid_argument);
+    EXPECT_THROW(geom::Distance_cache<scalar_type>(0), std::invalid_argument);
+}
+
+TYPED_TEST(GeomTest, CurveOrder) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using sector = typename TestFixture::sector;
+
+    static_assert(geom::morton_code(1, 0, 0) == 1 && geom::morton_code(0, 1, 0) == 2 && geom::morton_code(0, 0, 1) == 4);
+    static_assert(geom::morton_code(0x1fffff, 0x1fffff, 0x1fffff) == (std::uint64_t(1) << 63) - 1);
+    static_assert(geom::hilbert_code(0, 0, 0) == 0);
+    // Cells of an aligned cube go in a run of the Hilbert curve, every step to a face neighbour.
+    std::vector<std::pair<std::uint64_t, std::array<int, 3>>> cells;
+    for (int x = 0; x < 16; ++x) {
+        for (int y = 0; y < 16; ++y) {
+            for (int z = 0; z < 16; ++z) {
+                cells.push_back({geom::hilbert_code(x, y, z), {x, y, z}});
+            }
+        }
+    }
+    std::sort(cells.begin(), cells.end());
+    EXPECT_EQ(cells.back().first, 4095u);
+    for (std::size_t i = 1; i < cells.size(); ++i) {
+        const auto& [a, b] = std::pair(cells[i - 1].second, cells[i].second);
+        EXPECT_EQ(std::abs(a[0] - b[0]) + std::abs(a[1] - b[1]) + std::abs(a[2] - b[2]), 1);
+    }
+
+    // Random segments, enough for parallel passes of the sort, and a few NaN ones.
+    std::mt19937 gen{11};
+    std::uniform_real_distribution<scalar_type> coord{-100, 100}, offset{-1, 1};
+    geom::SoA_sectors<scalar_type> source;
+    for (std::size_t i = 0; i < 200000; ++i) {
+        const typename TestFixture::point a{coord(gen), coord(gen), coord(gen)};
+        source.push_back(sector{a, {a.get_x() + offset(gen), a.get_y() + offset(gen), a.get_z() + offset(gen)}});
+    }
+    const scalar_type nan = std::numeric_limits<scalar_type>::quiet_NaN();
+    source.set(7, sector{{nan, 0, 0}, {0, 0, 0}});
+
+    geom::Executor executor(4);
+    for (auto curve : {geom::space_curve::morton, geom::space_curve::hilbert}) {
+        const geom::Sector_order<scalar_type> ordered(source.get_view(), executor, curve);
+        ASSERT_EQ(ordered.size(), source.size());
+        std::vector<bool> seen(source.size());
+        double step = 0, shuffled_step = 0;
+        for (std::size_t k = 0; k < ordered.size(); ++k) {
+            const std::size_t i = ordered.original(k);
+            ASSERT_FALSE(seen[i]);
+            seen[i] = true;
+            EXPECT_EQ(ordered.position(i), k);
+            const sector s = ordered.sectors()[k];
+            const sector t = source[i];
+            EXPECT_EQ(s.get_first_point().get_y(), t.get_first_point().get_y());
+            EXPECT_EQ(s.get_second_point().get_z(), t.get_second_point().get_z());
+            // Steps to and from the NaN segment are skipped.
+            if (k && k != ordered.position(7) && k != ordered.position(7) + 1) {
+                step += (ordered.sectors()[k - 1].get_first_point() - s.get_first_point()).len();
+            }
+            if (k && k != 7 && k != 8) {
+                shuffled_step += (source[k - 1].get_first_point() - source[k].get_first_point()).len();
+            }
+        }
+        // Neighbours in the order are near in space.
+        EXPECT_LT(step * 20, shuffled_step);
+
+        // The order does not depend on threads.
+        const geom::Sector_order<scalar_type> serial(source.get_view(), curve);
+        EXPECT_TRUE(std::ranges::equal(serial.permutation(), ordered.permutation()));
+
+        std::vector<scalar_type> sorted_values(ordered.size()), restored(ordered.size());
+        for (std::size_t k = 0; k < ordered.size(); ++k) {
+            sorted_values[k] = static_cast<scalar_type>(ordered.original(k));
+        }
+        ordered.restore(std::span<const scalar_type>(sorted_values), std::span<scalar_type>(restored));
+        for (std::size_t i = 0; i < restored.size(); i += 97) {
+            EXPECT_EQ(restored[i], static_cast<scalar_type>(i));
+        }
+    }
+
+    // Batch and index paths give source indices and the same results.
+    source.set(7, source[8]);
+    const geom::Sector_order<scalar_type> ordered(source.get_view(), executor);
+    std::vector<geom::index_pair> pairs;
+    for (std::size_t i = 0; i < 50000; ++i) {
+        pairs.push_back({(i * 7919) % source.size(), (i * 104729 + 3) % source.size()});
+    }
+    std::vector<scalar_type> expected(pairs.size()), out(pairs.size());
+    geom::parallel_distance(executor, source.get_view(), std::span<const geom::index_pair>(pairs),
+                            std::span<scalar_type>(expected));
+    geom::parallel_distance(executor, ordered, std::span<const geom::index_pair>(pairs), std::span<scalar_type>(out));
+    EXPECT_EQ(out, expected);
+    pairs.push_back({source.size(), 0});
+    out.push_back(0);
+    EXPECT_THROW(geom::parallel_distance(executor, ordered, std::span<const geom::index_pair>(pairs), std::span<scalar_type>(out)),
+                 std::out_of_range);
+
+    const geom::Bvh_3D<scalar_type> plain(source.get_view(), executor);
+    const geom::Bvh_3D<scalar_type> index(ordered, executor);
+    ASSERT_EQ(index.size(), source.size());
+    for (std::size_t q = 0; q < 200; ++q) {
+        const sector query = source[(q * 997) % source.size()];
+        const auto hit = index.nearest(query);
+        ASSERT_TRUE(hit);
+        EXPECT_EQ(hit->distance, plain.nearest(query)->distance);
+        EXPECT_NEAR(hit->distance, geom::fast_distance(query, source[hit->index]), TestFixture::eps);
+        EXPECT_EQ(index.within(query, 3).size(), plain.within(query, 3).size());
+    }
+}
+
+TYPED_TEST(GeomTest, Quantized) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using sector = typename TestFixture::sector;
+
+    // Short segments of a scene ordered by locality, and a tile of one repeated segment.
+    std::mt19937 gen{13};
+    std::uniform_real_distribution<scalar_type> coord{-100, 100}, offset{-2, 2};
+    geom::SoA_sectors<scalar_type> scene;
+    for (std::size_t i = 0; i < 20000; ++i) {
+        const typename TestFixture::point a{coord(gen), coord(gen), coord(gen)};
+        scene.push_back(sector{a, {a.get_x() + offset(gen), a.get_y() + offset(gen), a.get_z() + offset(gen)}});
+    }
+    const geom::Sector_order<scalar_type> ordered(scene.get_view());
+    geom::SoA_sectors<scalar_type> source;
+    for (std::size_t k = 0; k < ordered.size(); ++k) {
+        source.push_back(ordered.sectors()[k]);
+    }
+    for (std::size_t i = 0; i < 300; ++i) {
+        source.push_back(sector{{1, 2, 3}, {1, 2, 3}});
+    }
+
+    const auto check = [&](const auto& quantized) {
+        ASSERT_EQ(quantized.size(), source.size());
+        EXPECT_LT(quantized.bytes(), source.size() * 6 * sizeof(scalar_type));
+        for (std::size_t i = 0; i < source.size(); ++i) {
+            const sector s = source[i];
+            const sector q = quantized[i];
+            EXPECT_LE((s.get_first_point() - q.get_first_point()).len(), quantized.error(i));
+            EXPECT_LE((s.get_second_point() - q.get_second_point()).len(), quantized.error(i));
+        }
+        // The repeated segment is exact, tiles of the scene are a few steps wide.
+        EXPECT_EQ(quantized.error(source.size() - 1) < TestFixture::eps, true);
+        EXPECT_LT(quantized.max_error(), scalar_type(0.01));
+
+        std::vector<scalar_type> approx(source.size()), exact(source.size());
+        std::vector<std::uint8_t> within(source.size());
+        for (std::size_t q = 0; q < 20; ++q) {
+            const geom::Prepared_sector_3D<scalar_type> query(source[(q * 7919) % source.size()]);
+            for (auto level : {geom::simd_level::scalar, geom::simd_level::sse2, geom::simd_level::avx2,
+                               geom::simd_level::avx512}) {
+                geom::batch_distance(query, quantized, std::span<scalar_type>(approx), level);
+                for (std::size_t i = 0; i < source.size(); ++i) {
+                    exact[i] = query.distance(source[i]);
+                    EXPECT_LE(std::abs(approx[i] - exact[i]), quantized.error(i) + TestFixture::eps);
+                }
+                // Exactly the full precision answers, most of them without rechecks.
+                for (scalar_type dist : {scalar_type(0), scalar_type(5), exact[(q * 31) % source.size()]}) {
+                    const std::size_t rechecks = geom::batch_within_distance(
+                        query, quantized, source.get_view(), dist, std::span<std::uint8_t>(within), level);
+                    EXPECT_LT(rechecks, source.size() / 20);
+                    for (std::size_t i = 0; i < source.size(); ++i) {
+                        ASSERT_EQ(within[i], exact[i] <= dist);
+                    }
+                }
+            }
+        }
+    };
+    check(geom::Quantized_sectors<scalar_type, 16>(source.get_view()));
+    check(geom::Quantized_sectors<scalar_type, 21>(source.get_view()));
+
+    const geom::Quantized_sectors<scalar_type, 21> fine(source.get_view());
+    const geom::Quantized_sectors<scalar_type, 16> coarse(source.get_view());
+    EXPECT_LT(fine.max_error(), coarse.max_error());
+
+    std::vector<scalar_type> out(3);
+    const geom::Prepared_sector_3D<scalar_type> query(source[0]);
+    EXPECT_THROW(geom::batch_distance(query, coarse, std::span<scalar_type>(out)), std::invalid_argument);
+    source.set(5, sector{{std::numeric_limits<scalar_type>::quiet_NaN(), 0, 0}, {0, 0, 0}});
+    EXPECT_THROW(geom::Quantized_sectors<scalar_type>(source.get_view()), std::invalid_argument);
+}
+
+TYPED_TEST(GeomTest, ClosestApproach) {
+    using scalar_type = typename TestFixture::scalar_type;
+    using sector = typename TestFixture::sector;
+    using vector = geom::Vector_3D<scalar_type>;
+    using moving = geom::Moving_sector_3D<scalar_type>;
+    constexpr scalar_type eps = TestFixture::eps;
+
+    // A crossbar falls onto a static segment at time 5.
+    const moving bar{sector{{-1, 0, 0}, {1, 0, 0}}, vector::zero()};
+    const moving falling{sector{{0, -1, 5}, {0, 1, 5}}, vector{0, 0, -1}};
+    auto res = geom::closest_approach(bar, falling, scalar_type(0), scalar_type(10));
+    EXPECT_NEAR(res.time, 5, eps);
+    EXPECT_NEAR(res.distance, 0, eps);
+    res = geom::closest_approach(bar, falling, scalar_type(0), scalar_type(3));
+    EXPECT_NEAR(res.time, 3, eps);
+    EXPECT_NEAR(res.distance, 2, eps);
+    // Passing by in parallel planes, and not moving relative to each other.
+    res = geom::closest_approach(bar, moving{sector{{-5, -1, 1}, {-5, 1, 1}}, vector{1, 0, 0}}, scalar_type(0), scalar_type(10));
+    EXPECT_NEAR(res.distance, 1, eps);
+    EXPECT_NEAR(geom::distance(bar.at(res.time), sector{{res.time - 5, -1, 1}, {res.time - 5, 1, 1}}), 1, eps);
+    res = geom::closest_approach(falling, falling, scalar_type(1), scalar_type(2));
+    EXPECT_EQ(res.time, 1);
+    EXPECT_NEAR(res.distance, 0, eps);
+
+    // Random pairs against dense sampling: the distance is reached at the time, and not above the samples.
+    std::mt19937 gen{17};
+    std::uniform_real_distribution<scalar_type> coord{-3, 3}, speed{-1, 1};
+    const auto gen_vector = [&] { return vector{speed(gen), speed(gen), speed(gen)}; };
+    const auto gen_sector = [&] { return sector{{coord(gen), coord(gen), coord(gen)}, {coord(gen), coord(gen), coord(gen)}}; };
+    std::vector<moving> first, second;
+    for (std::size_t i = 0; i < 400; ++i) {
+        const bool translating = i % 2 == 0;
+        const vector va = gen_vector();
+        const vector vb = gen_vector();
+        first.push_back(translating ? moving{gen_sector(), va} : moving{gen_sector(), va, gen_vector()});
+        second.push_back(translating ? moving{gen_sector(), vb} : moving{gen_sector(), vb, gen_vector()});
+    }
+    const scalar_type from = 1, to = 5;
+    std::vector<geom::Closest_approach<scalar_type>> out(first.size()), parallel_out(first.size());
+    geom::batch_closest_approach(std::span<const moving>(first), std::span<const moving>(second), from, to,
+                                 std::span<geom::Closest_approach<scalar_type>>(out));
+    for (std::size_t i = 0; i < first.size(); ++i) {
+        const auto expected = geom::closest_approach(first[i], second[i], from, to);
+        EXPECT_EQ(out[i].time, expected.time);
+        EXPECT_EQ(out[i].distance, expected.distance);
+        ASSERT_GE(out[i].time, from);
+        ASSERT_LE(out[i].time, to);
+        EXPECT_NEAR(out[i].distance, geom::distance(first[i].at(out[i].time), second[i].at(out[i].time)), eps);
+        scalar_type sampled = std::numeric_limits<scalar_type>::infinity();
+        for (int k = 0; k <= 2000; ++k) {
+            const scalar_type t = from + (to - from) * scalar_type(k) / 2000;
+            sampled = std::min(sampled, geom::distance(first[i].at(t), second[i].at(t)));
+        }
+        EXPECT_LE(out[i].distance, sampled + 2 * eps) << i;
+        // Relative speeds are below 4, samples are 0.002 apart.
+        EXPECT_GE(out[i].distance, sampled - scalar_type(0.004) - eps) << i;
+        // The general solver agrees on translating pairs.
+        if (i % 2 == 0) {
+            const auto general = geom::impl::moving_approach(first[i], second[i], from, to);
+            EXPECT_NEAR(general.distance, out[i].distance, eps) << i;
+        }
+    }
+
+    geom::Executor executor(3);
+    geom::parallel_closest_approach(executor, std::span<const moving>(first), std::span<const moving>(second), from, to,
+                                    std::span<geom::Closest_approach<scalar_type>>(parallel_out));
+    for (std::size_t i = 0; i < first.size(); ++i) {
+        EXPECT_EQ(parallel_out[i].distance, out[i].distance);
+    }
+
+    EXPECT_THROW(geom::closest_approach(bar, falling, scalar_type(2), scalar_type(1)), std::invalid_argument);
+    out.pop_back();
+    EXPECT_THROW(geom::batch_closest_approach(std::span<const moving>(first), std::span<const moving>(second), from, to,
+                                              std::span<geom::Closest_approach<scalar_type>>(out)),
+                 std::invalid_argument);
+}
@@ -0,0 +1,140 @@
+#include <gtest/gtest.h>
+
+#include <geom/distance.h>
+#include <geom/fast_distance.h>
+#include <geom/closest_points.h>
+#include <geom/batch_distance.h>
+#include <geom/parallel_distance.h>
+#include <geom/stats.h>
+
+#include <chrono>
+#include <numeric>
+#include <vector>
+
+using point = geom::Point_3D<double>;
+using sector = geom::Sector_3D<double>;
+using geom::stats::path;
+
+namespace
+{
+
+const sector base{point{-1., 0., 0.}, point{1., 0., 0.}};
+// The closest points of lines are inside both segments.
+const sector crossing{point{0., -1., 1.}, point{0., 1., 1.}};
+// Parallel, the closest pair is an end of it and its projection onto base.
+const sector parallel{point{.5, 1., 0.}, point{3., 1., 0.}};
+const sector degenerate{point{5., 0., 0.}, point{5., 0., 0.}};
+
+std::uint64_t candidate_calls(const geom::stats::Counters& counters) {
+    return std::accumulate(counters.candidate_pairs.begin(), counters.candidate_pairs.end(), std::uint64_t(0));
+}
+
+} // namespace
+
+TEST(Stats, DistancePaths) {
+    static_assert(geom::stats::enabled);
+    for (int kernel = 0; kernel < 3; ++kernel) {
+        geom::stats::reset();
+        for (const sector& s : {crossing, parallel, degenerate}) {
+            switch (kernel) {
+            case 0:
+                EXPECT_NEAR(geom::distance(base, s), geom::fast_distance(base, s), 1e-9);
+                break;
+            case 1:
+                geom::fast_distance(base, s);
+                break;
+            default:
+                geom::closest_points(base, s);
+                break;
+            }
+        }
+        const auto counters = geom::stats::snapshot();
+        // geom::distance checks against fast_distance, which counts too.
+        const std::uint64_t calls = kernel ? 1 : 2;
+        EXPECT_EQ(counters[path::skew], calls);
+        EXPECT_EQ(counters[path::parallel], calls);
+        EXPECT_EQ(counters[path::degenerate], calls);
+        EXPECT_EQ(counters[path::crossing], calls);
+        EXPECT_EQ(counters[path::projection], calls);
+        EXPECT_EQ(counters[path::ends], calls);
+        EXPECT_EQ(candidate_calls(counters), 3 * calls);
+    }
+
+    // Crossing pair: projections of ends are inside too, 5 candidates per segment;
+    // degenerate one: the point (twice) against ends of base, its projection is out of base.
+    geom::stats::reset();
+    geom::fast_distance(base, crossing);
+    geom::fast_distance(degenerate, base);
+    EXPECT_EQ(geom::stats::snapshot().candidate_pairs[25], 1u);
+    EXPECT_EQ(geom::stats::snapshot().candidate_pairs[4], 1u);
+
+    // Clamped kernel counts the input class only.
+    geom::stats::reset();
+    geom::fast_distance<geom::Clamped_policy>(base, crossing);
+    geom::fast_distance<geom::Clamped_policy>(base, degenerate);
+    const auto clamped = geom::stats::snapshot();
+    EXPECT_EQ(clamped[path::skew], 1u);
+    EXPECT_EQ(clamped[path::degenerate], 1u);
+    EXPECT_EQ(clamped[path::crossing] + clamped[path::projection] + clamped[path::ends], 0u);
+    EXPECT_EQ(candidate_calls(clamped), 0u);
+
+    // Constant evaluation records nothing.
+    constexpr double folded = geom::distance(sector{point{0., 0., 0.}, point{1., 0., 0.}},
+                                             sector{point{0., 1., 0.}, point{1., 1., 0.}});
+    static_assert(folded == 1.);
+}
+
+TEST(Stats, ThreadCounters) {
+    constexpr std::size_t count = 10000;
+    geom::SoA_sectors<double> first, second;
+    for (std::size_t i = 0; i < count; ++i) {
+        first.push_back(base);
+        second.push_back(i % 2 ? crossing : parallel);
+    }
+    std::vector<double> out(count);
+
+    geom::stats::reset();
+    geom::batch_distance(first.get_view(), second.get_view(), std::span<double>(out));
+    EXPECT_EQ(geom::stats::snapshot()[path::skew], count / 2);
+    EXPECT_EQ(geom::stats::snapshot()[path::parallel], count / 2);
+
+    geom::stats::reset();
+    {
+        geom::Executor executor(4);
+        geom::parallel_batch_distance(executor, first.get_view(), second.get_view(), std::span<double>(out));
+        // Counters of live worker threads.
+        EXPECT_EQ(candidate_calls(geom::stats::snapshot()), count);
+    }
+    // Counters of finished threads are kept.
+    const auto counters = geom::stats::snapshot();
+    EXPECT_EQ(candidate_calls(counters), count);
+    EXPECT_EQ(counters[path::crossing], count / 2);
+    EXPECT_EQ(counters[path::projection], count / 2);
+}
+
+TEST(Stats, LatencyHistogram) {
+    using namespace std::chrono_literals;
+    geom::stats::Latency_histogram histogram;
+    EXPECT_EQ(histogram.quantile(.5), 0u);
+    for (auto d : {0ns, 1ns, 3ns, 3ns, 1000ns}) {
+        histogram.add(d);
+    }
+    EXPECT_EQ(histogram.count(), 5u);
+    EXPECT_EQ(histogram.min(), 0u);
+    EXPECT_EQ(histogram.max(), 1000u);
+    EXPECT_EQ(histogram.sum(), 1007u);
+    EXPECT_EQ(histogram.buckets()[0], 1u);
+    EXPECT_EQ(histogram.buckets()[1], 1u);
+    EXPECT_EQ(histogram.buckets()[2], 2u);
+    EXPECT_EQ(histogram.buckets()[10], 1u);
+    EXPECT_EQ(histogram.quantile(.5), 4u);
+    EXPECT_EQ(histogram.quantile(1.), 1000u);
+
+    EXPECT_EQ(geom::stats::to_json(histogram),
+              "{\"count\":5,\"min_ns\":0,\"max_ns\":1000,\"mean_ns\":201,\"p50_ns\":4,\"p90_ns\":1000,\"p99_ns\":1000,"
+              "\"buckets\":[{\"below_ns\":1,\"count\":1},{\"below_ns\":2,\"count\":1},{\"below_ns\":4,\"count\":2},"
+              "{\"below_ns\":1024,\"count\":1}]}");
+    const auto counters = geom::stats::to_json(geom::stats::Counters{});
+    EXPECT_EQ(counters.find("{\"skew\":0,\"parallel\":0,\"degenerate\":0,"), 0u);
+    EXPECT_NE(counters.find("\"candidate_pairs\":[0,"), std::string::npos);
+}